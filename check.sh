@@ -0,0 +1,67 @@
+#!/bin/sh
+# Adrian Unruh
+# checks the result records against the puzzle fixtures
+# run: gcc -o sudoku sudoku.c -lm -pthread -lz && sh check.sh [./sudoku]
+
+sudoku=${1:-./sudoku}
+failed=0
+
+fail() {
+  echo "FAIL: $1"
+  failed=1
+}
+
+# every csv record has as many fields as the header, malformed ones too
+for options in "" "-s" "-m count" "-m unique" "-m unique -N 1000" "-e portfolio"; do
+  fields=$(printf '9\n1 2 3\n' | "$sudoku" $options -f csv - 2>/dev/null |
+           awk -F, 'NR == 1 { n = NF } NR > 1 && NF != n { bad = 1 } END { print (NR > 1 && !bad) ? "ok" : "bad" }')
+  [ "$fields" = ok ] || fail "malformed csv record with options '$options' does not match the header"
+  fields=$("$sudoku" $options -f csv puzzle-valid-complete.txt missing.txt 2>/dev/null |
+           awk -F, 'NR == 1 { n = NF } NR > 1 && NF != n { bad = 1 } END { print (NR == 3 && !bad) ? "ok" : "bad" }')
+  [ "$fields" = ok ] || fail "unreadable csv record with options '$options' does not match the header"
+done
+
+# a complete grid is its own only solution when valid and has none otherwise
+record=$("$sudoku" -m unique -f csv puzzle-valid-complete.txt 2>/dev/null | tail -n 1)
+[ "${record##*,false,}" = "1,true" ] || fail "complete valid grid: $record"
+record=$("$sudoku" -m unique -f csv puzzle-not-valid.txt 2>/dev/null | tail -n 1)
+[ "${record##*,false,}" = "0,false" ] || fail "complete invalid grid: $record"
+record=$("$sudoku" -m unique -f jsonl puzzle2-incomplete.txt 2>/dev/null)
+case $record in
+  *'"solutions":1,"unique":true}') ;;
+  *) fail "incomplete grid with one solution: $record" ;;
+esac
+
+# every solver runs out of 100 search nodes on the sparse 25x25 board, and the
+# default and bitmask solvers out of 100 ms, which the default solver needs 7
+# times over, and each prints its fullest partial grid without breaking a given
+for budget in "-N 100" "-N 100 -e bitmask" "-N 100 -e dlx" "-N 100 -e sat" "-N 100 -e portfolio" \
+              "-T 100" "-T 100 -e bitmask"; do
+  result=$("$sudoku" $budget puzzle3-sparse.txt 2>/dev/null |
+           awk 'NR == FNR { if (FNR > 1) for (i = 1; i <= NF; i++) given[FNR, i] = $i; next }
+                /^Stopped by budget\? true/ { stopped = 1 }
+                /^Cells fixed:/ { fixed = $3; row = -1; next }
+                row == -1 { row = 0; next }
+                row != "" && row < 25 { row++
+                  for (i = 1; i <= NF; i++) { if ($i != 0) cells++
+                    if (given[row + 1, i] != 0 && given[row + 1, i] != $i) broken = 1 } }
+                END { print (stopped && row == 25 && cells == fixed && !broken) ? "ok" : "bad" }' \
+               puzzle3-sparse.txt -)
+  [ "$result" = ok ] || fail "partial grid with budget '$budget'"
+done
+fixed=$("$sudoku" -N 100 -f csv puzzle3-sparse.txt 2>/dev/null | tail -n 1)
+case $fixed in
+  *,false,true,[0-9]*) ;;
+  *) fail "partial record with budget '-N 100': $fixed" ;;
+esac
+
+# a second run answers every puzzle from the result cache with the same records
+cache=${TMPDIR:-/tmp}/sudoku-check-$$.cache
+first=$("$sudoku" -b -s -C "$cache" -f csv puzzles-corpus.txt 2>/dev/null | cut -d, -f1-4,6-)
+second=$("$sudoku" -b -s -C "$cache" -f csv puzzles-corpus.txt 2>"$cache.err" | cut -d, -f1-4,6-)
+[ -n "$first" ] && [ "$first" = "$second" ] || fail "records read back from the result cache differ"
+grep -q '^disk cache: [0-9]* hits, 0 misses' "$cache.err" || fail "second run missed the result cache: $(cat "$cache.err")"
+rm -f "$cache" "$cache.index" "$cache.err"
+
+[ $failed = 0 ] && echo "all checks passed"
+exit $failed
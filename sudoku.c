@@ -1,15 +1,237 @@
 // Adrian Unruh
-// compile: gcc -o sudoku -lm -pthread sudoku.c
+// compile: gcc -o sudoku sudoku.c -lm -pthread -lz
 // run (verify complete puzzle and valid puzzle): ./sudoku puzzle.txt
+// run (complete puzzles that have empty cells): ./sudoku -s puzzle.txt
+// run (exact cover solver, count or list every solution): ./sudoku -e dlx -m count puzzle.txt
+// run (reject puzzles without exactly one solution): ./sudoku -m unique -f csv - < puzzles.txt
+// run (only the backtracking search, no deductions): ./sudoku -e bitmask puzzle.txt
+// run (clause learning sat solver for sparse big boards): ./sudoku -e sat puzzle.txt
+// run (sat encoding for an outside solver): ./sudoku -d puzzle.cnf puzzle.txt
+// run (every solver racing, the first to finish wins): ./sudoku -e portfolio -f csv - < puzzles.txt
+// run (one big puzzle searched by 8 threads stealing work): ./sudoku -s -t 8 puzzle.txt
+// run (at most 2 seconds of search per puzzle, partial grids otherwise): ./sudoku -T 2000 -f csv - < puzzles.txt
+// run (complete a stream of puzzles, 9x9 ones in SSE registers): ./sudoku -s -f csv - < puzzles.txt
+// run (verify many puzzles): ./sudoku -j 8 puzzles/ more.txt -l list.txt
+// run (read many small files through io_uring): ./sudoku -u -j 8 puzzles/
+// run (stream of puzzles from a pipe): generate | ./sudoku -
+// run (gzip compressed corpus): ./sudoku corpus.txt.gz  or  ./sudoku -z - < corpus.gz
+// run (one csv or json record per puzzle): ./sudoku -f csv puzzles/   ./sudoku -f jsonl - < puzzles.txt
+// run (millions of puzzles, one worker per chunk of puzzles): ./sudoku -b -j 8 corpus.txt
+// run (staged pipeline, 2 readers, 2 parsers, 4 validators): ./sudoku -b -p 2,2,4 -q 32 corpus.txt
+// run (solve repeated and equivalent puzzles once): ./sudoku -s -c -b corpus.txt
+// run (keep verdicts and solutions across runs in a memory-mapped log): ./sudoku -b -s -C results.cache corpus.txt
+// run (4 worker processes pinned to cores, one shard of the corpus each): ./sudoku -b -P 4 -a corpus.txt
+// run (resumable after being stopped, rerun the same command): ./sudoku -b -k run.ckpt -f csv corpus.txt >> out.csv
+// run (coordinator handing batches to workers over tcp): ./sudoku -b -S 0.0.0.0:7000 corpus.txt
+//     and on every worker host: ./sudoku -W coordinator:7000 -j 8
+// test (result records against the puzzle fixtures): sh check.sh
 
 // Sudoku puzzle verifier and solver
 
+#define _GNU_SOURCE
 #include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/io_uring.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// largest puzzle width accepted by the parser
+#define MAX_PUZZLE_SIZE 64
+
+// number of finished results the pool may hold before the writer catches up
+#define RESULT_WINDOW_PER_THREAD 16
+
+// number of files opened/read/closed per io_uring submission,
+// also the number of registered read buffers
+#define URING_BATCH 64
+
+// size of each registered read buffer, larger files are read the normal way
+#define URING_BUFFER_SIZE (32 * 1024)
+
+// initial and largest read buffer of a puzzle stream, the largest
+// buffer must hold one whole MAX_PUZZLE_SIZE puzzle
+#define STREAM_BUFFER_SIZE (64 * 1024)
+#define STREAM_BUFFER_LIMIT (1024 * 1024)
+
+// size of the ring buffer between the decompression thread and the parser
+#define RING_BUFFER_SIZE (1024 * 1024)
+
+// largest single gzread, so the parser can start before the ring is full
+#define INFLATE_CHUNK_SIZE (64 * 1024)
+
+// size of the result serializer's output buffer
+#define RESULT_BUFFER_SIZE (64 * 1024)
+
+// number of puzzles read, validated and written per round in batch mode
+#define BATCH_CHUNK_PUZZLES 65536
+
+// bytes of a mapped corpus parsed per round in batch mode, cut at a record boundary
+#define PARSE_WINDOW_BYTES (32 * 1024 * 1024)
+
+// number of puzzles a batch worker claims at a time, a multiple of TILE_LANES
+#define BATCH_GRAIN 256
+
+// number of 9x9 puzzles validated together in structure-of-arrays form
+#define TILE_LANES 64
+
+// bytes of corpus text per pipeline block, blocks are cut at record boundaries
+#define PIPELINE_BLOCK_SIZE (1024 * 1024)
+
+// extra bytes read past a block to find where its last record ends
+#define PIPELINE_READ_AHEAD (64 * 1024)
+
+// default capacity of each pipeline queue, also the most blocks in flight
+#define PIPELINE_QUEUE_DEPTH 16
+
+// number of buckets and lock stripes of the solution cache
+#define CACHE_BUCKETS (1 << 20)
+#define CACHE_LOCK_STRIPES 64
+
+// most answers the solution cache holds, later ones are not stored
+#define CACHE_MAX_ENTRIES (4 << 20)
+
+// largest puzzle whose canonical form is searched, bigger ones are cached
+// under their cells as given
+#define CANON_MAX_SIZE 16
+#define CANON_MAX_BOX 4
+
+// most arrangements kept tied while a canonical form is searched, a puzzle
+// with more is cached under its cells as given
+#define CANON_MAX_STATES 1024
+
+// tags of a solution cache key
+#define CACHE_KEY_CANONICAL 1
+#define CACHE_KEY_CELLS 2
+
+// puzzles missed under their cells that always get a canonical search, and
+// how often one is searched after the search has stopped paying for itself
+#define CANON_WARMUP 256
+#define CANON_PROBE_INTERVAL 64
+
+// fewest slots of a result cache index, a power of two, the writer sizes the
+// index to four slots per record in the log when it opens the cache
+#define DISK_INDEX_MIN_SLOTS (1 << 16)
+
+// the writer rebuilds a bigger index at open past this fill level, and stops
+// indexing new records past the second until the next open, in percent
+#define DISK_INDEX_GROW_LOAD 50
+#define DISK_CACHE_MAX_LOAD 75
+
+// how often and how many milliseconds apart a reader looks again at a cache
+// log whose writer has not written its header yet
+#define DISK_CACHE_OPEN_RETRIES 50
+#define DISK_CACHE_RETRY_MS 10
+
+// identify the result cache log and index file formats
+#define DISK_CACHE_MAGIC "SUDOKUL1"
+#define DISK_INDEX_MAGIC "SUDOKUI1"
+#define DISK_CACHE_VERSION 3
+
+// identifies the batch checkpoint file format
+#define CHECKPOINT_MAGIC "SUDOKUK1"
+#define CHECKPOINT_VERSION 2
+
+// least time between two batch checkpoints
+#define CHECKPOINT_INTERVAL_NANOS 2000000000LL
+
+// number of puzzles per batch sent to a remote worker
+#define NET_BATCH_PUZZLES 4096
+
+// batches a remote worker may hold at once
+#define NET_WORKER_WINDOW 2
+
+// batches read ahead of the output by the coordinator
+#define NET_MAX_OUTSTANDING 64
+
+// largest frame payload accepted from a peer
+#define NET_MAX_FRAME (64 << 20)
+
+// search levels split into separate tasks by the parallel solver, deeper
+// subtrees are searched by the thread that owns them
+#define SOLVE_SPLIT_DEPTH 8
+
+// tasks each solver thread's deque can hold, capacity must be a power of two
+#define SOLVE_DEQUE_CAPACITY 4096
+
+// conflicts before the sat solver first restarts, later restarts come after
+// multiples of it following the Luby sequence
+#define SAT_RESTART_CONFLICTS 100
+
+// learnt clauses the sat solver keeps before it drops the weaker half,
+// the limit grows by a tenth every time
+#define SAT_LEARNT_LIMIT 2000
+
+// factor by which variable activities fade after each conflict
+#define SAT_ACTIVITY_DECAY 0.95
+
+// search nodes between two looks at the budget of a solve, the clock is
+// only read that often
+#define SOLVE_BUDGET_INTERVAL 1024
+
+// frame types of the coordinator/worker protocol, every frame starts with a
+// 16 byte header: type, payload length (big-endian 32 bit), batch sequence (64 bit)
+// a batch payload is a puzzle count and per puzzle a size byte (0 for a
+// malformed record) and its cells, one byte each
+// a verdict payload is a puzzle count and per puzzle 8 bytes:
+// loaded|complete|valid bits, failing unit kind, failing index (16 bit), nanos (32 bit)
+// followed, when the run solves, by 16 more: attempted|solved|outOfBudget bits,
+// the answering solver, fixed cells (16 bit), solutions (64 bit), solve nanos (32 bit)
+// an options payload, sent once to each worker as it connects, holds the solve
+// options: solver, mode, threads (16 bit), limit, node and time budget (64 bit each)
+#define FRAME_BATCH 1
+#define FRAME_VERDICTS 2
+#define FRAME_DONE 3
+#define FRAME_OPTIONS 4
+#define FRAME_HEADER_SIZE 16
+#define FRAME_OPTIONS_SIZE 28
+#define VERDICT_SIZE 8
+#define SOLVED_VERDICT_SIZE 24
+
+// states of a batch held by the coordinator
+#define NET_PENDING 0
+#define NET_SENT 1
+#define NET_DONE 2
+
+// bits of a result cache record's state word, COUNTED marks a record that
+// holds a search outcome and EXACT one whose count is not a lower bound
+#define DISK_RECORD_COMPLETE 1
+#define DISK_RECORD_VALID 2
+#define DISK_RECORD_COUNTED 4
+#define DISK_RECORD_EXACT 8
+
+// kinds of unit reported as the first failing unit of a puzzle
+#define UNIT_NONE 0
+#define UNIT_ROW 1
+#define UNIT_COLUMN 2
+#define UNIT_BOX 3
+
+// stored in a batch for cell values that cannot be valid
+#define BATCH_BAD_CELL 255
 
 /* structure for passing data to threads */
   typedef struct {
@@ -26,13 +248,914 @@
 
   } Parameters;
 
+/* how results are written */
+  typedef enum {
+      // the original human readable output
+      FORMAT_TEXT,
+      // one comma separated line per puzzle after a header line
+      FORMAT_CSV,
+      // one json object per line
+      FORMAT_JSONL
+  } OutputFormat;
+
+/* how incomplete puzzles are completed */
+  typedef enum {
+      // incomplete puzzles are only reported
+      SOLVER_NONE,
+      // backtracking over row/column/box bitmasks, fewest candidates first
+      SOLVER_BITMASK,
+      // dancing links exact cover search, smallest column first
+      SOLVER_DLX,
+      // deductions over candidate sets, search only when they stall
+      SOLVER_LOGIC,
+      // conflict driven clause learning over the cell/value sat encoding
+      SOLVER_SAT,
+      // the solvers above racing on their own threads, the first to finish wins
+      SOLVER_PORTFOLIO
+  } SolverKind;
+
+/* what a solver looks for */
+  typedef enum {
+      // the first solution, written into the grid
+      SOLVE_ONE,
+      // the number of solutions
+      SOLVE_COUNT,
+      // whether there is exactly one solution, counts up to two
+      SOLVE_UNIQUE,
+      // every solution, written out one by one
+      SOLVE_ALL
+  } SolveMode;
+
+/* solution cache entry, keyed by the cells of a puzzle as given or by its canonical form
+   the options of a run are fixed, so an entry holds its answer to them */
+  typedef struct CacheEntry {
+      struct CacheEntry* next;
+      unsigned long long hash;
+      // solutions found and the solver that found them
+      long long solutions;
+      SolverKind strategy;
+      // whether the solution in the labels of the key follows the key
+      bool hasSolution;
+      // CACHE_KEY_* tag, psize and the cells
+      int keyLen;
+      unsigned char key[];
+  } CacheEntry;
+
+/* concurrent map from puzzle key to answer, shared by all workers */
+  typedef struct {
+      CacheEntry** buckets;
+      // bucket b is guarded by locks[b % CACHE_LOCK_STRIPES]
+      pthread_mutex_t locks[CACHE_LOCK_STRIPES];
+      long entries;
+      long hits;
+      long misses;
+      // the canonical search runs while its hits save more search time than
+      // it takes: searches done, their hits and nanoseconds, and the searches
+      // stored answers came from and their nanoseconds
+      long canons;
+      long canonHits;
+      long long canonNanos;
+      long solves;
+      long long solveNanos;
+  } ResultCache;
+
+/* key a puzzle is cached under, its cells as given or its canonical form, and
+   the arrangement that produces it */
+  typedef struct {
+      // CACHE_KEY_* tag, psize, then the cells in key order and labels
+      int keyLen;
+      unsigned char key[2 + MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+      unsigned long long hash;
+      // canonical row i and column j are source row rows[i] and column cols[j]
+      // of the puzzle, transposed first if transpose is set
+      bool transpose;
+      unsigned char rows[MAX_PUZZLE_SIZE];
+      unsigned char cols[MAX_PUZZLE_SIZE];
+      // canonical label of every digit, a permutation of 1..psize
+      unsigned char label[MAX_PUZZLE_SIZE + 1];
+  } CanonicalPuzzle;
+
+/* one arrangement tied for the smallest canonical rows found so far
+   columns are placed lazily: the first slotFixed[p] columns of stack slot p
+   are placed, the other columns of its stack were empty in every placed row
+   and may still come in any order, as may the stacks of slots from freeSlot on */
+  typedef struct {
+      bool transpose;
+      // source rows placed so far
+      unsigned char rows[CANON_MAX_SIZE];
+      unsigned int usedRows;
+      // source column of each placed column
+      unsigned char cols[CANON_MAX_SIZE];
+      unsigned int usedCols;
+      // source stack of each slot before freeSlot
+      unsigned char slotStack[CANON_MAX_BOX];
+      unsigned char slotFixed[CANON_MAX_BOX];
+      unsigned char freeSlot;
+      unsigned int usedStacks;
+      // label of each digit, 0 until it appears, and the labels of each digit
+      // class handed out so far, indexed by the first label of the class
+      unsigned char label[CANON_MAX_SIZE + 1];
+      unsigned char taken[CANON_MAX_SIZE + 2];
+  } CanonState;
+
+/* search for the arrangements giving the smallest next canonical row */
+  typedef struct {
+      int psize;
+      int boxSize;
+      // the cells row by row, as given and transposed
+      unsigned char views[2][CANON_MAX_SIZE * CANON_MAX_SIZE];
+      // first label of the class of each digit, digits are classed by their
+      // number of givens and classes with more take the smaller labels
+      unsigned char classLabel[CANON_MAX_SIZE + 1];
+      // canonical row being placed and the source row tried for it
+      int level;
+      int row;
+      // weights of the smallest row so far, 0xFF past where it is known
+      unsigned char best[CANON_MAX_SIZE];
+      // the arrangements reaching it, and whether there were too many
+      CanonState* states;
+      int count;
+      bool overflow;
+  } CanonSearch;
+
+/* header at the start of a result cache log */
+  typedef struct {
+      char magic[8];
+      unsigned int version;
+      // size of a record header, checked when the file is opened
+      unsigned int recordSize;
+      char reserved[16];
+  } DiskCacheHeader;
+
+/* one result in the cache log, followed by the solution when there is one,
+   padded to 8 bytes; records are only ever appended and a later record for
+   a grid supersedes the earlier ones */
+  typedef struct {
+      unsigned long long hashLo;
+      unsigned long long hashHi;
+      // DISK_RECORD_* bits
+      unsigned int state;
+      // first failing unit kind << 16 | its index
+      unsigned int failing;
+      // solutions found, a lower bound unless DISK_RECORD_EXACT is set
+      long long solutions;
+      unsigned int strategy;
+      // cells of the solution that follows, 0 for none
+      unsigned int solutionLen;
+      // checksum of the record and its solution, tells a torn last record apart
+      unsigned long long check;
+  } DiskRecord;
+
+/* header of the index of a cache log, kept in a file next to the log and
+   rebuilt from the log whenever it is missing, stale or too small */
+  typedef struct {
+      char magic[8];
+      unsigned int version;
+      // size of one slot, checked when the file is mapped
+      unsigned int slotSize;
+      // number of slots, a power of two
+      unsigned long long capacity;
+      // number of slots filled
+      unsigned long long used;
+      // records before indexed are all in the index, the writer appends at logLength
+      unsigned long long indexed;
+      unsigned long long logLength;
+      // inode of the log the index was built for
+      unsigned long long logInode;
+      // set by the writer once it found the index full and warned
+      unsigned int full;
+      char reserved[20];
+  } DiskIndexHeader;
+
+/* one slot of a cache index, found by linear probing on the hash, holding
+   the log offset of the newest record for the hash, 0 while empty
+   the offset is written last so readers never see a half-filled slot */
+  typedef struct {
+      unsigned long long hashLo;
+      unsigned long long hashHi;
+      unsigned long long offset;
+  } DiskSlot;
+
+/* memory-mapped result cache, an append-only log keyed by a 128-bit hash of
+   the grid through its index; any number of processes may read it, one
+   process at a time may write */
+  typedef struct {
+      int fd;
+      // whether this process holds the writer lock
+      bool writable;
+      // the log as far as it was written at open, later records are read with pread
+      const char* log;
+      size_t logMapSize;
+      // the index, shared with the file for the writer and private to a reader
+      size_t indexMapSize;
+      DiskIndexHeader* index;
+      DiskSlot* slots;
+      // serializes the writing threads, in shared memory so that worker
+      // processes forked from the writer take turns as well
+      pthread_mutex_t* writeLock;
+      long hits;
+      long misses;
+      long stored;
+  } DiskCache;
+
+/* how incomplete puzzles are completed */
+  typedef struct {
+      SolverKind kind;
+      SolveMode mode;
+      // threads searching one puzzle
+      int threads;
+      // solutions after which counting and listing stop, 0 for no limit
+      long long limit;
+      // search nodes and nanoseconds each puzzle may take, 0 for no limit
+      long long nodeBudget;
+      long long timeBudget;
+      // answers of repeated and equivalent puzzles solved before, or NULL
+      ResultCache* cache;
+      // results kept across runs, looked up before the solution cache, or NULL
+      DiskCache* diskCache;
+  } SolveOptions;
+
+/* solver throughput of a run, kept apart from the validation figures */
+  typedef struct {
+      long long puzzles;
+      long long solved;
+      long long unique;
+      long long nanos;
+      // puzzles whose search ran out of budget before it had an answer
+      long long stopped;
+      // puzzles each solver answered first in a portfolio race
+      long long wins[SOLVER_PORTFOLIO];
+  } SolveStats;
+
+/* verdict for one puzzle */
+  typedef struct {
+      // set once the result has been filled in
+      bool done;
+      // false if the puzzle could not be read or parsed
+      bool loaded;
+      bool complete;
+      bool valid;
+      // true if the puzzle was incomplete and a solver completed it
+      bool solved;
+      // solutions found when counting or listing them
+      long long solutions;
+      // true if a solver ran, and the time it took (also part of nanos)
+      bool attempted;
+      long long solveNanos;
+      // solver that answered, the winner when several raced
+      SolverKind strategy;
+      // true if the search ran out of budget before it had an answer, and the
+      // cells (givens included) filled in the partial grid it left
+      bool outOfBudget;
+      int fixedCells;
+      // first unit found not holding 1..N, one of UNIT_*, and its 1-based index
+      int failingUnit;
+      int failingIndex;
+      // time spent validating
+      long long nanos;
+  } PuzzleResult;
+
+/* buffered serializer for compact result records, reuses one fixed buffer */
+  typedef struct {
+      FILE* out;
+      OutputFormat format;
+      // true when records carry whether the puzzle was solved,
+      // how many solutions it has, whether that is exactly one,
+      // which solver won the race and whether the budget stopped it
+      bool solving;
+      bool counting;
+      bool uniqueness;
+      bool racing;
+      bool budgeted;
+      size_t len;
+      char buf[RESULT_BUFFER_SIZE];
+  } ResultWriter;
+
+/* growable list of puzzle file paths, kept in input order */
+  typedef struct {
+      // path strings owned by the list
+      char** items;
+      // number of paths stored
+      int count;
+      // number of slots allocated
+      int capacity;
+  } PathList;
+
+/* buffered reader that pulls puzzles of either format out of a byte stream */
+  typedef struct {
+      // reads up to len bytes into dst, returns 0 at end of input and -1 on error
+      ssize_t (*read)(void* source, char* dst, size_t len);
+      // file descriptor or other state passed to read
+      void* source;
+      // buffered input, bytes start..end are not consumed yet
+      char* buf;
+      size_t capacity;
+      size_t start;
+      size_t end;
+      // true once read reported the end of input
+      bool eof;
+      // bytes of input consumed by the records taken so far
+      long long position;
+      // writer flushed before each read, so results are not held back
+      // while waiting for more input
+      ResultWriter* flushBeforeRead;
+  } PuzzleStream;
+
+/* byte ring buffer between one producer thread and one consumer thread */
+  typedef struct {
+      // ring storage
+      char* data;
+      size_t capacity;
+      // total bytes written and read, their difference is the fill level
+      unsigned long long written;
+      unsigned long long read;
+      // set by the producer when no more bytes will come
+      bool closed;
+      // set by the producer if the input could not be decoded
+      bool failed;
+      pthread_mutex_t lock;
+      // signalled when bytes are added or the ring is closed
+      pthread_cond_t notEmpty;
+      // signalled when bytes are taken out
+      pthread_cond_t notFull;
+  } ByteRing;
+
+/* decompression thread input, gzip data is inflated into the ring */
+  typedef struct {
+      gzFile input;
+      ByteRing* ring;
+  } InflateJob;
+
+/* an open puzzle input: a file, stdin, or a gzip stream inflated on its own thread */
+  typedef struct {
+      // descriptor being read, or the compressed input's descriptor
+      int fd;
+      // whether fd was opened here and must be closed
+      bool ownsFd;
+      // whether a decompression thread feeds the stream
+      bool compressed;
+      gzFile gz;
+      ByteRing ring;
+      InflateJob job;
+      pthread_t inflateThread;
+      // puzzles are read from here
+      PuzzleStream stream;
+  } PuzzleSource;
+
+/* progress of a batch run, enough to continue it after a restart
+   written whenever the output is flushed up to the records it counts */
+  typedef struct {
+      char magic[8];
+      unsigned int version;
+      // output format and inputs of the run, a resumed run must match them
+      int format;
+      unsigned long long pathsHash;
+      // input being read and the bytes of it already validated
+      int pathIndex;
+      long long inputOffset;
+      // puzzles written and malformed records seen so far
+      long written;
+      long failures;
+      long long validateNanos;
+      // size of the output at this point, -1 if the output cannot seek
+      long long outputOffset;
+      // solve options of the run, which a resumed run must match as well,
+      // and the solver figures so far
+      int solver;
+      int solveMode;
+      long long solveLimit;
+      long long nodeBudget;
+      long long timeBudget;
+      SolveStats solveStats;
+  } Checkpoint;
+
+/* many puzzles stored back to back for batch validation */
+  typedef struct {
+      // number of puzzles held and allocated
+      int count;
+      int capacity;
+      // size of each puzzle, -1 for a malformed record
+      int* sizes;
+      // index of each puzzle's first cell in cells
+      size_t* offsets;
+      // row-major cells of all puzzles, values outside 0..size are stored as BATCH_BAD_CELL
+      unsigned char* cells;
+      size_t cellCount;
+      size_t cellCapacity;
+      // verdict of each puzzle
+      PuzzleResult* results;
+      // how incomplete puzzles are completed, or NULL to only validate them
+      const SolveOptions* solve;
+      // persistent result cache consulted before validating, or NULL
+      DiskCache* diskCache;
+  } PuzzleBatch;
+
+/* a corpus file mapped into memory and parsed a window at a time */
+  typedef struct {
+      const char* text;
+      size_t size;
+      // start of the first record not parsed yet
+      size_t offset;
+  } MappedCorpus;
+
+/* one byte range of a mapped corpus window, parsed by its own thread
+   the first pass counts the records and cells of the range, the second
+   stores them, or their verdicts, from the given batch slot on */
+  typedef struct {
+      const char* text;
+      // bytes mapped, kernels may read past the range up to here
+      size_t size;
+      size_t from;
+      size_t to;
+      bool store;
+      int count;
+      size_t cellCount;
+      long malformed;
+      PuzzleBatch* batch;
+      int first;
+      size_t firstCell;
+  } ParseRange;
+
+/* work shared by the batch validation workers */
+  typedef struct {
+      PuzzleBatch* batch;
+      // index of the next puzzle to hand out, claimed BATCH_GRAIN at a time
+      int next;
+  } BatchJob;
+
+/* what a shard worker process reports back to the coordinator */
+  typedef struct {
+      // records parsed and how many of them were malformed
+      long count;
+      long malformed;
+      long long validateNanos;
+      // solution and result cache use of the worker
+      long cacheHits;
+      long cacheMisses;
+      long diskHits;
+      long diskMisses;
+      long diskStored;
+      // set last, once the worker's results are all in place
+      bool done;
+  } ShardStats;
+
+/* a batch held by the tcp coordinator until its verdicts are written */
+  typedef struct {
+      long seq;
+      // NET_PENDING, NET_SENT or NET_DONE
+      int state;
+      // worker the batch was last sent to
+      int worker;
+      PuzzleBatch batch;
+      // encoded batch frame, kept so the batch can be sent again
+      unsigned char* frame;
+      size_t frameLen;
+  } NetBatch;
+
+/* connection from the tcp coordinator to one worker */
+  typedef struct {
+      int fd;
+      // batches sent and not answered yet
+      int inFlight;
+  } NetWorker;
+
+/* bounded lock-free multi-producer multi-consumer queue of pointers */
+  typedef struct {
+      // a cell's sequence number says whether it is free for the producer
+      // of a position or holds an item for the consumer of that position
+      size_t* sequences;
+      void** items;
+      // capacity - 1, the capacity is a power of two
+      size_t mask;
+      // next position to fill and to take, on separate cache lines
+      char pad0[64];
+      size_t enqueuePos;
+      char pad1[64];
+      size_t dequeuePos;
+      char pad2[64];
+      // most items seen in the queue at once, for tuning the depth
+      size_t highWater;
+  } BlockQueue;
+
+/* a record-aligned piece of corpus text travelling through the pipeline */
+  typedef struct {
+      // position in the output order
+      long seq;
+      // text buffer and the part of it this block owns
+      char* text;
+      size_t start;
+      size_t end;
+      // puzzles parsed from the text and their verdicts
+      PuzzleBatch batch;
+  } PipelineBlock;
+
+/* staged read -> parse -> validate -> write pipeline over corpus files */
+  typedef struct {
+      PathList* paths;
+      bool gzipInput;
+      // threads per stage and queue capacity
+      int readers;
+      int parsers;
+      int validators;
+      size_t depth;
+      BlockQueue parseQueue;
+      BlockQueue validateQueue;
+      BlockQueue writeQueue;
+      // reader state, guarded by readLock
+      pthread_mutex_t readLock;
+      int fileIndex;
+      bool sourceOpen;
+      // regular files are split by offset and read with pread by any reader
+      bool seekable;
+      int fd;
+      off_t fileSize;
+      off_t fileOffset;
+      // other inputs are read in order, carrying the partial last record
+      PuzzleSource source;
+      char* carry;
+      size_t carryLen;
+      long nextSeq;
+      // descriptors of regular files, closed when the pipeline ends
+      int* fds;
+      // number of blocks the writer has emitted, readers stay within depth of it
+      long written;
+      // threads still running in each stage, the last one sets the done flag
+      int activeReaders;
+      int activeParsers;
+      int activeValidators;
+      bool readersDone;
+      bool parsersDone;
+      bool validatorsDone;
+      // inputs that could not be opened or read
+      long failures;
+      // how the validators complete incomplete puzzles, or NULL
+      const SolveOptions* solve;
+      // result cache shared by the validators, or NULL
+      DiskCache* diskCache;
+  } Pipeline;
+
+/* state shared by the threads of the file validation pool */
+  typedef struct {
+      // files to validate, in input order
+      PathList* paths;
+      // how results are written
+      OutputFormat format;
+      // how incomplete puzzles are completed
+      const SolveOptions* solve;
+      // verdict of each file
+      PuzzleResult* results;
+      // text format result of each file
+      char** outputs;
+      // length of each text format result
+      size_t* outputSizes;
+      // true when a separate ingestion thread reads and parses the files
+      bool ingest;
+      // parsed grid and size of each ingested file, size is -1 if unreadable
+      int*** grids;
+      int* sizes;
+      // number of files the ingestion thread has parsed so far
+      int ingested;
+      // index of the next file to hand to a worker
+      int next;
+      // number of results already written by the writer
+      int written;
+      // how far workers may run ahead of the writer
+      int window;
+      pthread_mutex_t lock;
+      // signalled when a worker finishes a file
+      pthread_cond_t resultReady;
+      // signalled when the writer frees a slot in the window
+      pthread_cond_t windowOpen;
+      // signalled when the ingestion thread publishes parsed files
+      pthread_cond_t ingestReady;
+      // ring used by the ingestion thread
+      struct Uring* ring;
+  } FilePool;
+
+/* io_uring instance driven through raw syscalls, with its mapped rings */
+  typedef struct Uring {
+      // ring file descriptor
+      int fd;
+      // submission queue ring fields
+      unsigned* sqHead;
+      unsigned* sqTail;
+      unsigned* sqMask;
+      unsigned* sqArray;
+      struct io_uring_sqe* sqes;
+      // completion queue ring fields
+      unsigned* cqHead;
+      unsigned* cqTail;
+      unsigned* cqMask;
+      struct io_uring_cqe* cqes;
+      // mappings to release on teardown
+      void* sqRing;
+      size_t sqRingSize;
+      void* cqRing;
+      size_t cqRingSize;
+      size_t sqesSize;
+      // fixed buffer pool registered with the ring
+      char* buffers;
+  } Uring;
+
+/* node and time limits of one solve, the threads searching a puzzle
+   together share one */
+  typedef struct {
+      // search nodes the searches on the budget may take together, 0 for no limit
+      long long nodes;
+      // nowNanos() time to stop at, 0 for none
+      long long deadline;
+      // set once a limit is reached, stops every search on the budget
+      bool spent;
+      // nodes the searches have reported so far, each adds its own at every
+      // look at the budget
+      long long used;
+  } SearchBudget;
+
+/* how a search keeps to its budget: the node count at which it next looks
+   at it, and the fullest consistent assignment it has reached, which is
+   what it leaves in the grid when the budget stops it */
+  typedef struct {
+      // NULL for a search without limits
+      SearchBudget* budget;
+      // LLONG_MAX without a budget, so the check is a single comparison
+      long long check;
+      // nodes of this search already added to the budget
+      long long counted;
+      int cells;
+      // cells the best assignment fixes, counted the search's own way, and
+      // its row-major values (0 open)
+      int bestFixed;
+      unsigned char* best;
+  } BudgetTracker;
+
+/* state of the bitmask backtracking solver, sized for the largest puzzle
+   so that a search never allocates */
+  typedef struct {
+      int psize;
+      int boxSize;
+      // bit v-1 is set when value v is used in the row, column or box
+      unsigned long long rows[MAX_PUZZLE_SIZE];
+      unsigned long long cols[MAX_PUZZLE_SIZE];
+      unsigned long long boxes[MAX_PUZZLE_SIZE];
+      // all psize value bits
+      unsigned long long full;
+      // row-major values, 0 for an empty cell
+      unsigned char cells[MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+      // indices of the cells that were empty, the first depth of them are filled
+      unsigned short empties[MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+      int emptyCount;
+      // search steps taken
+      long long nodes;
+      // complete grids found, the search stops when they reach limit
+      long long solutions;
+      long long limit;
+      // set by another thread when the search should give up, may be NULL
+      const bool* cancel;
+      BudgetTracker tracker;
+  } BitmaskSolver;
+
+/* dancing links matrix for the exact cover form of a puzzle
+   columns stand for the constraints cell filled, value in row, value in
+   column and value in box, matrix rows for placing a value in a cell
+   all nodes come from one pool sized from psize, node 0 is the root and
+   nodes 1..4*psize*psize the column headers */
+  typedef struct {
+      int psize;
+      // links of every node
+      int* left;
+      int* right;
+      int* up;
+      int* down;
+      // column header of a node, and the placement (cell * psize + value - 1)
+      // a node stands for
+      int* column;
+      int* placement;
+      // number of nodes in each column, indexed by header node
+      int* size;
+      int nodeCount;
+      // placements of the givens and the chosen ones, depth of them in use
+      int* chosen;
+      int givenCount;
+      int depth;
+      SolveMode mode;
+      long long solutions;
+      long long limit;
+      long long nodes;
+      // receives each solution in SOLVE_ALL mode
+      FILE* out;
+      int** grid;
+      // set by another thread when the search should give up, may be NULL
+      const bool* cancel;
+      BudgetTracker tracker;
+  } DlxSolver;
+
+/* candidate sets of every cell, narrowed by deductions
+   units are the rows (0..psize-1), columns (psize..2*psize-1) and
+   boxes (2*psize..3*psize-1), each listing its cells in order */
+  typedef struct {
+      int psize;
+      int boxSize;
+      int cells;
+      unsigned long long full;
+      int* unitCells;
+      // row, column and box unit of each cell
+      int* cellUnits;
+      // candidates and placed value (0 while open) of each cell
+      unsigned long long* candidates;
+      unsigned char* values;
+      int remaining;
+      // every change since the search started, taken back when it backs up:
+      // the cell (-1 - cell for a placement) and its candidates before
+      // a cell only ever loses candidates on the way down, so cells * psize
+      // entries are enough
+      int* trailCells;
+      unsigned long long* trailMasks;
+      int trailCount;
+      // open cells down to one candidate, waiting to be placed
+      int* singles;
+      int singleCount;
+      // units whose cells changed since they were last examined
+      int* unitQueue;
+      int queueHead;
+      int queueCount;
+      bool* unitQueued;
+      long long nodes;
+      // complete grids found, the search stops when they reach limit
+      long long solutions;
+      long long limit;
+      // set by another thread when the search should give up, may be NULL
+      const bool* cancel;
+      BudgetTracker tracker;
+  } LogicSolver;
+
+/* subtree of the parallel search: the candidates it starts from and the
+   value it places first */
+  typedef struct {
+      int depth;
+      int cell;
+      unsigned long long bit;
+      int remaining;
+      unsigned long long* candidates;
+      unsigned char* values;
+  } SolveTask;
+
+/* Chase-Lev work stealing deque, the owner pushes and pops at bottom,
+   other threads steal from top */
+  typedef struct {
+      long long top;
+      long long bottom;
+      SolveTask* tasks[SOLVE_DEQUE_CAPACITY];
+  } TaskDeque;
+
+/* state shared by the threads of the parallel search */
+  typedef struct {
+      int psize;
+      int** grid;
+      int threads;
+      TaskDeque* deques;
+      // tasks pushed and not yet finished, the search is over at zero
+      long long pending;
+      // set by the thread that completes the grid, stops the others
+      bool found;
+      unsigned char* solution;
+      long long nodes;
+      // shared by every thread, may be NULL
+      SearchBudget* budget;
+  } ParallelSearch;
+
+/* argument of a parallel search thread, which hands back the fullest
+   assignment it reached */
+  typedef struct {
+      ParallelSearch* search;
+      int id;
+      BudgetTracker tracker;
+  } SearchThread;
+
+/* state shared by the solvers of a portfolio race */
+  typedef struct {
+      int psize;
+      SolveMode mode;
+      long long limit;
+      // limits each solver gets a budget of its own with, may be NULL
+      const SearchBudget* budget;
+      // solver that finished first, SOLVER_NONE until then
+      SolverKind winner;
+      // set by the winner, stops the others
+      bool done;
+  } PortfolioRace;
+
+/* one solver of a portfolio race, with its own copy of the grid and budget */
+  typedef struct {
+      PortfolioRace* race;
+      SolverKind kind;
+      int** grid;
+      long long solutions;
+      SearchBudget budget;
+  } PortfolioEntry;
+
+#if defined(__SSE2__)
+/* candidates of a 9x9 puzzle kept in SSE registers, one word per digit
+   each 32-bit lane holds a band of three rows, cell r*9+c is bit
+   (r%3)*9+c of lane r/3, so cell numbers run 27 to a lane and lane 3
+   stays zero */
+  typedef struct {
+      __m128i digits[9];
+      __m128i solved;
+  } Simd9State;
+
+/* what a register resident search has found and how far it may go */
+  typedef struct {
+      long long solutions;
+      long long limit;
+      long long nodes;
+      BudgetTracker tracker;
+  } Simd9Search;
+#endif
+
+/* growable array of ints */
+  typedef struct {
+      int* items;
+      int count;
+      int capacity;
+  } IntList;
+
+/* conflict driven clause learning solver over the sat encoding of a puzzle,
+   only the values the givens leave open in a cell get a variable
+   literal 2*v is variable v true and 2*v+1 variable v false
+   clauses of three or more literals live in one arena as their size, their
+   lbd (0 for clauses of the puzzle) and their literals, watched on the first
+   two, two literal clauses only live in the implication lists */
+  typedef struct {
+      int psize;
+      int vars;
+      // placement (cell * psize + value - 1) of each variable
+      int* placements;
+      IntList arena;
+      // arena offsets of the learnt clauses
+      IntList learnts;
+      // (clause, blocker) pairs of the clauses watching each literal,
+      // visited when the literal becomes false
+      IntList* watches;
+      // literals made true when each literal becomes true
+      IntList* implies;
+      // 1 true, -1 false, 0 open, per literal
+      signed char* values;
+      int* levels;
+      // clause that implied each variable: an arena offset, -1 for a decision
+      // or a level 0 unit, -2 - lit for a two literal clause with other literal lit
+      int* reasons;
+      // literal each variable took last, tried first when it is decided again
+      int* phases;
+      double* activity;
+      double increment;
+      // open variables, max heap on activity
+      int* heap;
+      int* heapIndex;
+      int heapCount;
+      int* trail;
+      int trailCount;
+      int propagated;
+      // trail length where each decision level starts
+      int* levelStarts;
+      int level;
+      // scratch of conflict analysis
+      unsigned char* seen;
+      IntList learnt;
+      int* levelStamps;
+      int stamp;
+      // literals of a conflicting two literal clause
+      int binaryConflict[2];
+      long long conflicts;
+      long long decisions;
+      long long restarts;
+      int learntLimit;
+      // positive literals on the trail, the cells the assignment fixes
+      int placed;
+      // set by another thread when the search should give up, may be NULL
+      const bool* cancel;
+      BudgetTracker tracker;
+  } SatSolver;
+
 void* checkRow(void* parameters);
 void* checkCol(void* parameters);
 void* checkBox(void* parameters);
 bool verifyPuzzleComplete(int** puzzle, int size);
-
-// stores the current box index
-int boxCount = 1;
+void writeSudokuPuzzle(FILE* out, int psize, int** grid);
+void deleteSudokuPuzzle(int psize, int** grid);
+void flushResultWriter(ResultWriter* writer);
+size_t findRecordStart(const char* buf, size_t len, size_t pos, bool eof, bool* found);
+FILE* diagnosticOutput(OutputFormat format);
+bool lookupCachedSolution(ResultCache* cache, int psize, int** grid, bool withSolution,
+                          CanonicalPuzzle* given, CanonicalPuzzle* canon, PuzzleResult* result);
+bool hashPuzzleGrid(int psize, int** grid, unsigned long long* lo, unsigned long long* hi);
+bool lookupDiskSolution(DiskCache* cache, unsigned long long lo, unsigned long long hi,
+                        const SolveOptions* options, int psize, int** grid, PuzzleResult* result);
+void storeDiskResult(DiskCache* cache, unsigned long long lo, unsigned long long hi,
+                     const PuzzleResult* result, const SolveOptions* solve, int psize, int** grid);
+void closeDiskCache(DiskCache* cache);
+void storeCachedSolution(ResultCache* cache, int psize, int** grid, bool withSolution,
+                         const CanonicalPuzzle* given, const CanonicalPuzzle* canon,
+                         const PuzzleResult* result, long long searchNanos);
 
 // takes puzzle size and grid[][] representing sudoku puzzle
 // and tow booleans to be assigned: complete and valid.
@@ -41,7 +1164,8 @@ int boxCount = 1;
 // A puzzle is complete if it can be completed with no 0s in it
 // If complete, a puzzle is valid if all rows/columns/boxes have numbers from 1
 // to psize For incomplete puzzles, we cannot say anything about validity
-void checkPuzzle(int psize, int **grid, bool *complete, bool *valid) {
+// internal errors are reported where a run writing results in format reports problems
+void checkPuzzle(int psize, int **grid, bool *complete, bool *valid, OutputFormat format) {
 
   // determine whether the puzzle is complete
   *complete = verifyPuzzleComplete(grid, psize);
@@ -167,27 +1291,28 @@ void checkPuzzle(int psize, int **grid, bool *complete, bool *valid) {
 
     // error checking for if an index was never checked
     if (rowValidity[i] == -1) {
-      printf("ERROR: not all rows were checked\n");
+      fprintf(diagnosticOutput(format), "ERROR: not all rows were checked\n");
       *valid = false;
-      return;
+      break;
     }
     if (colValidity[i] == -1) {
-      printf("ERROR: not all columns were checked\n");
+      fprintf(diagnosticOutput(format), "ERROR: not all columns were checked\n");
       *valid = false;
-      return;
+      break;
     }
     if (boxValidity[i] == -1) {
-      printf("ERROR: not all boxes were checked\n");
+      fprintf(diagnosticOutput(format), "ERROR: not all boxes were checked\n");
       *valid = false;
-      return;
+      break;
     }
 
     if (rowValidity[i] == 0 || colValidity[i] == 0 || boxValidity[i] == 0) {
       *valid = false;
-      return;
+      break;
     }
   }
-  
+
+
   // free validity and thread arrays
   free(rowValidity);
   free(colValidity);
@@ -198,94 +1323,472 @@ void checkPuzzle(int psize, int **grid, bool *complete, bool *valid) {
   free(boxThreads);
 }
 
-// takes filename and pointer to grid[][]
-// returns size of Sudoku puzzle and fills grid
-int readSudokuPuzzle(char *filename, int ***grid) {
-  FILE *fp = fopen(filename, "r");
-  if (fp == NULL) {
-    printf("Could not open file %s\n", filename);
-    exit(EXIT_FAILURE);
+// whether c separates numbers in the puzzle formats
+static bool isBlank(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// reads the next whitespace separated integer from buf[*pos..len)
+// returns false if the buffer ends before a number or the token is not a number
+static bool scanInt(const char* buf, size_t len, size_t* pos, int* value) {
+  size_t i = *pos;
+  while (i < len && isBlank(buf[i])) {
+    i++;
+  }
+  bool negative = false;
+  if (i < len && buf[i] == '-') {
+    negative = true;
+    i++;
+  }
+  if (i >= len || buf[i] < '0' || buf[i] > '9') {
+    return false;
   }
+  int result = 0;
+  while (i < len && buf[i] >= '0' && buf[i] <= '9') {
+    if (result < 100000000) {
+      result = result * 10 + (buf[i] - '0');
+    }
+    i++;
+  }
+  *value = negative ? -result : result;
+  *pos = i;
+  return true;
+}
+
+// skips count whitespace separated tokens of a malformed record from buf[pos..len)
+// returns -1 with *used past them, or 0 if more bytes are needed before eof
+static int skipPuzzleTokens(const char* buf, size_t len, bool eof, size_t pos, int count, size_t* used) {
+  for (int i = 0; i < count; i++) {
+    while (pos < len && isBlank(buf[pos])) {
+      pos++;
+    }
+    while (pos < len && !isBlank(buf[pos])) {
+      pos++;
+    }
+    if (pos == len && !eof) {
+      return 0;
+    }
+  }
+  *used = pos;
+  return -1;
+}
+
+// scans the next puzzle record from buf[0..len) into cells (row-major, psize*psize)
+// two formats are accepted:
+//   matrix format: the size N followed by N*N numbers, from the header line on
+//   line format: one line of 16 or 81 digits, '0' or '.' for an empty cell
+// eof tells whether more bytes can follow the buffer
+// returns psize and sets *used to the bytes consumed
+// returns 0 if the buffer holds no complete record (at eof: no more records)
+// returns -1 for a malformed record, *used then skips past it
+int scanPuzzleRecord(const char* buf, size_t len, bool eof, size_t* used, int* cells) {
+  size_t pos = 0;
+  while (pos < len && isBlank(buf[pos])) {
+    pos++;
+  }
+  *used = pos;
+  if (pos == len) {
+    return 0;
+  }
+
+  // the first line decides the format
+  size_t lineEnd = pos;
+  while (lineEnd < len && buf[lineEnd] != '\n') {
+    lineEnd++;
+  }
+  if (lineEnd == len && !eof) {
+    return 0;
+  }
+  size_t next = lineEnd < len ? lineEnd + 1 : lineEnd;
+  size_t tokenEnd = pos;
+  while (tokenEnd < lineEnd && !isBlank(buf[tokenEnd])) {
+    tokenEnd++;
+  }
+  size_t rest = tokenEnd;
+  while (rest < lineEnd && isBlank(buf[rest])) {
+    rest++;
+  }
+  size_t tokenLen = tokenEnd - pos;
+  bool digits = true;
+  bool dots = false;
+  for (size_t i = pos; i < tokenEnd; i++) {
+    if (buf[i] == '.') {
+      dots = true;
+    }
+    else if (buf[i] < '0' || buf[i] > '9') {
+      digits = false;
+    }
+  }
+  if (!digits) {
+    *used = next;
+    return -1;
+  }
+
+  // line format
+  if (tokenLen == 16 || tokenLen == 81) {
+    if (rest != lineEnd) {
+      *used = next;
+      return -1;
+    }
+    for (size_t i = 0; i < tokenLen; i++) {
+      char c = buf[pos + i];
+      cells[i] = c == '.' ? 0 : c - '0';
+    }
+    *used = next;
+    return tokenLen == 16 ? 4 : 9;
+  }
+
+  // matrix format, the first token is the size header and the cells may
+  // start on the same line
   int psize;
-  fscanf(fp, "%d", &psize);
-  int **agrid = (int **)malloc((psize + 1) * sizeof(int *));
-  for (int row = 1; row <= psize; row++) {
-    agrid[row] = (int *)malloc((psize + 1) * sizeof(int));
-    for (int col = 1; col <= psize; col++) {
-      fscanf(fp, "%d", &agrid[row][col]);
+  if (dots || tokenLen > 3 || !scanInt(buf, tokenEnd, &pos, &psize)
+      || psize < 1 || psize > MAX_PUZZLE_SIZE) {
+    *used = next;
+    return -1;
+  }
+  int boxSize = sqrt(psize);
+  if (boxSize * boxSize != psize) {
+    *used = next;
+    return -1;
+  }
+  pos = tokenEnd;
+  for (int i = 0; i < psize * psize; i++) {
+    while (pos < len && isBlank(buf[pos])) {
+      pos++;
+    }
+    if (pos == len) {
+      if (!eof) {
+        return 0;
+      }
+      *used = len;
+      return -1;
+    }
+    size_t tokenStart = pos;
+    if (!scanInt(buf, len, &pos, &cells[i]) || (pos < len && !isBlank(buf[pos]))) {
+      // skip the whole record so that its remaining rows are not read as records
+      return skipPuzzleTokens(buf, len, eof, tokenStart, psize * psize - i, used);
+    }
+    // a number touching the end of the buffer may continue in the next read
+    if (pos == len && !eof) {
+      return 0;
     }
   }
-  fclose(fp);
-  *grid = agrid;
+  *used = pos;
   return psize;
 }
 
-// takes puzzle size and grid[][]
-// prints the puzzle
-void printSudokuPuzzle(int psize, int **grid) {
-  printf("%d\n", psize);
+// takes puzzle size and row-major cells
+// returns a newly allocated grid[][] holding the cells
+int** gridFromCells(int psize, const int* cells) {
+  int **agrid = (int **)malloc((psize + 1) * sizeof(int *));
   for (int row = 1; row <= psize; row++) {
+    agrid[row] = (int *)malloc((psize + 1) * sizeof(int));
     for (int col = 1; col <= psize; col++) {
-      printf("%d ", grid[row][col]);
+      agrid[row][col] = cells[(row - 1) * psize + (col - 1)];
     }
-    printf("\n");
   }
-  printf("\n");
+  return agrid;
 }
 
 // takes puzzle size and grid[][]
-// frees the memory allocated
-void deleteSudokuPuzzle(int psize, int **grid) {
+// returns a newly allocated copy of the grid
+int** copySudokuPuzzle(int psize, int** grid) {
+  int **agrid = (int **)malloc((psize + 1) * sizeof(int *));
   for (int row = 1; row <= psize; row++) {
-    free(grid[row]);
+    agrid[row] = (int *)malloc((psize + 1) * sizeof(int));
+    memcpy(agrid[row], grid[row], (psize + 1) * sizeof(int));
   }
-  free(grid);
+  return agrid;
 }
 
-// determines whether a certain row in the puzzle is valid
-// takes in the row/ col information to check, the grid, the row/column size, 
-// and the array containing the validity values for rows
-// for rowValidity -> 0: INVALID, 1: VALID, 2: INCOMPLETE
-void* checkRow(void* parameters) {
-
-  Parameters* params = (Parameters*) parameters;
-
-  // contains indexes for each value in the row
-  // 0 means 'not found', 1 means 'found'
-  int foundVals[params->size + 1];
+// whether buf starts with the gzip magic bytes, no puzzle format does
+bool isGzipData(const char* buf, size_t len) {
+  return len >= 2 && (unsigned char) buf[0] == 0x1f && (unsigned char) buf[1] == 0x8b;
+}
 
-  // initialize all values to zero (not found)
-  for (int i = 1; i <= params->size; i++) {
-    foundVals[i] = 0;
+// inflates the gzip members in buf[0..len) into a newly allocated buffer
+// returns NULL if the data is not valid gzip, otherwise sets *inflated to its length
+char* inflateBuffer(const char* buf, size_t len, size_t* inflated) {
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (inflateInit2(&z, 15 + 16) != Z_OK) {
+    return NULL;
   }
-
-  // debugging test
-  for (int i = 1; i <= params->size; i++) {
-    foundVals[params->puzzle[params->row][i]] = 1;
+  size_t capacity = len * 4 + INFLATE_CHUNK_SIZE;
+  char* out = malloc(capacity);
+  if (out == NULL) {
+    printf("ERROR: out of memory for inflated input\n");
+    exit(EXIT_FAILURE);
   }
-
-  // check if there are any zeros in 'foundVals', which would mean that the row is not valid
-  bool valid = true;
-  for (int i = 1; i <= params->size; i++) {
-    if (foundVals[i] == 0) {
-      valid = false;
+  z.next_in = (unsigned char*) buf;
+  z.avail_in = len;
+  size_t total = 0;
+  int status = Z_OK;
+  for (;;) {
+    if (total == capacity) {
+      capacity *= 2;
+      out = realloc(out, capacity);
+      if (out == NULL) {
+        printf("ERROR: out of memory for inflated input\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    // zlib counts in unsigned int, so larger outputs go in several steps
+    size_t space = capacity - total < UINT_MAX ? capacity - total : UINT_MAX;
+    z.next_out = (unsigned char*) out + total;
+    z.avail_out = space;
+    status = inflate(&z, Z_NO_FLUSH);
+    total += space - z.avail_out;
+    if (status == Z_STREAM_END) {
+      // gzip files may hold several members back to back
+      if (z.avail_in == 0) {
+        break;
+      }
+      inflateReset(&z);
+    }
+    else if (status != Z_OK && !(status == Z_BUF_ERROR && z.avail_out == 0)) {
       break;
     }
   }
-  if (!valid) {
-    params->validity[params->row] = 0;
+  inflateEnd(&z);
+  if (status != Z_STREAM_END) {
+    free(out);
+    return NULL;
   }
-  else {
-    params->validity[params->row] = 1;
+  *inflated = total;
+  return out;
+}
+
+// takes a buffer holding a puzzle file and pointer to grid[][]
+// gzip compressed files are inflated first
+// returns size of Sudoku puzzle and fills grid, or -1 if the buffer is malformed
+int parseSudokuPuzzle(const char* buf, size_t len, int*** grid) {
+  if (isGzipData(buf, len)) {
+    size_t plainLen;
+    char* plain = inflateBuffer(buf, len, &plainLen);
+    if (plain == NULL) {
+      return -1;
+    }
+    int psize = parseSudokuPuzzle(plain, plainLen, grid);
+    free(plain);
+    return psize;
+  }
+  int cells[MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+  size_t used;
+  int psize = scanPuzzleRecord(buf, len, true, &used, cells);
+  if (psize <= 0) {
+    return -1;
   }
+  *grid = gridFromCells(psize, cells);
+  return psize;
+}
 
+// reads from the file descriptor behind a puzzle stream
+ssize_t readFd(void* source, char* dst, size_t len) {
+  ssize_t got;
+  do {
+    got = read(*(int*) source, dst, len);
+  } while (got < 0 && errno == EINTR);
+  return got;
 }
 
-// determines whether a certain column in the puzzle is valid
-// takes in the row/col information to check, the grid, the row/column size, 
-// and the array containing the validity values for rows
-// for rowValidity -> 0: INVALID, 1: VALID, 2: INCOMPLETE
-void* checkCol(void* parameters) {
+// sets up a puzzle stream reading through readFn(source, ...)
+void initPuzzleStream(PuzzleStream* stream, ssize_t (*readFn)(void*, char*, size_t), void* source) {
+  stream->read = readFn;
+  stream->source = source;
+  stream->capacity = STREAM_BUFFER_SIZE;
+  stream->buf = malloc(stream->capacity);
+  stream->start = 0;
+  stream->end = 0;
+  stream->eof = false;
+  stream->position = 0;
+  stream->flushBeforeRead = NULL;
+  if (stream->buf == NULL) {
+    printf("ERROR: out of memory for stream buffer\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void freePuzzleStream(PuzzleStream* stream) {
+  free(stream->buf);
+  stream->buf = NULL;
+}
+
+// takes the next puzzle from the stream into cells, reading more input as needed
+// returns psize, 0 at the end of the stream, -1 for a malformed record
+// or -2 if reading failed
+int nextPuzzle(PuzzleStream* stream, int* cells) {
+  for (;;) {
+    size_t used;
+    int psize = scanPuzzleRecord(stream->buf + stream->start, stream->end - stream->start,
+                                 stream->eof, &used, cells);
+    stream->start += used;
+    stream->position += used;
+    if (psize != 0 || stream->eof) {
+      return psize;
+    }
+
+    // keep the partial record and make room behind it
+    size_t pending = stream->end - stream->start;
+    memmove(stream->buf, stream->buf + stream->start, pending);
+    stream->start = 0;
+    stream->end = pending;
+    if (pending == stream->capacity) {
+      if (stream->capacity >= STREAM_BUFFER_LIMIT) {
+        // no record is this long, drop the buffered bytes as one bad record
+        stream->position += pending;
+        stream->end = 0;
+        return -1;
+      }
+      stream->capacity *= 2;
+      stream->buf = realloc(stream->buf, stream->capacity);
+      if (stream->buf == NULL) {
+        printf("ERROR: out of memory for stream buffer\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    // results so far go out before a read that may block
+    if (stream->flushBeforeRead != NULL) {
+      flushResultWriter(stream->flushBeforeRead);
+    }
+    ssize_t got = stream->read(stream->source, stream->buf + stream->end,
+                               stream->capacity - stream->end);
+    if (got < 0) {
+      return -2;
+    }
+    if (got == 0) {
+      stream->eof = true;
+    }
+    stream->end += got;
+  }
+}
+
+// takes filename and pointer to grid[][]
+// returns size of Sudoku puzzle and fills grid, or -1 if the file
+// cannot be read or does not hold a puzzle
+int loadSudokuPuzzle(const char *filename, int ***grid) {
+  FILE *fp = fopen(filename, "r");
+  if (fp == NULL) {
+    return -1;
+  }
+  // read the whole file so that parsing does not go through stdio per number
+  size_t capacity = 4096;
+  size_t len = 0;
+  char* buf = malloc(capacity);
+  if (buf == NULL) {
+    printf("ERROR: out of memory for puzzle file\n");
+    exit(EXIT_FAILURE);
+  }
+  size_t got;
+  while ((got = fread(buf + len, 1, capacity - len, fp)) > 0) {
+    len += got;
+    if (len == capacity) {
+      capacity *= 2;
+      buf = realloc(buf, capacity);
+      if (buf == NULL) {
+        printf("ERROR: out of memory for puzzle file\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+  fclose(fp);
+  int psize = parseSudokuPuzzle(buf, len, grid);
+  free(buf);
+  return psize;
+}
+
+// takes filename and pointer to grid[][]
+// returns size of Sudoku puzzle and fills grid
+int readSudokuPuzzle(char *filename, int ***grid) {
+  int psize = loadSudokuPuzzle(filename, grid);
+  if (psize < 0) {
+    printf("Could not open file %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  return psize;
+}
+
+// takes output stream, puzzle size and grid[][]
+// writes the puzzle to the stream
+void writeSudokuPuzzle(FILE* out, int psize, int **grid) {
+  fprintf(out, "%d\n", psize);
+  for (int row = 1; row <= psize; row++) {
+    for (int col = 1; col <= psize; col++) {
+      fprintf(out, "%d ", grid[row][col]);
+    }
+    fprintf(out, "\n");
+  }
+  fprintf(out, "\n");
+}
+
+// takes puzzle size and grid[][]
+// prints the puzzle
+void printSudokuPuzzle(int psize, int **grid) {
+  writeSudokuPuzzle(stdout, psize, grid);
+}
+
+// takes puzzle size and grid[][]
+// frees the memory allocated
+void deleteSudokuPuzzle(int psize, int **grid) {
+  for (int row = 1; row <= psize; row++) {
+    free(grid[row]);
+  }
+  free(grid);
+}
+
+// determines whether a certain row in the puzzle is valid
+// takes in the row/ col information to check, the grid, the row/column size, 
+// and the array containing the validity values for rows
+// for rowValidity -> 0: INVALID, 1: VALID, 2: INCOMPLETE
+void* checkRow(void* parameters) {
+
+  Parameters* params = (Parameters*) parameters;
+
+  // contains indexes for each value in the row
+  // 0 means 'not found', 1 means 'found'
+  int foundVals[params->size + 1];
+
+  // initialize all values to zero (not found)
+  for (int i = 1; i <= params->size; i++) {
+    foundVals[i] = 0;
+  }
+
+  // mark each value seen, values outside 1..size make the row invalid
+  bool inRange = true;
+  for (int i = 1; i <= params->size; i++) {
+    int value = params->puzzle[params->row][i];
+    if (value < 1 || value > params->size) {
+      inRange = false;
+      break;
+    }
+    foundVals[value] = 1;
+  }
+
+  // check if there are any zeros in 'foundVals', which would mean that the row is not valid
+  bool valid = inRange;
+  for (int i = 1; i <= params->size; i++) {
+    if (foundVals[i] == 0) {
+      valid = false;
+      break;
+    }
+  }
+  if (!valid) {
+    params->validity[params->row] = 0;
+  }
+  else {
+    params->validity[params->row] = 1;
+  }
+
+  free(params);
+  return NULL;
+}
+
+// determines whether a certain column in the puzzle is valid
+// takes in the row/col information to check, the grid, the row/column size, 
+// and the array containing the validity values for rows
+// for rowValidity -> 0: INVALID, 1: VALID, 2: INCOMPLETE
+void* checkCol(void* parameters) {
 
   Parameters* params = (Parameters*) parameters;
 
@@ -298,13 +1801,19 @@ void* checkCol(void* parameters) {
     foundVals[i] = 0;
   }
 
-  // debugging test
+  // mark each value seen, values outside 1..size make the column invalid
+  bool inRange = true;
   for (int i = 1; i <= params->size; i++) {
-    foundVals[params->puzzle[i][params->column]] = 1;
+    int value = params->puzzle[i][params->column];
+    if (value < 1 || value > params->size) {
+      inRange = false;
+      break;
+    }
+    foundVals[value] = 1;
   }
 
   // check if there are any zeros in 'foundVals', which would mean that the row is not valid
-  bool valid = true;
+  bool valid = inRange;
   for (int i = 1; i <= params->size; i++) {
     if (foundVals[i] == 0) {
       valid = false;
@@ -318,6 +1827,8 @@ void* checkCol(void* parameters) {
     params->validity[params->column] = 1;
   }
 
+  free(params);
+  return NULL;
 }
 
 // determines whether a certain sqrt(n) * sqrt(n) box in the puzzle is valid
@@ -342,28 +1853,38 @@ void* checkBox(void* parameters) {
   int length = sqrt(params->size);
 
   // loop through the indexes of the box and indicate in 'foundVals' whether the value is found
+  bool inRange = true;
   for (int row = params->row; row <= params->row + length - 1; row++) {
     for (int col = params->column; col <= params->column + length - 1; col++) {
-      foundVals[params->puzzle[row][col]] = 1;
+      int value = params->puzzle[row][col];
+      if (value < 1 || value > params->size) {
+        inRange = false;
+        continue;
+      }
+      foundVals[value] = 1;
     }
   }
 
   // check if there are any zeros in 'foundVals' which would indicate that the puzzle is not valid
-  bool valid = true;
+  bool valid = inRange;
   for (int i = 1; i <= params->size; i++) {
     if (foundVals[i] == 0) {
       valid = false;
       break;
     }
   }
-  // determine the index of the box in the boxValidity array
+  // determine the index of the box in the boxValidity array from its corner,
+  // boxes are numbered left to right, top to bottom starting at 1
+  int boxIndex = ((params->row - 1) / length) * length + (params->column - 1) / length + 1;
   if (!valid) {
-    params->validity[boxCount] = 0;
+    params->validity[boxIndex] = 0;
   }
   else {
-    params->validity[boxCount] = 1;
+    params->validity[boxIndex] = 1;
   }
-  boxCount = boxCount + 1;
+
+  free(params);
+  return NULL;
 }
 
 // determines whether the puzzle is complete (no zeros)
@@ -380,27 +1901,7364 @@ bool verifyPuzzleComplete(int** puzzle, int size) {
   return complete;
 }
 
-// expects file name of the puzzle as argument in command line
-int main(int argc, char **argv) {
-  if (argc != 2) {
-    printf("usage: ./sudoku puzzle.txt\n");
-    return EXIT_FAILURE;
+// appends a copy of path to the list
+void addPath(PathList* list, const char* path) {
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity == 0 ? 16 : list->capacity * 2;
+    list->items = realloc(list->items, list->capacity * sizeof(char*));
+    if (list->items == NULL) {
+      printf("ERROR: out of memory for path list\n");
+      exit(EXIT_FAILURE);
+    }
   }
-  // grid is a 2D array
-  int **grid = NULL;
-  // find grid size and fill grid
-  int sudokuSize = readSudokuPuzzle(argv[1], &grid);
-  bool valid = false;
-  bool complete = false;
-  checkPuzzle(sudokuSize, grid, &complete, &valid);
-  printf("Complete puzzle? ");
-  printf(complete ? "true\n" : "false\n");
-  if (complete) {
-    printf("Valid puzzle? ");
-    printf(valid ? "true\n" : "false\n");
-  }
-  printSudokuPuzzle(sudokuSize, grid);
-  deleteSudokuPuzzle(sudokuSize, grid);
-  return EXIT_SUCCESS;
+  list->items[list->count++] = strdup(path);
+}
+
+// frees every path and the list storage
+void freePathList(PathList* list) {
+  for (int i = 0; i < list->count; i++) {
+    free(list->items[i]);
+  }
+  free(list->items);
+  list->items = NULL;
+  list->count = 0;
+  list->capacity = 0;
+}
+
+// adds every regular file directly inside dir to the list, sorted by name
+// so that results come out in the same order on every run
+bool addDirectory(PathList* list, const char* dir) {
+  struct dirent** entries;
+  int n = scandir(dir, &entries, NULL, alphasort);
+  if (n < 0) {
+    return false;
+  }
+  for (int i = 0; i < n; i++) {
+    if (entries[i]->d_name[0] != '.') {
+      size_t len = strlen(dir) + strlen(entries[i]->d_name) + 2;
+      char* path = malloc(len);
+      snprintf(path, len, "%s/%s", dir, entries[i]->d_name);
+      struct stat st;
+      if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+        addPath(list, path);
+      }
+      free(path);
+    }
+    free(entries[i]);
+  }
+  free(entries);
+  return true;
+}
+
+// adds each non-empty line of listFile as a path
+bool addListFile(PathList* list, const char* listFile) {
+  FILE* fp = fopen(listFile, "r");
+  if (fp == NULL) {
+    return false;
+  }
+  char* line = NULL;
+  size_t capacity = 0;
+  ssize_t len;
+  while ((len = getline(&line, &capacity, fp)) != -1) {
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+      line[--len] = '\0';
+    }
+    if (len > 0) {
+      addPath(list, line);
+    }
+  }
+  free(line);
+  fclose(fp);
+  return true;
+}
+
+// adds a command line argument, expanding directories into their files
+bool addInput(PathList* list, const char* arg) {
+  struct stat st;
+  if (stat(arg, &st) == 0 && S_ISDIR(st.st_mode)) {
+    return addDirectory(list, arg);
+  }
+  addPath(list, arg);
+  return true;
+}
+
+// finds the first row, then column, then box that does not hold every value 1..psize
+// returns false if there is none, otherwise sets the unit kind and its 1-based index
+bool findFailingUnit(int psize, int** grid, int* unit, int* index) {
+  int boxSize = sqrt(psize);
+  bool seen[MAX_PUZZLE_SIZE + 1];
+  for (int kind = UNIT_ROW; kind <= UNIT_BOX; kind++) {
+    for (int u = 1; u <= psize; u++) {
+      memset(seen, 0, sizeof(seen));
+      bool ok = true;
+      for (int i = 1; i <= psize && ok; i++) {
+        int value;
+        if (kind == UNIT_ROW) {
+          value = grid[u][i];
+        }
+        else if (kind == UNIT_COLUMN) {
+          value = grid[i][u];
+        }
+        else {
+          int row = ((u - 1) / boxSize) * boxSize + (i - 1) / boxSize + 1;
+          int col = ((u - 1) % boxSize) * boxSize + (i - 1) % boxSize + 1;
+          value = grid[row][col];
+        }
+        ok = value >= 1 && value <= psize && !seen[value];
+        if (ok) {
+          seen[value] = true;
+        }
+      }
+      if (!ok) {
+        *unit = kind;
+        *index = u;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// returns the current monotonic time in nanoseconds
+long long nowNanos(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// validates grid and records the verdict, the first failing unit and the time taken
+void evaluatePuzzle(int psize, int** grid, PuzzleResult* result, OutputFormat format) {
+  long long start = nowNanos();
+  result->complete = false;
+  result->valid = false;
+  checkPuzzle(psize, grid, &result->complete, &result->valid, format);
+  result->failingUnit = UNIT_NONE;
+  result->failingIndex = 0;
+  if (result->complete && !result->valid) {
+    findFailingUnit(psize, grid, &result->failingUnit, &result->failingIndex);
+  }
+  result->nanos = nowNanos() - start;
+  result->loaded = true;
+}
+
+// number of cells of grid holding a value
+int filledCells(int psize, int** grid) {
+  int filled = 0;
+  for (int row = 1; row <= psize; row++) {
+    for (int col = 1; col <= psize; col++) {
+      filled += grid[row][col] != 0;
+    }
+  }
+  return filled;
+}
+
+// sets up tracker for a search over cells cells, budget may be NULL
+void initBudgetTracker(BudgetTracker* tracker, SearchBudget* budget, int cells) {
+  tracker->budget = budget;
+  tracker->check = budget != NULL ? 0 : LLONG_MAX;
+  tracker->counted = 0;
+  tracker->cells = cells;
+  tracker->bestFixed = 0;
+  tracker->best = NULL;
+  if (budget != NULL) {
+    tracker->best = calloc(cells, 1);
+    if (tracker->best == NULL) {
+      printf("ERROR: out of memory for solver\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+void freeBudgetTracker(BudgetTracker* tracker) {
+  free(tracker->best);
+}
+
+// looks at the budget of a search that has taken nodes steps, adding the
+// steps it has not reported yet, returns true once it is spent, by this
+// search or another one sharing it, and otherwise sets the node count to
+// look at it again
+static bool checkBudget(BudgetTracker* tracker, long long nodes) {
+  SearchBudget* budget = tracker->budget;
+  if (__atomic_load_n(&budget->spent, __ATOMIC_RELAXED)) {
+    return true;
+  }
+  long long used = __atomic_add_fetch(&budget->used, nodes - tracker->counted, __ATOMIC_RELAXED);
+  tracker->counted = nodes;
+  if ((budget->nodes > 0 && used >= budget->nodes) ||
+      (budget->deadline > 0 && nowNanos() >= budget->deadline)) {
+    __atomic_store_n(&budget->spent, true, __ATOMIC_RELAXED);
+    return true;
+  }
+  // the nodes left are shared, so this search looks again once it could
+  // have taken them all
+  long long step = SOLVE_BUDGET_INTERVAL;
+  if (budget->nodes > 0 && budget->nodes - used < step) {
+    step = budget->nodes - used;
+  }
+  tracker->check = nodes + step;
+  return false;
+}
+
+// true when a search that has taken nodes steps has to stop for its budget,
+// a single comparison until the next look at the budget is due
+static inline bool budgetSpent(BudgetTracker* tracker, long long nodes) {
+  return nodes >= tracker->check && checkBudget(tracker, nodes);
+}
+
+// true when a search on a budget has reached an assignment fixing more
+// cells than any before, best is then cleared for the caller to copy it into
+static inline bool improvesBest(BudgetTracker* tracker, int fixed) {
+  if (tracker->best == NULL || fixed <= tracker->bestFixed) {
+    return false;
+  }
+  tracker->bestFixed = fixed;
+  memset(tracker->best, 0, tracker->cells);
+  return true;
+}
+
+// fills the open cells of grid from the fullest assignment of a search
+// its budget stopped, does nothing for a search that was not stopped
+void writeBestPartial(const BudgetTracker* tracker, int psize, int** grid) {
+  if (tracker->best == NULL || !tracker->budget->spent) {
+    return;
+  }
+  for (int cell = 0; cell < tracker->cells; cell++) {
+    if (tracker->best[cell] != 0 && grid[cell / psize + 1][cell % psize + 1] == 0) {
+      grid[cell / psize + 1][cell % psize + 1] = tracker->best[cell];
+    }
+  }
+}
+
+// sets up the solver for grid, returns false if the givens already repeat
+// a value in a unit or hold a value outside 0..psize
+bool initBitmaskSolver(BitmaskSolver* solver, int psize, int** grid) {
+  solver->psize = psize;
+  solver->boxSize = sqrt(psize);
+  solver->full = psize == 64 ? ~0ULL : (1ULL << psize) - 1;
+  solver->emptyCount = 0;
+  solver->nodes = 0;
+  solver->solutions = 0;
+  solver->limit = 1;
+  solver->cancel = NULL;
+  initBudgetTracker(&solver->tracker, NULL, 0);
+  memset(solver->rows, 0, sizeof(solver->rows));
+  memset(solver->cols, 0, sizeof(solver->cols));
+  memset(solver->boxes, 0, sizeof(solver->boxes));
+  for (int row = 0; row < psize; row++) {
+    for (int col = 0; col < psize; col++) {
+      int value = grid[row + 1][col + 1];
+      int box = (row / solver->boxSize) * solver->boxSize + col / solver->boxSize;
+      if (value < 0 || value > psize) {
+        return false;
+      }
+      solver->cells[row * psize + col] = value;
+      if (value == 0) {
+        solver->empties[solver->emptyCount++] = row * psize + col;
+        continue;
+      }
+      unsigned long long bit = 1ULL << (value - 1);
+      if ((solver->rows[row] | solver->cols[col] | solver->boxes[box]) & bit) {
+        return false;
+      }
+      solver->rows[row] |= bit;
+      solver->cols[col] |= bit;
+      solver->boxes[box] |= bit;
+    }
+  }
+  return true;
+}
+
+// values still possible in a cell
+static inline unsigned long long bitmaskCandidates(const BitmaskSolver* solver, int cell) {
+  int row = cell / solver->psize;
+  int col = cell % solver->psize;
+  int box = (row / solver->boxSize) * solver->boxSize + col / solver->boxSize;
+  return solver->full & ~(solver->rows[row] | solver->cols[col] | solver->boxes[box]);
+}
+
+// fills the empty cells from depth on, branching on the cell with the fewest
+// candidates, which is swapped to position depth of the empty list
+// the values of the first depth empty cells are kept in cells on the way down
+// returns true once every cell is filled
+static bool searchBitmask(BitmaskSolver* solver, int depth) {
+  if (depth == solver->emptyCount) {
+    return ++solver->solutions >= solver->limit;
+  }
+  if (solver->cancel != NULL && __atomic_load_n(solver->cancel, __ATOMIC_RELAXED)) {
+    return false;
+  }
+  if (improvesBest(&solver->tracker, depth)) {
+    for (int i = 0; i < depth; i++) {
+      solver->tracker.best[solver->empties[i]] = solver->cells[solver->empties[i]];
+    }
+  }
+  if (budgetSpent(&solver->tracker, ++solver->nodes)) {
+    return false;
+  }
+  int best = depth;
+  int bestCount = 65;
+  for (int i = depth; i < solver->emptyCount; i++) {
+    int count = __builtin_popcountll(bitmaskCandidates(solver, solver->empties[i]));
+    if (count < bestCount) {
+      best = i;
+      bestCount = count;
+      if (count <= 1) {
+        break;
+      }
+    }
+  }
+  if (bestCount == 0) {
+    return false;
+  }
+  unsigned short cell = solver->empties[best];
+  solver->empties[best] = solver->empties[depth];
+  solver->empties[depth] = cell;
+
+  int row = cell / solver->psize;
+  int col = cell % solver->psize;
+  int box = (row / solver->boxSize) * solver->boxSize + col / solver->boxSize;
+  unsigned long long candidates = bitmaskCandidates(solver, cell);
+  while (candidates != 0) {
+    unsigned long long bit = candidates & -candidates;
+    candidates ^= bit;
+    solver->rows[row] |= bit;
+    solver->cols[col] |= bit;
+    solver->boxes[box] |= bit;
+    solver->cells[cell] = __builtin_ctzll(bit) + 1;
+    if (searchBitmask(solver, depth + 1)) {
+      return true;
+    }
+    solver->rows[row] &= ~bit;
+    solver->cols[col] &= ~bit;
+    solver->boxes[box] &= ~bit;
+  }
+  return false;
+}
+
+// solves grid with the bitmask solver, see solveSudokuPuzzle
+long long solveBitmask(int psize, int** grid, SolveMode mode, long long limit, const bool* cancel,
+                       SearchBudget* budget) {
+  BitmaskSolver* solver = malloc(sizeof(BitmaskSolver));
+  if (solver == NULL) {
+    printf("ERROR: out of memory for solver\n");
+    exit(EXIT_FAILURE);
+  }
+  long long solutions = 0;
+  if (initBitmaskSolver(solver, psize, grid)) {
+    solver->limit = limit;
+    solver->cancel = cancel;
+    initBudgetTracker(&solver->tracker, budget, psize * psize);
+    searchBitmask(solver, 0);
+    solutions = solver->solutions;
+  }
+  if (mode == SOLVE_ONE && solutions > 0) {
+    for (int i = 0; i < solver->emptyCount; i++) {
+      int cell = solver->empties[i];
+      grid[cell / psize + 1][cell % psize + 1] = solver->cells[cell];
+    }
+  }
+  else if (mode == SOLVE_ONE) {
+    writeBestPartial(&solver->tracker, psize, grid);
+  }
+  freeBudgetTracker(&solver->tracker);
+  free(solver);
+  return solutions;
+}
+
+// builds the exact cover matrix of grid from the node pool, with a matrix row
+// only for placements the givens allow and with the columns the givens
+// satisfy left out, returns false if the givens conflict
+bool initDlxSolver(DlxSolver* dlx, int psize, int** grid) {
+  int cells = psize * psize;
+  int columns = 4 * cells;
+  int maxNodes = 1 + columns + 4 * cells * psize;
+  dlx->psize = psize;
+  dlx->grid = grid;
+  dlx->depth = 0;
+  dlx->givenCount = 0;
+  dlx->solutions = 0;
+  dlx->nodes = 0;
+  dlx->cancel = NULL;
+  initBudgetTracker(&dlx->tracker, NULL, 0);
+  // one allocation holds every array of the pool
+  int* pool = malloc(sizeof(int) * ((size_t) maxNodes * 6 + columns + 1 + cells));
+  if (pool == NULL) {
+    printf("ERROR: out of memory for exact cover matrix\n");
+    exit(EXIT_FAILURE);
+  }
+  dlx->left = pool;
+  dlx->right = dlx->left + maxNodes;
+  dlx->up = dlx->right + maxNodes;
+  dlx->down = dlx->up + maxNodes;
+  dlx->column = dlx->down + maxNodes;
+  dlx->placement = dlx->column + maxNodes;
+  dlx->size = dlx->placement + maxNodes;
+  dlx->chosen = dlx->size + columns + 1;
+
+  BitmaskSolver* used = malloc(sizeof(BitmaskSolver));
+  if (used == NULL) {
+    printf("ERROR: out of memory for solver\n");
+    exit(EXIT_FAILURE);
+  }
+  bool consistent = initBitmaskSolver(used, psize, grid);
+  int boxSize = used->boxSize;
+
+  // headers of the columns still to cover, in a ring through the root
+  dlx->left[0] = dlx->right[0] = 0;
+  for (int c = 1; c <= columns; c++) {
+    dlx->up[c] = dlx->down[c] = c;
+    dlx->column[c] = c;
+    dlx->size[c] = 0;
+    int kind = (c - 1) / cells;
+    int index = (c - 1) % cells;
+    int unit = index / psize;
+    unsigned long long bit = 1ULL << (index % psize);
+    bool satisfied = kind == 0 ? used->cells[index] != 0
+                     : kind == 1 ? (used->rows[unit] & bit) != 0
+                     : kind == 2 ? (used->cols[unit] & bit) != 0
+                     : (used->boxes[unit] & bit) != 0;
+    if (satisfied) {
+      dlx->left[c] = dlx->right[c] = c;
+      continue;
+    }
+    dlx->left[c] = dlx->left[0];
+    dlx->right[c] = 0;
+    dlx->right[dlx->left[0]] = c;
+    dlx->left[0] = c;
+  }
+
+  int next = columns + 1;
+  for (int cell = 0; consistent && cell < cells; cell++) {
+    int row = cell / psize;
+    int col = cell % psize;
+    int box = (row / boxSize) * boxSize + col / boxSize;
+    if (used->cells[cell] != 0) {
+      dlx->chosen[dlx->givenCount++] = cell * psize + used->cells[cell] - 1;
+      continue;
+    }
+    unsigned long long candidates = bitmaskCandidates(used, cell);
+    while (candidates != 0) {
+      int value = __builtin_ctzll(candidates);
+      candidates &= candidates - 1;
+      int headers[4] = {1 + cell, 1 + cells + row * psize + value,
+                        1 + 2 * cells + col * psize + value, 1 + 3 * cells + box * psize + value};
+      for (int k = 0; k < 4; k++) {
+        int node = next + k;
+        int c = headers[k];
+        dlx->column[node] = c;
+        dlx->placement[node] = cell * psize + value;
+        dlx->up[node] = dlx->up[c];
+        dlx->down[node] = c;
+        dlx->down[dlx->up[c]] = node;
+        dlx->up[c] = node;
+        dlx->size[c]++;
+        dlx->left[node] = next + (k + 3) % 4;
+        dlx->right[node] = next + (k + 1) % 4;
+      }
+      next += 4;
+    }
+  }
+  dlx->nodeCount = next;
+  free(used);
+  if (!consistent) {
+    free(dlx->left);
+  }
+  return consistent;
+}
+
+void freeDlxSolver(DlxSolver* dlx) {
+  free(dlx->left);
+}
+
+// removes column c from the header ring and its rows from the other columns
+static void dlxCover(DlxSolver* dlx, int c) {
+  dlx->right[dlx->left[c]] = dlx->right[c];
+  dlx->left[dlx->right[c]] = dlx->left[c];
+  for (int i = dlx->down[c]; i != c; i = dlx->down[i]) {
+    for (int j = dlx->right[i]; j != i; j = dlx->right[j]) {
+      dlx->down[dlx->up[j]] = dlx->down[j];
+      dlx->up[dlx->down[j]] = dlx->up[j];
+      dlx->size[dlx->column[j]]--;
+    }
+  }
+}
+
+// undoes dlxCover(c)
+static void dlxUncover(DlxSolver* dlx, int c) {
+  for (int i = dlx->up[c]; i != c; i = dlx->up[i]) {
+    for (int j = dlx->left[i]; j != i; j = dlx->left[j]) {
+      dlx->size[dlx->column[j]]++;
+      dlx->down[dlx->up[j]] = j;
+      dlx->up[dlx->down[j]] = j;
+    }
+  }
+  dlx->right[dlx->left[c]] = c;
+  dlx->left[dlx->right[c]] = c;
+}
+
+// writes the chosen placements into the grid
+static void dlxFillGrid(DlxSolver* dlx) {
+  int psize = dlx->psize;
+  for (int i = dlx->givenCount; i < dlx->depth; i++) {
+    int cell = dlx->chosen[i] / psize;
+    dlx->grid[cell / psize + 1][cell % psize + 1] = dlx->chosen[i] % psize + 1;
+  }
+}
+
+// algorithm X over the remaining columns, always covering the column with the
+// fewest rows, returns true when the search should stop
+static bool searchDlx(DlxSolver* dlx) {
+  if (dlx->right[0] == 0) {
+    dlx->solutions++;
+    if (dlx->mode == SOLVE_ONE || dlx->mode == SOLVE_ALL) {
+      dlxFillGrid(dlx);
+    }
+    if (dlx->mode == SOLVE_ALL && dlx->out != NULL) {
+      writeSudokuPuzzle(dlx->out, dlx->psize, dlx->grid);
+    }
+    return dlx->solutions >= dlx->limit;
+  }
+  if (dlx->cancel != NULL && __atomic_load_n(dlx->cancel, __ATOMIC_RELAXED)) {
+    return true;
+  }
+  if (improvesBest(&dlx->tracker, dlx->depth)) {
+    for (int i = dlx->givenCount; i < dlx->depth; i++) {
+      dlx->tracker.best[dlx->chosen[i] / dlx->psize] = dlx->chosen[i] % dlx->psize + 1;
+    }
+  }
+  if (budgetSpent(&dlx->tracker, ++dlx->nodes)) {
+    return true;
+  }
+  int best = dlx->right[0];
+  for (int c = dlx->right[best]; c != 0 && dlx->size[best] > 1; c = dlx->right[c]) {
+    if (dlx->size[c] < dlx->size[best]) {
+      best = c;
+    }
+  }
+  if (dlx->size[best] == 0) {
+    return false;
+  }
+  dlxCover(dlx, best);
+  bool stop = false;
+  for (int r = dlx->down[best]; r != best && !stop; r = dlx->down[r]) {
+    dlx->chosen[dlx->depth++] = dlx->placement[r];
+    for (int j = dlx->right[r]; j != r; j = dlx->right[j]) {
+      dlxCover(dlx, dlx->column[j]);
+    }
+    stop = searchDlx(dlx);
+    for (int j = dlx->left[r]; j != r; j = dlx->left[j]) {
+      dlxUncover(dlx, dlx->column[j]);
+    }
+    dlx->depth--;
+  }
+  dlxUncover(dlx, best);
+  return stop;
+}
+
+// solves grid with dancing links, see solveSudokuPuzzle
+long long solveDlx(int psize, int** grid, SolveMode mode, long long limit, FILE* out, const bool* cancel,
+                   SearchBudget* budget) {
+  DlxSolver dlx;
+  if (!initDlxSolver(&dlx, psize, grid)) {
+    return 0;
+  }
+  dlx.mode = mode;
+  dlx.limit = limit;
+  dlx.out = out;
+  dlx.cancel = cancel;
+  dlx.depth = dlx.givenCount;
+  initBudgetTracker(&dlx.tracker, budget, psize * psize);
+  searchDlx(&dlx);
+  if (mode == SOLVE_ALL && dlx.solutions > 0) {
+    // put the puzzle back the way it was given, only the givens are sure to
+    // be in chosen still, a search stopped by its budget leaves placements
+    // of later branches over those of the last solution
+    for (int row = 1; row <= psize; row++) {
+      memset(grid[row] + 1, 0, sizeof(int) * psize);
+    }
+    for (int i = 0; i < dlx.givenCount; i++) {
+      int cell = dlx.chosen[i] / psize;
+      grid[cell / psize + 1][cell % psize + 1] = dlx.chosen[i] % psize + 1;
+    }
+  }
+  else if (mode == SOLVE_ONE && dlx.solutions == 0) {
+    writeBestPartial(&dlx.tracker, psize, grid);
+  }
+  long long solutions = dlx.solutions;
+  freeBudgetTracker(&dlx.tracker);
+  freeDlxSolver(&dlx);
+  return solutions;
 }
 
+// sets up units and candidates and places the givens
+// returns false if the givens conflict
+bool initLogicSolver(LogicSolver* solver, int psize, int** grid);
+void freeLogicSolver(LogicSolver* solver);
+// queues every unit for a first look
+void queueAllUnits(LogicSolver* solver);
+
+// queues the units of a cell whose candidates changed
+static inline void queueCellUnits(LogicSolver* solver, int cell) {
+  int units = 3 * solver->psize;
+  for (int k = 0; k < 3; k++) {
+    int unit = solver->cellUnits[cell * 3 + k];
+    if (!solver->unitQueued[unit]) {
+      solver->unitQueued[unit] = true;
+      solver->unitQueue[(solver->queueHead + solver->queueCount++) % units] = unit;
+    }
+  }
+}
+
+// keeps only the candidates of cell in mask, returns false if none are left
+static inline bool restrictCandidates(LogicSolver* solver, int cell, unsigned long long mask) {
+  unsigned long long before = solver->candidates[cell];
+  unsigned long long after = before & mask;
+  if (after == before) {
+    return true;
+  }
+  if (after == 0) {
+    return false;
+  }
+  solver->trailCells[solver->trailCount] = cell;
+  solver->trailMasks[solver->trailCount++] = before;
+  solver->candidates[cell] = after;
+  if ((after & (after - 1)) == 0) {
+    solver->singles[solver->singleCount++] = cell;
+  }
+  queueCellUnits(solver, cell);
+  return true;
+}
+
+// places value bit in cell and takes it out of every peer
+static bool placeValue(LogicSolver* solver, int cell, unsigned long long bit) {
+  solver->trailCells[solver->trailCount] = -1 - cell;
+  solver->trailMasks[solver->trailCount++] = solver->candidates[cell];
+  solver->candidates[cell] = bit;
+  solver->values[cell] = __builtin_ctzll(bit) + 1;
+  solver->remaining--;
+  queueCellUnits(solver, cell);
+  for (int k = 0; k < 3; k++) {
+    const int* members = solver->unitCells + solver->cellUnits[cell * 3 + k] * solver->psize;
+    for (int i = 0; i < solver->psize; i++) {
+      if (members[i] != cell && !restrictCandidates(solver, members[i], ~bit)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// takes bit out of the cells of unit that are not also in unit keep
+static bool eliminateOutside(LogicSolver* solver, int unit, int keep, unsigned long long bit) {
+  const int* members = solver->unitCells + unit * solver->psize;
+  for (int i = 0; i < solver->psize; i++) {
+    int cell = members[i];
+    const int* units = solver->cellUnits + cell * 3;
+    if (units[0] != keep && units[1] != keep && units[2] != keep &&
+        !restrictCandidates(solver, cell, ~bit)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// hidden singles, pointing/claiming and naked/hidden pairs inside one unit
+static bool examineUnit(LogicSolver* solver, int unit) {
+  int psize = solver->psize;
+  int boxSize = solver->boxSize;
+  const int* members = solver->unitCells + unit * psize;
+  // positions (indices into members) each value can still go to
+  unsigned long long positions[64] = {0};
+  unsigned long long placed = 0;
+  for (int i = 0; i < psize; i++) {
+    unsigned long long candidates = solver->candidates[members[i]];
+    if (solver->values[members[i]] != 0) {
+      placed |= candidates;
+      continue;
+    }
+    while (candidates != 0) {
+      positions[__builtin_ctzll(candidates)] |= 1ULL << i;
+      candidates &= candidates - 1;
+    }
+  }
+  unsigned long long open = solver->full & ~placed;
+  int kind = unit / psize;
+  int index = unit % psize;
+  unsigned long long segment = boxSize == 64 ? ~0ULL : (1ULL << boxSize) - 1;
+  unsigned long long twoPlaces = 0;
+  for (unsigned long long rest = open; rest != 0; rest &= rest - 1) {
+    int value = __builtin_ctzll(rest);
+    unsigned long long bit = 1ULL << value;
+    unsigned long long where = positions[value];
+    if (where == 0) {
+      return false;
+    }
+    if ((where & (where - 1)) == 0) {
+      // hidden single
+      int cell = members[__builtin_ctzll(where)];
+      if (!restrictCandidates(solver, cell, bit)) {
+        return false;
+      }
+      continue;
+    }
+    if (__builtin_popcountll(where) == 2) {
+      twoPlaces |= bit;
+    }
+    // pointing (box onto a row or column) and claiming (row or column onto a box)
+    for (int s = 0; s < boxSize; s++) {
+      unsigned long long rowMask = segment << (s * boxSize);
+      if ((where & ~rowMask) == 0) {
+        int target = kind == 0 ? 2 * psize + (index / boxSize) * boxSize + s
+                     : kind == 1 ? 2 * psize + s * boxSize + index / boxSize
+                     : (index / boxSize) * boxSize + s;
+        if (!eliminateOutside(solver, target, unit, bit)) {
+          return false;
+        }
+        break;
+      }
+      if (kind == 2) {
+        unsigned long long colMask = 0;
+        for (int r = 0; r < boxSize; r++) {
+          colMask |= 1ULL << (r * boxSize + s);
+        }
+        if ((where & ~colMask) == 0) {
+          if (!eliminateOutside(solver, psize + (index % boxSize) * boxSize + s, unit, bit)) {
+            return false;
+          }
+          break;
+        }
+      }
+    }
+  }
+  // hidden pairs: two values sharing the same two places own those cells
+  for (unsigned long long a = twoPlaces; a != 0; a &= a - 1) {
+    int first = __builtin_ctzll(a);
+    for (unsigned long long b = a & (a - 1); b != 0; b &= b - 1) {
+      int second = __builtin_ctzll(b);
+      if (positions[first] == positions[second]) {
+        unsigned long long pair = (1ULL << first) | (1ULL << second);
+        unsigned long long where = positions[first];
+        if (!restrictCandidates(solver, members[__builtin_ctzll(where)], pair) ||
+            !restrictCandidates(solver, members[63 - __builtin_clzll(where)], pair)) {
+          return false;
+        }
+      }
+    }
+  }
+  // naked pairs: two cells left with the same two candidates own those values
+  for (int i = 0; i < psize; i++) {
+    unsigned long long pair = solver->candidates[members[i]];
+    if (solver->values[members[i]] != 0 || __builtin_popcountll(pair) != 2) {
+      continue;
+    }
+    for (int j = i + 1; j < psize; j++) {
+      if (solver->candidates[members[j]] != pair || solver->values[members[j]] != 0) {
+        continue;
+      }
+      for (int k = 0; k < psize; k++) {
+        if (k != i && k != j && !restrictCandidates(solver, members[k], ~pair)) {
+          return false;
+        }
+      }
+      break;
+    }
+  }
+  return true;
+}
+
+// applies deductions until none of them changes anything
+// singles are placed first, then queued units are examined one by one
+// returns false if some cell or value runs out of places
+bool propagateLogic(LogicSolver* solver) {
+  int units = 3 * solver->psize;
+  for (;;) {
+    if (solver->singleCount > 0) {
+      int cell = solver->singles[--solver->singleCount];
+      if (solver->values[cell] == 0 && !placeValue(solver, cell, solver->candidates[cell])) {
+        return false;
+      }
+      continue;
+    }
+    if (solver->queueCount == 0) {
+      return true;
+    }
+    int unit = solver->unitQueue[solver->queueHead];
+    solver->queueHead = (solver->queueHead + 1) % units;
+    solver->queueCount--;
+    solver->unitQueued[unit] = false;
+    if (!examineUnit(solver, unit)) {
+      return false;
+    }
+  }
+}
+
+void queueAllUnits(LogicSolver* solver) {
+  int units = 3 * solver->psize;
+  for (int unit = 0; unit < units; unit++) {
+    if (!solver->unitQueued[unit]) {
+      solver->unitQueued[unit] = true;
+      solver->unitQueue[(solver->queueHead + solver->queueCount++) % units] = unit;
+    }
+  }
+}
+
+// takes back the changes recorded after mark, latest first
+static void undoLogic(LogicSolver* solver, int mark) {
+  while (solver->trailCount > mark) {
+    int i = --solver->trailCount;
+    int cell = solver->trailCells[i];
+    if (cell < 0) {
+      cell = -1 - cell;
+      solver->values[cell] = 0;
+      solver->remaining++;
+    }
+    solver->candidates[cell] = solver->trailMasks[i];
+  }
+}
+
+// forgets pending work after a contradiction
+static void clearLogicQueues(LogicSolver* solver) {
+  for (int i = 0; i < solver->queueCount; i++) {
+    solver->unitQueued[solver->unitQueue[(solver->queueHead + i) % (3 * solver->psize)]] = false;
+  }
+  solver->queueCount = 0;
+  solver->singleCount = 0;
+}
+
+bool initLogicSolver(LogicSolver* solver, int psize, int** grid) {
+  int boxSize = sqrt(psize);
+  int cells = psize * psize;
+  int units = 3 * psize;
+  solver->psize = psize;
+  solver->boxSize = boxSize;
+  solver->cells = cells;
+  solver->full = psize == 64 ? ~0ULL : (1ULL << psize) - 1;
+  solver->unitCells = malloc(sizeof(int) * (units * psize + cells * 3 + cells + units + cells * psize));
+  solver->candidates = malloc(sizeof(unsigned long long) * (cells + cells * psize));
+  solver->values = malloc(cells);
+  solver->unitQueued = malloc(sizeof(bool) * units);
+  if (solver->unitCells == NULL || solver->candidates == NULL || solver->values == NULL ||
+      solver->unitQueued == NULL) {
+    printf("ERROR: out of memory for solver\n");
+    exit(EXIT_FAILURE);
+  }
+  solver->cellUnits = solver->unitCells + units * psize;
+  solver->singles = solver->cellUnits + cells * 3;
+  solver->unitQueue = solver->singles + cells;
+  solver->trailCells = solver->unitQueue + units;
+  solver->trailMasks = solver->candidates + cells;
+  for (int row = 0; row < psize; row++) {
+    for (int col = 0; col < psize; col++) {
+      int cell = row * psize + col;
+      int box = (row / boxSize) * boxSize + col / boxSize;
+      int inBox = (row % boxSize) * boxSize + col % boxSize;
+      solver->unitCells[row * psize + col] = cell;
+      solver->unitCells[(psize + col) * psize + row] = cell;
+      solver->unitCells[(2 * psize + box) * psize + inBox] = cell;
+      solver->cellUnits[cell * 3] = row;
+      solver->cellUnits[cell * 3 + 1] = psize + col;
+      solver->cellUnits[cell * 3 + 2] = 2 * psize + box;
+      solver->candidates[cell] = solver->full;
+      solver->values[cell] = 0;
+    }
+  }
+  solver->remaining = cells;
+  solver->trailCount = 0;
+  solver->singleCount = 0;
+  solver->queueHead = 0;
+  solver->queueCount = 0;
+  solver->nodes = 0;
+  solver->solutions = 0;
+  solver->limit = 1;
+  solver->cancel = NULL;
+  initBudgetTracker(&solver->tracker, NULL, 0);
+  memset(solver->unitQueued, 0, sizeof(bool) * units);
+  for (int cell = 0; cell < cells; cell++) {
+    int value = grid[cell / psize + 1][cell % psize + 1];
+    if (value < 0 || value > psize) {
+      return false;
+    }
+    if (value != 0) {
+      unsigned long long bit = 1ULL << (value - 1);
+      if ((solver->candidates[cell] & bit) == 0 || !placeValue(solver, cell, bit)) {
+        return false;
+      }
+    }
+  }
+  // the givens are never taken back
+  solver->trailCount = 0;
+  // the givens only trigger singles, every unit still needs a first look
+  queueAllUnits(solver);
+  return true;
+}
+
+void freeLogicSolver(LogicSolver* solver) {
+  free(solver->unitCells);
+  free(solver->candidates);
+  free(solver->values);
+  free(solver->unitQueued);
+}
+
+// propagates, then branches on the open cell with the fewest candidates,
+// undoing each branch through the trail before trying the next
+static bool searchLogic(LogicSolver* solver) {
+  // looked at before propagating, so a spent budget unwinds the search quickly
+  if (budgetSpent(&solver->tracker, solver->nodes) || !propagateLogic(solver)) {
+    clearLogicQueues(solver);
+    return false;
+  }
+  if (solver->remaining == 0) {
+    return ++solver->solutions >= solver->limit;
+  }
+  if (solver->cancel != NULL && __atomic_load_n(solver->cancel, __ATOMIC_RELAXED)) {
+    return false;
+  }
+  if (improvesBest(&solver->tracker, solver->cells - solver->remaining)) {
+    memcpy(solver->tracker.best, solver->values, solver->cells);
+  }
+  solver->nodes++;
+  int best = -1;
+  int bestCount = 65;
+  for (int cell = 0; cell < solver->cells && bestCount > 2; cell++) {
+    if (solver->values[cell] == 0) {
+      int count = __builtin_popcountll(solver->candidates[cell]);
+      if (count < bestCount) {
+        best = cell;
+        bestCount = count;
+      }
+    }
+  }
+  int mark = solver->trailCount;
+  for (unsigned long long rest = solver->candidates[best]; rest != 0; rest &= rest - 1) {
+    unsigned long long bit = rest & -rest;
+    if (placeValue(solver, best, bit) && searchLogic(solver)) {
+      return true;
+    }
+    clearLogicQueues(solver);
+    undoLogic(solver, mark);
+  }
+  return false;
+}
+
+// solves grid by deductions and search, see solveSudokuPuzzle
+long long solveLogic(int psize, int** grid, SolveMode mode, long long limit, const bool* cancel,
+                     SearchBudget* budget) {
+  LogicSolver solver;
+  long long solutions = 0;
+  if (initLogicSolver(&solver, psize, grid)) {
+    solver.limit = limit;
+    solver.cancel = cancel;
+    initBudgetTracker(&solver.tracker, budget, solver.cells);
+    searchLogic(&solver);
+    solutions = solver.solutions;
+  }
+  if (mode == SOLVE_ONE && solutions > 0) {
+    for (int cell = 0; cell < solver.cells; cell++) {
+      grid[cell / psize + 1][cell % psize + 1] = solver.values[cell];
+    }
+  }
+  else if (mode == SOLVE_ONE) {
+    writeBestPartial(&solver.tracker, psize, grid);
+  }
+  freeBudgetTracker(&solver.tracker);
+  freeLogicSolver(&solver);
+  return solutions;
+}
+
+// open cell with the fewest candidates
+static int fewestCandidates(const LogicSolver* solver) {
+  int best = -1;
+  int bestCount = 65;
+  for (int cell = 0; cell < solver->cells && bestCount > 2; cell++) {
+    if (solver->values[cell] == 0) {
+      int count = __builtin_popcountll(solver->candidates[cell]);
+      if (count < bestCount) {
+        best = cell;
+        bestCount = count;
+      }
+    }
+  }
+  return best;
+}
+
+// called by the owner only, returns false if the deque is full
+static bool pushTask(TaskDeque* deque, SolveTask* task) {
+  long long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+  long long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  if (bottom - top >= SOLVE_DEQUE_CAPACITY) {
+    return false;
+  }
+  __atomic_store_n(&deque->tasks[bottom & (SOLVE_DEQUE_CAPACITY - 1)], task, __ATOMIC_RELAXED);
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+// called by the owner only, takes the newest task
+static SolveTask* popTask(TaskDeque* deque) {
+  long long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long long top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+  if (top > bottom) {
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  SolveTask* task = __atomic_load_n(&deque->tasks[bottom & (SOLVE_DEQUE_CAPACITY - 1)], __ATOMIC_RELAXED);
+  if (top == bottom) {
+    // last task, race the thieves for it
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST,
+                                     __ATOMIC_RELAXED)) {
+      task = NULL;
+    }
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+  }
+  return task;
+}
+
+// called by any other thread, takes the oldest task, which is the biggest subtree
+static SolveTask* stealTask(TaskDeque* deque) {
+  long long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+  if (top >= bottom) {
+    return NULL;
+  }
+  SolveTask* task = __atomic_load_n(&deque->tasks[top & (SOLVE_DEQUE_CAPACITY - 1)], __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST,
+                                   __ATOMIC_RELAXED)) {
+    return NULL;
+  }
+  return task;
+}
+
+// copies the candidates of solver into a new task that starts by placing bit in cell
+static SolveTask* newSolveTask(const LogicSolver* solver, int depth, int cell, unsigned long long bit) {
+  SolveTask* task = malloc(sizeof(SolveTask) + (sizeof(unsigned long long) + 1) * solver->cells);
+  if (task == NULL) {
+    printf("ERROR: out of memory for solver tasks\n");
+    exit(EXIT_FAILURE);
+  }
+  task->depth = depth;
+  task->cell = cell;
+  task->bit = bit;
+  task->remaining = solver->remaining;
+  task->candidates = (unsigned long long*) (task + 1);
+  task->values = (unsigned char*) (task->candidates + solver->cells);
+  memcpy(task->candidates, solver->candidates, sizeof(unsigned long long) * solver->cells);
+  memcpy(task->values, solver->values, solver->cells);
+  return task;
+}
+
+// the thread's solver completed the grid, the first thread to get here keeps it
+static void reportSolution(ParallelSearch* search, const LogicSolver* solver) {
+  bool expected = false;
+  if (__atomic_compare_exchange_n(&search->found, &expected, true, false, __ATOMIC_ACQ_REL,
+                                  __ATOMIC_RELAXED)) {
+    memcpy(search->solution, solver->values, solver->cells);
+  }
+}
+
+// searches one task, splitting it into child tasks near the root and
+// searching it to the end itself below SOLVE_SPLIT_DEPTH
+static void runSolveTask(ParallelSearch* search, TaskDeque* own, LogicSolver* solver, SolveTask* task) {
+  if (budgetSpent(&solver->tracker, solver->nodes)) {
+    return;
+  }
+  memcpy(solver->candidates, task->candidates, sizeof(unsigned long long) * solver->cells);
+  memcpy(solver->values, task->values, solver->cells);
+  solver->remaining = task->remaining;
+  // a task starts from its own copy, nothing before it is taken back
+  solver->trailCount = 0;
+  if (task->cell < 0) {
+    queueAllUnits(solver);
+  }
+  else if (!placeValue(solver, task->cell, task->bit)) {
+    clearLogicQueues(solver);
+    return;
+  }
+  if (task->depth >= SOLVE_SPLIT_DEPTH) {
+    if (searchLogic(solver)) {
+      reportSolution(search, solver);
+    }
+    return;
+  }
+  if (!propagateLogic(solver)) {
+    clearLogicQueues(solver);
+    return;
+  }
+  if (solver->remaining == 0) {
+    reportSolution(search, solver);
+    return;
+  }
+  if (improvesBest(&solver->tracker, solver->cells - solver->remaining)) {
+    memcpy(solver->tracker.best, solver->values, solver->cells);
+  }
+  solver->nodes++;
+  int best = fewestCandidates(solver);
+  SolveTask* children[64];
+  int count = 0;
+  for (unsigned long long rest = solver->candidates[best]; rest != 0; rest &= rest - 1) {
+    children[count++] = newSolveTask(solver, task->depth + 1, best, rest & -rest);
+  }
+  for (int i = 0; i < count; i++) {
+    __atomic_add_fetch(&search->pending, 1, __ATOMIC_RELAXED);
+    if (!pushTask(own, children[i])) {
+      // no room left, search the subtree here
+      children[i]->depth = SOLVE_SPLIT_DEPTH;
+      runSolveTask(search, own, solver, children[i]);
+      free(children[i]);
+      __atomic_sub_fetch(&search->pending, 1, __ATOMIC_RELEASE);
+    }
+  }
+}
+
+// runs tasks from its own deque, then steals from the others, until a
+// solution turns up, the budget is spent or no task is left anywhere
+void* parallelSearchWorker(void* parameters) {
+  SearchThread* thread = (SearchThread*) parameters;
+  ParallelSearch* search = thread->search;
+  TaskDeque* own = &search->deques[thread->id];
+  LogicSolver solver;
+  initLogicSolver(&solver, search->psize, search->grid);
+  clearLogicQueues(&solver);
+  solver.cancel = &search->found;
+  initBudgetTracker(&solver.tracker, search->budget, solver.cells);
+  int victim = thread->id;
+  while (!__atomic_load_n(&search->found, __ATOMIC_RELAXED) &&
+         (search->budget == NULL || !__atomic_load_n(&search->budget->spent, __ATOMIC_RELAXED)) &&
+         __atomic_load_n(&search->pending, __ATOMIC_ACQUIRE) > 0) {
+    SolveTask* task = popTask(own);
+    for (int tries = 0; task == NULL && tries < search->threads; tries++) {
+      victim = (victim + 1) % search->threads;
+      if (victim != thread->id) {
+        task = stealTask(&search->deques[victim]);
+      }
+    }
+    if (task == NULL) {
+      sched_yield();
+      continue;
+    }
+    runSolveTask(search, own, &solver, task);
+    free(task);
+    __atomic_sub_fetch(&search->pending, 1, __ATOMIC_RELEASE);
+  }
+  __atomic_add_fetch(&search->nodes, solver.nodes, __ATOMIC_RELAXED);
+  // the caller picks the fullest assignment of all threads and frees them
+  thread->tracker = solver.tracker;
+  freeLogicSolver(&solver);
+  return NULL;
+}
+
+// completes grid with the logic engine searched by several threads
+// the top SOLVE_SPLIT_DEPTH levels of the search become tasks that idle
+// threads steal, and the first thread to complete the grid stops the rest
+// budget is shared by the threads, the first to spend it stops them all and
+// grid gets the fullest assignment any of them reached
+bool solveLogicParallel(int psize, int** grid, int threads, SearchBudget* budget) {
+  LogicSolver root;
+  if (!initLogicSolver(&root, psize, grid)) {
+    freeLogicSolver(&root);
+    return false;
+  }
+  ParallelSearch search;
+  search.psize = psize;
+  search.grid = grid;
+  search.threads = threads;
+  search.pending = 1;
+  search.found = false;
+  search.nodes = 0;
+  search.budget = budget;
+  search.deques = calloc(threads, sizeof(TaskDeque));
+  search.solution = malloc(root.cells);
+  SearchThread* arguments = malloc(sizeof(SearchThread) * threads);
+  pthread_t* workers = malloc(sizeof(pthread_t) * threads);
+  if (search.deques == NULL || search.solution == NULL || arguments == NULL || workers == NULL) {
+    printf("ERROR: out of memory for solver threads\n");
+    exit(EXIT_FAILURE);
+  }
+  // the givens are placed by init, the root task starts from them
+  pushTask(&search.deques[0], newSolveTask(&root, 0, -1, 0));
+  for (int i = 0; i < threads; i++) {
+    arguments[i].search = &search;
+    arguments[i].id = i;
+    if (pthread_create(&workers[i], NULL, parallelSearchWorker, (void*) &arguments[i])) {
+      printf("ERROR: create solver threads failed");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (int i = 0; i < threads; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  // tasks left behind after a solution was found
+  for (int i = 0; i < threads; i++) {
+    for (SolveTask* task = popTask(&search.deques[i]); task != NULL; task = popTask(&search.deques[i])) {
+      free(task);
+    }
+  }
+  if (search.found) {
+    for (int cell = 0; cell < root.cells; cell++) {
+      grid[cell / psize + 1][cell % psize + 1] = search.solution[cell];
+    }
+  }
+  int fullest = 0;
+  for (int i = 1; i < threads; i++) {
+    if (arguments[i].tracker.bestFixed > arguments[fullest].tracker.bestFixed) {
+      fullest = i;
+    }
+  }
+  if (!search.found) {
+    writeBestPartial(&arguments[fullest].tracker, psize, grid);
+  }
+  for (int i = 0; i < threads; i++) {
+    freeBudgetTracker(&arguments[i].tracker);
+  }
+  bool found = search.found;
+  free(workers);
+  free(arguments);
+  free(search.solution);
+  free(search.deques);
+  freeLogicSolver(&root);
+  return found;
+}
+
+#if defined(__SSE2__)
+// bit of each cell and of its 20 peers in the band layout of Simd9State
+static unsigned int simd9Bits[81][4] __attribute__((aligned(16)));
+static unsigned int simd9Peers[81][4] __attribute__((aligned(16)));
+static pthread_once_t simd9TablesOnce = PTHREAD_ONCE_INIT;
+
+static void initSimd9Tables(void) {
+  for (int cell = 0; cell < 81; cell++) {
+    memset(simd9Bits[cell], 0, sizeof(simd9Bits[cell]));
+    memset(simd9Peers[cell], 0, sizeof(simd9Peers[cell]));
+    simd9Bits[cell][cell / 27] = 1U << (cell % 27);
+    for (int other = 0; other < 81; other++) {
+      int row = cell / 9, col = cell % 9, otherRow = other / 9, otherCol = other % 9;
+      bool peer = row == otherRow || col == otherCol ||
+                  (row / 3 == otherRow / 3 && col / 3 == otherCol / 3);
+      if (peer && other != cell) {
+        simd9Peers[cell][other / 27] |= 1U << (other % 27);
+      }
+    }
+  }
+}
+
+static inline bool simd9Any(__m128i v) {
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xFFFF;
+}
+
+// places digit in cell: clears the cell from the other digits and the digit from the peers
+static inline void simd9Place(Simd9State* state, int digit, int cell) {
+  __m128i bit = _mm_load_si128((const __m128i*) simd9Bits[cell]);
+  for (int d = 0; d < 9; d++) {
+    state->digits[d] = _mm_andnot_si128(bit, state->digits[d]);
+  }
+  __m128i peers = _mm_load_si128((const __m128i*) simd9Peers[cell]);
+  state->digits[digit] = _mm_or_si128(_mm_andnot_si128(peers, state->digits[digit]), bit);
+  state->solved = _mm_or_si128(state->solved, bit);
+}
+
+// union of the peers of the cells in mask
+static inline __m128i simd9PeersOf(__m128i mask) {
+  unsigned int lanes[4] __attribute__((aligned(16)));
+  _mm_store_si128((__m128i*) lanes, mask);
+  __m128i peers = _mm_setzero_si128();
+  for (int lane = 0; lane < 3; lane++) {
+    for (unsigned int rest = lanes[lane]; rest != 0; rest &= rest - 1) {
+      int cell = lane * 27 + __builtin_ctz(rest);
+      peers = _mm_or_si128(peers, _mm_load_si128((const __m128i*) simd9Peers[cell]));
+    }
+  }
+  return peers;
+}
+
+// places every digit d in the cells of placed[d] at once, the masks must not
+// overlap, returns false if two cells placed with the same digit see each other
+static inline bool simd9PlaceAll(Simd9State* state, const __m128i* placed) {
+  __m128i cells = _mm_setzero_si128();
+  __m128i peers[9];
+  for (int d = 0; d < 9; d++) {
+    peers[d] = simd9PeersOf(placed[d]);
+    if (simd9Any(_mm_and_si128(placed[d], peers[d]))) {
+      return false;
+    }
+    cells = _mm_or_si128(cells, placed[d]);
+  }
+  for (int d = 0; d < 9; d++) {
+    __m128i cleared = _mm_andnot_si128(_mm_or_si128(cells, peers[d]), state->digits[d]);
+    state->digits[d] = _mm_or_si128(cleared, placed[d]);
+  }
+  state->solved = _mm_or_si128(state->solved, cells);
+  return true;
+}
+
+// cells where the digit board x has the only place of its row, column or box,
+// units where it has no place at all are added to dead
+static inline __m128i simd9HiddenSingles(__m128i x, __m128i* dead) {
+  const __m128i rowBase = _mm_setr_epi32(0x40201, 0x40201, 0x40201, 0);
+  const __m128i field = _mm_setr_epi32(0x1FF, 0x1FF, 0x1FF, 0);
+  const __m128i boxBase = _mm_setr_epi32(0x49, 0x49, 0x49, 0);
+  // rows: fold the nine columns of each row onto its first bit in halving
+  // steps, the first bit of a row only ever sees bits of its own row
+  __m128i once = x;
+  __m128i twice = _mm_setzero_si128();
+  for (int shift = 1; shift < 8; shift <<= 1) {
+    __m128i upper = _mm_srli_epi32(once, shift);
+    twice = _mm_or_si128(_mm_or_si128(twice, _mm_srli_epi32(twice, shift)), _mm_and_si128(once, upper));
+    once = _mm_or_si128(once, upper);
+  }
+  __m128i last = _mm_srli_epi32(x, 8);
+  twice = _mm_and_si128(_mm_or_si128(twice, _mm_and_si128(once, last)), rowBase);
+  once = _mm_and_si128(_mm_or_si128(once, last), rowBase);
+  __m128i rowOne = _mm_andnot_si128(twice, once);
+  *dead = _mm_or_si128(*dead, _mm_andnot_si128(once, rowBase));
+  __m128i cells = _mm_sub_epi32(_mm_slli_epi32(rowOne, 9), rowOne);
+  // columns: fold the three rows of each band, then the three bands
+  __m128i r0 = _mm_and_si128(x, field);
+  __m128i r1 = _mm_and_si128(_mm_srli_epi32(x, 9), field);
+  __m128i r2 = _mm_and_si128(_mm_srli_epi32(x, 18), field);
+  __m128i bandOnce = _mm_or_si128(_mm_or_si128(r0, r1), r2);
+  __m128i bandTwice = _mm_or_si128(_mm_or_si128(_mm_and_si128(r0, r1), _mm_and_si128(r0, r2)),
+                                   _mm_and_si128(r1, r2));
+  __m128i o1 = _mm_shuffle_epi32(bandOnce, _MM_SHUFFLE(3, 0, 2, 1));
+  __m128i o2 = _mm_shuffle_epi32(bandOnce, _MM_SHUFFLE(3, 1, 0, 2));
+  __m128i t1 = _mm_shuffle_epi32(bandTwice, _MM_SHUFFLE(3, 0, 2, 1));
+  __m128i t2 = _mm_shuffle_epi32(bandTwice, _MM_SHUFFLE(3, 1, 0, 2));
+  __m128i colOnce = _mm_or_si128(_mm_or_si128(bandOnce, o1), o2);
+  __m128i colTwice = _mm_or_si128(_mm_or_si128(_mm_or_si128(bandTwice, t1), t2),
+                                  _mm_or_si128(_mm_or_si128(_mm_and_si128(bandOnce, o1),
+                                                            _mm_and_si128(bandOnce, o2)),
+                                               _mm_and_si128(o1, o2)));
+  __m128i colOne = _mm_andnot_si128(colTwice, colOnce);
+  *dead = _mm_or_si128(*dead, _mm_andnot_si128(colOnce, field));
+  cells = _mm_or_si128(cells, _mm_or_si128(_mm_or_si128(colOne, _mm_slli_epi32(colOne, 9)),
+                                           _mm_slli_epi32(colOne, 18)));
+  // boxes: fold the three columns of each box in the band
+  __m128i c0 = _mm_and_si128(bandOnce, boxBase);
+  __m128i c1 = _mm_and_si128(_mm_srli_epi32(bandOnce, 1), boxBase);
+  __m128i c2 = _mm_and_si128(_mm_srli_epi32(bandOnce, 2), boxBase);
+  __m128i boxOnce = _mm_or_si128(_mm_or_si128(c0, c1), c2);
+  __m128i boxTwice = _mm_and_si128(_mm_or_si128(_mm_or_si128(bandTwice, _mm_srli_epi32(bandTwice, 1)),
+                                                _mm_srli_epi32(bandTwice, 2)), boxBase);
+  boxTwice = _mm_or_si128(boxTwice, _mm_or_si128(_mm_or_si128(_mm_and_si128(c0, c1), _mm_and_si128(c0, c2)),
+                                                 _mm_and_si128(c1, c2)));
+  __m128i boxOne = _mm_andnot_si128(boxTwice, boxOnce);
+  *dead = _mm_or_si128(*dead, _mm_andnot_si128(boxOnce, boxBase));
+  __m128i boxCols = _mm_or_si128(_mm_or_si128(boxOne, _mm_slli_epi32(boxOne, 1)), _mm_slli_epi32(boxOne, 2));
+  cells = _mm_or_si128(cells, _mm_or_si128(_mm_or_si128(boxCols, _mm_slli_epi32(boxCols, 9)),
+                                           _mm_slli_epi32(boxCols, 18)));
+  return _mm_and_si128(x, cells);
+}
+
+// places naked and hidden singles until there are none left
+// returns false if a cell has no candidate or a unit has no place for a digit
+static bool propagateSimd9(Simd9State* state) {
+  const __m128i all = _mm_setr_epi32(0x7FFFFFF, 0x7FFFFFF, 0x7FFFFFF, 0);
+  for (;;) {
+    __m128i unsolved = _mm_andnot_si128(state->solved, all);
+    if (!simd9Any(unsolved)) {
+      return true;
+    }
+    __m128i once = _mm_setzero_si128();
+    __m128i twice = _mm_setzero_si128();
+    for (int d = 0; d < 9; d++) {
+      twice = _mm_or_si128(twice, _mm_and_si128(once, state->digits[d]));
+      once = _mm_or_si128(once, state->digits[d]);
+    }
+    if (simd9Any(_mm_andnot_si128(once, unsolved))) {
+      return false;
+    }
+    __m128i singles = _mm_and_si128(_mm_andnot_si128(twice, once), unsolved);
+    if (simd9Any(singles)) {
+      __m128i placed[9];
+      for (int d = 0; d < 9; d++) {
+        placed[d] = _mm_and_si128(state->digits[d], singles);
+      }
+      if (!simd9PlaceAll(state, placed)) {
+        return false;
+      }
+      continue;
+    }
+    __m128i dead = _mm_setzero_si128();
+    __m128i hidden[9];
+    __m128i anyHidden = _mm_setzero_si128();
+    __m128i clash = _mm_setzero_si128();
+    for (int d = 0; d < 9; d++) {
+      hidden[d] = _mm_andnot_si128(state->solved, simd9HiddenSingles(state->digits[d], &dead));
+      clash = _mm_or_si128(clash, _mm_and_si128(anyHidden, hidden[d]));
+      anyHidden = _mm_or_si128(anyHidden, hidden[d]);
+    }
+    // a cell that is the only place of two digits
+    if (simd9Any(_mm_or_si128(dead, clash))) {
+      return false;
+    }
+    if (!simd9Any(anyHidden)) {
+      return true;
+    }
+    if (!simd9PlaceAll(state, hidden)) {
+      return false;
+    }
+  }
+}
+
+// keeps the solved cells of state if they are more than the search had before
+static void recordSimd9(const Simd9State* state, BudgetTracker* tracker) {
+  unsigned int solved[4] __attribute__((aligned(16)));
+  _mm_store_si128((__m128i*) solved, state->solved);
+  int fixed = __builtin_popcount(solved[0]) + __builtin_popcount(solved[1]) + __builtin_popcount(solved[2]);
+  if (!improvesBest(tracker, fixed)) {
+    return;
+  }
+  for (int d = 0; d < 9; d++) {
+    unsigned int lanes[4] __attribute__((aligned(16)));
+    _mm_store_si128((__m128i*) lanes, _mm_and_si128(state->digits[d], state->solved));
+    for (int lane = 0; lane < 3; lane++) {
+      for (unsigned int rest = lanes[lane]; rest != 0; rest &= rest - 1) {
+        tracker->best[lane * 27 + __builtin_ctz(rest)] = d + 1;
+      }
+    }
+  }
+}
+
+// propagates, then branches on a cell with two candidates if there is one,
+// the state is 160 bytes so each branch works on a copy
+// counts complete grids in search and returns true once they reach its limit
+static bool searchSimd9(Simd9State* state, Simd9Search* search) {
+  if (budgetSpent(&search->tracker, search->nodes) || !propagateSimd9(state)) {
+    return false;
+  }
+  const __m128i all = _mm_setr_epi32(0x7FFFFFF, 0x7FFFFFF, 0x7FFFFFF, 0);
+  __m128i unsolved = _mm_andnot_si128(state->solved, all);
+  if (!simd9Any(unsolved)) {
+    return ++search->solutions >= search->limit;
+  }
+  if (search->tracker.best != NULL) {
+    recordSimd9(state, &search->tracker);
+  }
+  search->nodes++;
+  __m128i once = _mm_setzero_si128();
+  __m128i twice = _mm_setzero_si128();
+  __m128i thrice = _mm_setzero_si128();
+  for (int d = 0; d < 9; d++) {
+    thrice = _mm_or_si128(thrice, _mm_and_si128(twice, state->digits[d]));
+    twice = _mm_or_si128(twice, _mm_and_si128(once, state->digits[d]));
+    once = _mm_or_si128(once, state->digits[d]);
+  }
+  __m128i pairs = _mm_andnot_si128(thrice, _mm_and_si128(twice, unsolved));
+  unsigned int lanes[4] __attribute__((aligned(16)));
+  _mm_store_si128((__m128i*) lanes, simd9Any(pairs) ? pairs : unsolved);
+  int lane = lanes[0] != 0 ? 0 : lanes[1] != 0 ? 1 : 2;
+  int cell = lane * 27 + __builtin_ctz(lanes[lane]);
+  __m128i bit = _mm_load_si128((const __m128i*) simd9Bits[cell]);
+  for (int d = 0; d < 9; d++) {
+    if (simd9Any(_mm_and_si128(state->digits[d], bit))) {
+      Simd9State branch = *state;
+      simd9Place(&branch, d, cell);
+      if (searchSimd9(&branch, search)) {
+        *state = branch;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// solves a 9x9 grid with singles propagated in SSE registers, see solveSudokuPuzzle
+long long solveSimd9(int** grid, SolveMode mode, long long limit, SearchBudget* budget) {
+  pthread_once(&simd9TablesOnce, initSimd9Tables);
+  Simd9State state;
+  for (int d = 0; d < 9; d++) {
+    state.digits[d] = _mm_setr_epi32(0x7FFFFFF, 0x7FFFFFF, 0x7FFFFFF, 0);
+  }
+  state.solved = _mm_setzero_si128();
+  unsigned int givens[9][4] __attribute__((aligned(16)));
+  memset(givens, 0, sizeof(givens));
+  for (int cell = 0; cell < 81; cell++) {
+    int value = grid[cell / 9 + 1][cell % 9 + 1];
+    if (value < 0 || value > 9) {
+      return 0;
+    }
+    if (value != 0) {
+      givens[value - 1][cell / 27] |= 1U << (cell % 27);
+    }
+  }
+  __m128i placed[9];
+  for (int d = 0; d < 9; d++) {
+    placed[d] = _mm_load_si128((const __m128i*) givens[d]);
+  }
+  Simd9Search search = {.limit = limit};
+  initBudgetTracker(&search.tracker, budget, 81);
+  bool consistent = simd9PlaceAll(&state, placed);
+  if (!consistent || !searchSimd9(&state, &search) || mode != SOLVE_ONE) {
+    if (consistent && mode == SOLVE_ONE) {
+      writeBestPartial(&search.tracker, 9, grid);
+    }
+    freeBudgetTracker(&search.tracker);
+    return search.solutions;
+  }
+  freeBudgetTracker(&search.tracker);
+  for (int d = 0; d < 9; d++) {
+    unsigned int lanes[4] __attribute__((aligned(16)));
+    _mm_store_si128((__m128i*) lanes, state.digits[d]);
+    for (int lane = 0; lane < 3; lane++) {
+      for (unsigned int rest = lanes[lane]; rest != 0; rest &= rest - 1) {
+        int cell = lane * 27 + __builtin_ctz(rest);
+        grid[cell / 9 + 1][cell % 9 + 1] = d + 1;
+      }
+    }
+  }
+  return search.solutions;
+}
+#endif
+
+// appends value to the list
+static void pushInt(IntList* list, int value) {
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity == 0 ? 4 : list->capacity * 2;
+    list->items = realloc(list->items, list->capacity * sizeof(int));
+    if (list->items == NULL) {
+      printf("ERROR: out of memory for solver\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  list->items[list->count++] = value;
+}
+
+// moves the variable at heap position i up past the less active ones
+static void satHeapUp(SatSolver* sat, int i) {
+  int var = sat->heap[i];
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (sat->activity[sat->heap[parent]] >= sat->activity[var]) {
+      break;
+    }
+    sat->heap[i] = sat->heap[parent];
+    sat->heapIndex[sat->heap[i]] = i;
+    i = parent;
+  }
+  sat->heap[i] = var;
+  sat->heapIndex[var] = i;
+}
+
+// moves the variable at heap position i down below the more active ones
+static void satHeapDown(SatSolver* sat, int i) {
+  int var = sat->heap[i];
+  for (;;) {
+    int child = 2 * i + 1;
+    if (child >= sat->heapCount) {
+      break;
+    }
+    if (child + 1 < sat->heapCount && sat->activity[sat->heap[child + 1]] > sat->activity[sat->heap[child]]) {
+      child++;
+    }
+    if (sat->activity[sat->heap[child]] <= sat->activity[var]) {
+      break;
+    }
+    sat->heap[i] = sat->heap[child];
+    sat->heapIndex[sat->heap[i]] = i;
+    i = child;
+  }
+  sat->heap[i] = var;
+  sat->heapIndex[var] = i;
+}
+
+static void satHeapInsert(SatSolver* sat, int var) {
+  if (sat->heapIndex[var] < 0) {
+    sat->heap[sat->heapCount] = var;
+    sat->heapIndex[var] = sat->heapCount;
+    satHeapUp(sat, sat->heapCount++);
+  }
+}
+
+// takes the most active variable out of the heap
+static int satHeapPop(SatSolver* sat) {
+  int var = sat->heap[0];
+  sat->heapIndex[var] = -1;
+  if (--sat->heapCount > 0) {
+    sat->heap[0] = sat->heap[sat->heapCount];
+    satHeapDown(sat, 0);
+  }
+  return var;
+}
+
+// raises the activity of a variable met in a conflict, scaling every
+// activity down before they overflow
+static void bumpSatVariable(SatSolver* sat, int var) {
+  sat->activity[var] += sat->increment;
+  if (sat->activity[var] > 1e100) {
+    for (int v = 0; v < sat->vars; v++) {
+      sat->activity[v] *= 1e-100;
+    }
+    sat->increment *= 1e-100;
+  }
+  if (sat->heapIndex[var] >= 0) {
+    satHeapUp(sat, sat->heapIndex[var]);
+  }
+}
+
+static inline void assignSat(SatSolver* sat, int lit, int reason) {
+  int var = lit >> 1;
+  sat->values[lit] = 1;
+  sat->values[lit ^ 1] = -1;
+  sat->levels[var] = sat->level;
+  sat->reasons[var] = reason;
+  sat->trail[sat->trailCount++] = lit;
+  sat->placed += (lit & 1) == 0;
+}
+
+// stores a clause of three or more literals and watches its first two,
+// returns its arena offset
+static int attachSatClause(SatSolver* sat, const int* lits, int count, int lbd) {
+  int offset = sat->arena.count;
+  pushInt(&sat->arena, count);
+  pushInt(&sat->arena, lbd);
+  for (int i = 0; i < count; i++) {
+    pushInt(&sat->arena, lits[i]);
+  }
+  pushInt(&sat->watches[lits[0]], offset);
+  pushInt(&sat->watches[lits[0]], lits[1]);
+  pushInt(&sat->watches[lits[1]], offset);
+  pushInt(&sat->watches[lits[1]], lits[0]);
+  return offset;
+}
+
+// adds a clause at level 0, leaving out the literals already false,
+// returns false if no literal is left to satisfy it
+static bool addSatClause(SatSolver* sat, const int* lits, int count) {
+  sat->learnt.count = 0;
+  for (int i = 0; i < count; i++) {
+    if (sat->values[lits[i]] > 0) {
+      return true;
+    }
+    if (sat->values[lits[i]] == 0) {
+      pushInt(&sat->learnt, lits[i]);
+    }
+  }
+  int* kept = sat->learnt.items;
+  switch (sat->learnt.count) {
+    case 0:
+      return false;
+    case 1:
+      assignSat(sat, kept[0], -1);
+      return true;
+    case 2:
+      pushInt(&sat->implies[kept[0] ^ 1], kept[1]);
+      pushInt(&sat->implies[kept[1] ^ 1], kept[0]);
+      return true;
+    default:
+      attachSatClause(sat, kept, sat->learnt.count, 0);
+      return true;
+  }
+}
+
+// cells of unit u of a kind (0 rows, 1 columns, 2 boxes), in order
+static inline int unitCell(int psize, int boxSize, int kind, int unit, int i) {
+  if (kind == 0) {
+    return unit * psize + i;
+  }
+  if (kind == 1) {
+    return i * psize + unit;
+  }
+  return ((unit / boxSize) * boxSize + i / boxSize) * psize + (unit % boxSize) * boxSize + i % boxSize;
+}
+
+// encodes grid with a variable for each value the givens leave open in a
+// cell: every open cell takes at least one and at most one value, and every
+// value missing from a unit goes to at least one and at most one of its cells
+// returns false if the givens conflict or leave a cell or value no place
+bool initSatSolver(SatSolver* sat, int psize, int** grid) {
+  int cells = psize * psize;
+  BitmaskSolver* used = malloc(sizeof(BitmaskSolver));
+  int* varOf = malloc(sizeof(int) * cells * psize);
+  if (used == NULL || varOf == NULL) {
+    printf("ERROR: out of memory for solver\n");
+    exit(EXIT_FAILURE);
+  }
+  bool consistent = initBitmaskSolver(used, psize, grid);
+  int boxSize = used->boxSize;
+  int vars = 0;
+  for (int cell = 0; cell < cells; cell++) {
+    unsigned long long candidates = consistent && used->cells[cell] == 0 ? bitmaskCandidates(used, cell) : 0;
+    for (int value = 0; value < psize; value++) {
+      varOf[cell * psize + value] = candidates >> value & 1 ? vars++ : -1;
+    }
+  }
+
+  memset(sat, 0, sizeof(SatSolver));
+  sat->psize = psize;
+  initBudgetTracker(&sat->tracker, NULL, 0);
+  sat->vars = vars;
+  sat->placements = calloc((size_t) vars * 9 + 3, sizeof(int));
+  sat->activity = malloc(sizeof(double) * (vars + 1));
+  sat->values = calloc(vars * 3 + 2, 1);
+  sat->watches = calloc(vars * 4 + 2, sizeof(IntList));
+  if (sat->placements == NULL || sat->activity == NULL || sat->values == NULL || sat->watches == NULL) {
+    printf("ERROR: out of memory for solver\n");
+    exit(EXIT_FAILURE);
+  }
+  sat->levels = sat->placements + vars;
+  sat->reasons = sat->levels + vars;
+  sat->phases = sat->reasons + vars;
+  sat->heap = sat->phases + vars;
+  sat->heapIndex = sat->heap + vars;
+  sat->trail = sat->heapIndex + vars;
+  sat->levelStarts = sat->trail + vars;
+  sat->levelStamps = sat->levelStarts + vars + 1;
+  sat->seen = (unsigned char*) sat->values + vars * 2;
+  sat->implies = sat->watches + vars * 2;
+  sat->increment = 1;
+  sat->learntLimit = SAT_LEARNT_LIMIT;
+
+  for (int placement = 0; placement < cells * psize; placement++) {
+    int var = varOf[placement];
+    if (var >= 0) {
+      // decisions start on the cells with the fewest candidates and rule a
+      // value out rather than place it, which lets the learnt clauses do the
+      // placing and is far faster on sparse boards
+      sat->placements[var] = placement;
+      sat->phases[var] = 2 * var + 1;
+      sat->activity[var] = 1.0 / __builtin_popcountll(bitmaskCandidates(used, placement / psize));
+      sat->heapIndex[var] = -1;
+    }
+  }
+  for (int var = 0; var < vars; var++) {
+    satHeapInsert(sat, var);
+  }
+
+  int lits[MAX_PUZZLE_SIZE];
+  int where[MAX_PUZZLE_SIZE];
+  for (int cell = 0; consistent && cell < cells; cell++) {
+    if (used->cells[cell] != 0) {
+      continue;
+    }
+    int count = 0;
+    for (int value = 0; value < psize; value++) {
+      if (varOf[cell * psize + value] >= 0) {
+        lits[count++] = 2 * varOf[cell * psize + value];
+      }
+    }
+    consistent = addSatClause(sat, lits, count);
+    for (int i = 0; consistent && i < count; i++) {
+      for (int j = i + 1; consistent && j < count; j++) {
+        int pair[2] = {lits[i] ^ 1, lits[j] ^ 1};
+        consistent = addSatClause(sat, pair, 2);
+      }
+    }
+  }
+  for (int kind = 0; consistent && kind < 3; kind++) {
+    unsigned long long* placed = kind == 0 ? used->rows : kind == 1 ? used->cols : used->boxes;
+    for (int unit = 0; consistent && unit < psize; unit++) {
+      for (int value = 0; consistent && value < psize; value++) {
+        if (placed[unit] >> value & 1) {
+          continue;
+        }
+        int count = 0;
+        for (int i = 0; i < psize; i++) {
+          int cell = unitCell(psize, boxSize, kind, unit, i);
+          if (varOf[cell * psize + value] >= 0) {
+            where[count] = cell;
+            lits[count++] = 2 * varOf[cell * psize + value];
+          }
+        }
+        consistent = addSatClause(sat, lits, count);
+        for (int i = 0; consistent && i < count; i++) {
+          for (int j = i + 1; consistent && j < count; j++) {
+            // pairs of a box sharing a row or column are already excluded
+            if (kind == 2 && (where[i] / psize == where[j] / psize || where[i] % psize == where[j] % psize)) {
+              continue;
+            }
+            int pair[2] = {lits[i] ^ 1, lits[j] ^ 1};
+            consistent = addSatClause(sat, pair, 2);
+          }
+        }
+      }
+    }
+  }
+  free(varOf);
+  free(used);
+  return consistent;
+}
+
+void freeSatSolver(SatSolver* sat) {
+  for (int lit = 0; lit < sat->vars * 4; lit++) {
+    free(sat->watches[lit].items);
+  }
+  free(sat->watches);
+  free(sat->arena.items);
+  free(sat->learnts.items);
+  free(sat->learnt.items);
+  free(sat->placements);
+  free(sat->activity);
+  free(sat->values);
+}
+
+// assigns what the clauses imply, returns the arena offset of a clause left
+// with every literal false, -2 for a two literal clause (its literals in
+// binaryConflict) or -1 when there is no conflict
+static int propagateSat(SatSolver* sat) {
+  while (sat->propagated < sat->trailCount) {
+    int lit = sat->trail[sat->propagated++];
+    int falseLit = lit ^ 1;
+    IntList* implied = &sat->implies[lit];
+    for (int i = 0; i < implied->count; i++) {
+      int other = implied->items[i];
+      if (sat->values[other] < 0) {
+        sat->binaryConflict[0] = other;
+        sat->binaryConflict[1] = falseLit;
+        return -2;
+      }
+      if (sat->values[other] == 0) {
+        assignSat(sat, other, -2 - falseLit);
+      }
+    }
+
+    IntList* watching = &sat->watches[falseLit];
+    int* watch = watching->items;
+    int count = watching->count;
+    int kept = 0;
+    int i = 0;
+    while (i < count) {
+      int offset = watch[i];
+      int blocker = watch[i + 1];
+      i += 2;
+      if (sat->values[blocker] > 0) {
+        watch[kept++] = offset;
+        watch[kept++] = blocker;
+        continue;
+      }
+      int size = sat->arena.items[offset];
+      int* clause = sat->arena.items + offset + 2;
+      // the false literal goes second, the other watched one first
+      if (clause[0] == falseLit) {
+        clause[0] = clause[1];
+        clause[1] = falseLit;
+      }
+      int first = clause[0];
+      if (first != blocker && sat->values[first] > 0) {
+        watch[kept++] = offset;
+        watch[kept++] = first;
+        continue;
+      }
+      int k = 2;
+      while (k < size && sat->values[clause[k]] < 0) {
+        k++;
+      }
+      if (k < size) {
+        clause[1] = clause[k];
+        clause[k] = falseLit;
+        pushInt(&sat->watches[clause[1]], offset);
+        pushInt(&sat->watches[clause[1]], first);
+        continue;
+      }
+      watch[kept++] = offset;
+      watch[kept++] = first;
+      if (sat->values[first] < 0) {
+        while (i < count) {
+          watch[kept++] = watch[i++];
+        }
+        watching->count = kept;
+        return offset;
+      }
+      assignSat(sat, first, offset);
+    }
+    watching->count = kept;
+  }
+  return -1;
+}
+
+// true if every other literal of the clause that implied var is in the
+// learnt clause or fixed at level 0
+static bool satRedundant(const SatSolver* sat, int var) {
+  int reason = sat->reasons[var];
+  if (reason < -1) {
+    int other = (-2 - reason) >> 1;
+    return sat->seen[other] || sat->levels[other] == 0;
+  }
+  const int* clause = sat->arena.items + reason + 2;
+  for (int i = 1; i < sat->arena.items[reason]; i++) {
+    int other = clause[i] >> 1;
+    if (!sat->seen[other] && sat->levels[other] > 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// learns the first unique implication point clause of a conflict into
+// learnt, with the asserting literal first and a literal of the level to go
+// back to second, returns that level and sets lbd to the levels it spans
+static int analyzeSat(SatSolver* sat, int conflict, int* lbd) {
+  IntList* learnt = &sat->learnt;
+  learnt->count = 0;
+  pushInt(learnt, 0);
+  int pending = 0;
+  int lit = -1;
+  int index = sat->trailCount - 1;
+  int reason = conflict;
+  for (;;) {
+    const int* lits;
+    int count;
+    int other;
+    if (lit < 0 && reason == -2) {
+      lits = sat->binaryConflict;
+      count = 2;
+    }
+    else if (lit >= 0 && reason < -1) {
+      other = -2 - reason;
+      lits = &other;
+      count = 1;
+    }
+    else {
+      lits = sat->arena.items + reason + 2;
+      count = sat->arena.items[reason];
+      // a reason holds the literal it implied first
+      if (lit >= 0) {
+        lits++;
+        count--;
+      }
+    }
+    for (int i = 0; i < count; i++) {
+      int var = lits[i] >> 1;
+      if (!sat->seen[var] && sat->levels[var] > 0) {
+        sat->seen[var] = 1;
+        bumpSatVariable(sat, var);
+        if (sat->levels[var] >= sat->level) {
+          pending++;
+        }
+        else {
+          pushInt(learnt, lits[i]);
+        }
+      }
+    }
+    while (!sat->seen[sat->trail[index] >> 1]) {
+      index--;
+    }
+    lit = sat->trail[index--];
+    sat->seen[lit >> 1] = 0;
+    if (--pending == 0) {
+      break;
+    }
+    reason = sat->reasons[lit >> 1];
+  }
+  learnt->items[0] = lit ^ 1;
+
+  // literals implied by the others are left out, moved past the end so that
+  // their marks are still cleared
+  int* items = learnt->items;
+  int kept = 1;
+  for (int i = 1; i < learnt->count; i++) {
+    if (sat->reasons[items[i] >> 1] == -1 || !satRedundant(sat, items[i] >> 1)) {
+      int keep = items[i];
+      items[i] = items[kept];
+      items[kept++] = keep;
+    }
+  }
+  for (int i = 1; i < learnt->count; i++) {
+    sat->seen[items[i] >> 1] = 0;
+  }
+  learnt->count = kept;
+
+  int back = 0;
+  sat->stamp++;
+  *lbd = 0;
+  for (int i = 0; i < kept; i++) {
+    int level = sat->levels[items[i] >> 1];
+    if (sat->levelStamps[level] != sat->stamp) {
+      sat->levelStamps[level] = sat->stamp;
+      (*lbd)++;
+    }
+    if (i > 0 && level > back) {
+      back = level;
+      int swap = items[1];
+      items[1] = items[i];
+      items[i] = swap;
+    }
+  }
+  return back;
+}
+
+// undoes the assignments above level, remembering the value each variable had
+static void backtrackSat(SatSolver* sat, int level) {
+  if (sat->level <= level) {
+    return;
+  }
+  int start = sat->levelStarts[level + 1];
+  for (int i = sat->trailCount - 1; i >= start; i--) {
+    int lit = sat->trail[i];
+    sat->values[lit] = 0;
+    sat->values[lit ^ 1] = 0;
+    sat->phases[lit >> 1] = lit;
+    sat->placed -= (lit & 1) == 0;
+    satHeapInsert(sat, lit >> 1);
+  }
+  sat->trailCount = start;
+  sat->propagated = start;
+  sat->level = level;
+}
+
+// stores the clause just learnt and assigns its asserting literal
+static void learnSat(SatSolver* sat, int lbd) {
+  int* lits = sat->learnt.items;
+  if (sat->learnt.count == 1) {
+    assignSat(sat, lits[0], -1);
+  }
+  else if (sat->learnt.count == 2) {
+    pushInt(&sat->implies[lits[0] ^ 1], lits[1]);
+    pushInt(&sat->implies[lits[1] ^ 1], lits[0]);
+    assignSat(sat, lits[0], -2 - lits[1]);
+  }
+  else {
+    int offset = attachSatClause(sat, lits, sat->learnt.count, lbd);
+    pushInt(&sat->learnts, offset);
+    assignSat(sat, lits[0], offset);
+  }
+}
+
+static int compareLearnt(const void* a, const void* b) {
+  const int* x = a;
+  const int* y = b;
+  return x[0] != y[0] ? x[0] - y[0] : x[1] - y[1];
+}
+
+// at level 0, drops the weaker half of the learnt clauses (highest lbd, then
+// longest) and the clauses the level 0 assignments satisfy, takes the false
+// literals out of the rest and rebuilds the arena and the watches
+static void reduceSat(SatSolver* sat) {
+  int* ranked = malloc(sizeof(int) * 3 * sat->learnts.count);
+  if (ranked == NULL) {
+    printf("ERROR: out of memory for solver\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < sat->learnts.count; i++) {
+    int offset = sat->learnts.items[i];
+    ranked[3 * i] = sat->arena.items[offset + 1];
+    ranked[3 * i + 1] = sat->arena.items[offset];
+    ranked[3 * i + 2] = offset;
+  }
+  qsort(ranked, sat->learnts.count, 3 * sizeof(int), compareLearnt);
+  for (int i = sat->learnts.count / 2; i < sat->learnts.count; i++) {
+    // clauses spanning two levels are kept whatever their rank
+    if (ranked[3 * i] > 2) {
+      sat->arena.items[ranked[3 * i + 2] + 1] = -1;
+    }
+  }
+  free(ranked);
+
+  IntList arena = {NULL, 0, 0};
+  sat->learnts.count = 0;
+  for (int lit = 0; lit < sat->vars * 2; lit++) {
+    sat->watches[lit].count = 0;
+  }
+  for (int offset = 0; offset < sat->arena.count; offset += 2 + sat->arena.items[offset]) {
+    int size = sat->arena.items[offset];
+    int lbd = sat->arena.items[offset + 1];
+    const int* clause = sat->arena.items + offset + 2;
+    if (lbd < 0) {
+      continue;
+    }
+    sat->learnt.count = 0;
+    bool satisfied = false;
+    for (int i = 0; i < size && !satisfied; i++) {
+      satisfied = sat->values[clause[i]] > 0;
+      if (sat->values[clause[i]] == 0) {
+        pushInt(&sat->learnt, clause[i]);
+      }
+    }
+    // propagation is complete at level 0, so two literals are always left
+    if (satisfied) {
+      continue;
+    }
+    int kept = arena.count;
+    pushInt(&arena, sat->learnt.count);
+    pushInt(&arena, lbd);
+    for (int i = 0; i < sat->learnt.count; i++) {
+      pushInt(&arena, sat->learnt.items[i]);
+    }
+    int first = sat->learnt.items[0];
+    int second = sat->learnt.items[1];
+    pushInt(&sat->watches[first], kept);
+    pushInt(&sat->watches[first], second);
+    pushInt(&sat->watches[second], kept);
+    pushInt(&sat->watches[second], first);
+    if (lbd > 0) {
+      pushInt(&sat->learnts, kept);
+    }
+  }
+  free(sat->arena.items);
+  sat->arena = arena;
+  // the old offsets are gone, and level 0 is never looked into
+  for (int i = 0; i < sat->trailCount; i++) {
+    sat->reasons[sat->trail[i] >> 1] = -1;
+  }
+  sat->learntLimit += sat->learntLimit / 10;
+}
+
+// element i of the Luby sequence 1 1 2 1 1 2 4 1 1 2 ...
+static long long lubySat(long long i) {
+  long long size = 1;
+  int seq = 0;
+  while (size < i + 1) {
+    seq++;
+    size = 2 * size + 1;
+  }
+  while (size - 1 != i) {
+    size = (size - 1) >> 1;
+    seq--;
+    i = i % size;
+  }
+  return 1LL << seq;
+}
+
+// decides the most active open variable and propagates until every variable
+// is assigned, learning a clause and jumping back on each conflict
+// returns 1 for a complete assignment, 0 if the clauses cannot be satisfied
+// and -1 if cancelled or out of budget
+static int searchSat(SatSolver* sat) {
+  long long restartAt = sat->conflicts + lubySat(sat->restarts) * SAT_RESTART_CONFLICTS;
+  for (;;) {
+    int conflict = propagateSat(sat);
+    if (conflict != -1) {
+      sat->conflicts++;
+      if (sat->level == 0) {
+        return 0;
+      }
+      int lbd;
+      int back = analyzeSat(sat, conflict, &lbd);
+      backtrackSat(sat, back);
+      learnSat(sat, lbd);
+      sat->increment /= SAT_ACTIVITY_DECAY;
+      if (sat->conflicts >= restartAt) {
+        sat->restarts++;
+        backtrackSat(sat, 0);
+        restartAt = sat->conflicts + lubySat(sat->restarts) * SAT_RESTART_CONFLICTS;
+      }
+      continue;
+    }
+    if (sat->level == 0 && sat->learnts.count >= sat->learntLimit) {
+      reduceSat(sat);
+    }
+    if (sat->cancel != NULL && __atomic_load_n(sat->cancel, __ATOMIC_RELAXED)) {
+      return -1;
+    }
+    if (improvesBest(&sat->tracker, sat->placed)) {
+      for (int i = 0; i < sat->trailCount; i++) {
+        if ((sat->trail[i] & 1) == 0) {
+          int placement = sat->placements[sat->trail[i] >> 1];
+          sat->tracker.best[placement / sat->psize] = placement % sat->psize + 1;
+        }
+      }
+    }
+    if (budgetSpent(&sat->tracker, sat->decisions)) {
+      return -1;
+    }
+    int var = -1;
+    while (sat->heapCount > 0 && var < 0) {
+      var = satHeapPop(sat);
+      if (sat->values[2 * var] != 0) {
+        var = -1;
+      }
+    }
+    if (var < 0) {
+      return 1;
+    }
+    sat->decisions++;
+    sat->level++;
+    sat->levelStarts[sat->level] = sat->trailCount;
+    assignSat(sat, sat->phases[var], -1);
+  }
+}
+
+// solves grid with the sat solver, see solveSudokuPuzzle
+// further solutions are looked for after a clause ruling out the decisions
+// of the last one, which imply all of its other assignments
+long long solveSat(int psize, int** grid, SolveMode mode, long long limit, const bool* cancel,
+                   SearchBudget* budget) {
+  SatSolver sat;
+  long long solutions = 0;
+  bool open = initSatSolver(&sat, psize, grid);
+  sat.cancel = cancel;
+  initBudgetTracker(&sat.tracker, budget, psize * psize);
+  int* blocking = malloc(sizeof(int) * (sat.vars + 1));
+  if (blocking == NULL) {
+    printf("ERROR: out of memory for solver\n");
+    exit(EXIT_FAILURE);
+  }
+  while (open && searchSat(&sat) == 1) {
+    solutions++;
+    if (mode == SOLVE_ONE) {
+      for (int var = 0; var < sat.vars; var++) {
+        if (sat.values[2 * var] > 0) {
+          int cell = sat.placements[var] / psize;
+          grid[cell / psize + 1][cell % psize + 1] = sat.placements[var] % psize + 1;
+        }
+      }
+    }
+    if (solutions >= limit || sat.level == 0) {
+      break;
+    }
+    for (int level = 1; level <= sat.level; level++) {
+      blocking[level - 1] = sat.trail[sat.levelStarts[level]] ^ 1;
+    }
+    int count = sat.level;
+    backtrackSat(&sat, 0);
+    open = addSatClause(&sat, blocking, count);
+  }
+  if (mode == SOLVE_ONE && solutions == 0) {
+    writeBestPartial(&sat.tracker, psize, grid);
+  }
+  freeBudgetTracker(&sat.tracker);
+  free(blocking);
+  freeSatSolver(&sat);
+  return solutions;
+}
+
+// writes the sat encoding of grid in DIMACS form, variable cell * psize + value
+// is that value placed in that cell (cells numbered row-major from 0), the
+// placements the givens decide come first as unit clauses
+void writeSatDimacs(FILE* out, int psize, int** grid) {
+  SatSolver sat;
+  long long placements = (long long) psize * psize * psize;
+  if (!initSatSolver(&sat, psize, grid)) {
+    fprintf(out, "c the givens leave no solution\np cnf %lld 1\n0\n", placements);
+    freeSatSolver(&sat);
+    return;
+  }
+  bool* open = calloc(placements, sizeof(bool));
+  if (open == NULL) {
+    printf("ERROR: out of memory for solver\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int var = 0; var < sat.vars; var++) {
+    open[sat.placements[var]] = true;
+  }
+  // first pass counts the clauses for the header, second writes them
+  long long clauses = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass == 1) {
+      fprintf(out, "c sudoku %dx%d\np cnf %lld %lld\n", psize, psize, placements, clauses);
+    }
+    for (long long placement = 0; placement < placements; placement++) {
+      if (!open[placement]) {
+        int value = grid[placement / psize / psize + 1][placement / psize % psize + 1];
+        if (pass == 0) {
+          clauses++;
+        }
+        else {
+          fprintf(out, "%s%lld 0\n", value == placement % psize + 1 ? "" : "-", placement + 1);
+        }
+      }
+    }
+    for (int i = 0; i < sat.trailCount; i++) {
+      int lit = sat.trail[i];
+      if (pass == 0) {
+        clauses++;
+      }
+      else {
+        fprintf(out, "%s%d 0\n", lit & 1 ? "-" : "", sat.placements[lit >> 1] + 1);
+      }
+    }
+    for (int lit = 0; lit < sat.vars * 2; lit++) {
+      for (int i = 0; i < sat.implies[lit].count; i++) {
+        // each two literal clause is listed under both of its literals
+        int other = sat.implies[lit].items[i];
+        if ((lit ^ 1) > other) {
+          continue;
+        }
+        if (pass == 0) {
+          clauses++;
+        }
+        else {
+          fprintf(out, "%s%d %s%d 0\n", lit & 1 ? "" : "-", sat.placements[lit >> 1] + 1,
+                  other & 1 ? "-" : "", sat.placements[other >> 1] + 1);
+        }
+      }
+    }
+    for (int offset = 0; offset < sat.arena.count; offset += 2 + sat.arena.items[offset]) {
+      if (pass == 0) {
+        clauses++;
+        continue;
+      }
+      for (int i = 0; i < sat.arena.items[offset]; i++) {
+        int lit = sat.arena.items[offset + 2 + i];
+        fprintf(out, "%s%d ", lit & 1 ? "-" : "", sat.placements[lit >> 1] + 1);
+      }
+      fprintf(out, "0\n");
+    }
+  }
+  free(open);
+  freeSatSolver(&sat);
+}
+
+// name of a solver as given to -e
+const char* solverName(SolverKind kind) {
+  static const char* names[] = {"none", "bitmask", "dlx", "logic", "sat", "portfolio"};
+  return names[kind];
+}
+
+// runs one solver of a portfolio race on its copy of the grid, and if it
+// is the first to finish, claims the win and stops the others
+// a solver that runs out of its budget leaves the race to the others
+void* portfolioWorker(void* parameters) {
+  PortfolioEntry* entry = (PortfolioEntry*) parameters;
+  PortfolioRace* race = entry->race;
+  int psize = race->psize;
+  const bool* cancel = &race->done;
+  SearchBudget* budget = race->budget != NULL ? &entry->budget : NULL;
+  switch (entry->kind) {
+    case SOLVER_BITMASK:
+      entry->solutions = solveBitmask(psize, entry->grid, race->mode, race->limit, cancel, budget);
+      break;
+    case SOLVER_DLX:
+      entry->solutions = solveDlx(psize, entry->grid, race->mode, race->limit, NULL, cancel, budget);
+      break;
+    case SOLVER_LOGIC:
+      entry->solutions = solveLogic(psize, entry->grid, race->mode, race->limit, cancel, budget);
+      break;
+    default:
+      entry->solutions = solveSat(psize, entry->grid, race->mode, race->limit, cancel, budget);
+      break;
+  }
+  if (entry->budget.spent) {
+    return NULL;
+  }
+  // a solver stopped early only returns after done is set, by which time
+  // the winner is already claimed
+  SolverKind none = SOLVER_NONE;
+  if (__atomic_compare_exchange_n(&race->winner, &none, entry->kind, false, __ATOMIC_ACQ_REL,
+                                  __ATOMIC_ACQUIRE)) {
+    __atomic_store_n(&race->done, true, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+// races the bitmask, dancing links, logic and sat solvers on their own
+// threads and copies of grid, returns the answer of the first to finish
+// and sets winner to it
+// each solver gets the limits of budget to itself, when they all run out
+// budget is marked spent and the one that got furthest answers
+long long solvePortfolio(int psize, int** grid, SolveMode mode, long long limit, SearchBudget* budget,
+                         SolverKind* winner) {
+  static const SolverKind entrants[] = {SOLVER_BITMASK, SOLVER_DLX, SOLVER_LOGIC, SOLVER_SAT};
+  int count = sizeof(entrants) / sizeof(entrants[0]);
+  PortfolioRace race;
+  race.psize = psize;
+  race.mode = mode;
+  race.limit = limit;
+  race.budget = budget;
+  race.winner = SOLVER_NONE;
+  race.done = false;
+  PortfolioEntry entries[count];
+  pthread_t threads[count];
+  // the copies are made up front, grid is only written once the race is over
+  for (int i = 0; i < count; i++) {
+    entries[i].race = &race;
+    entries[i].kind = entrants[i];
+    entries[i].grid = copySudokuPuzzle(psize, grid);
+    entries[i].solutions = 0;
+    if (budget != NULL) {
+      entries[i].budget = *budget;
+    }
+    entries[i].budget.spent = false;
+    entries[i].budget.used = 0;
+  }
+  for (int i = 0; i < count; i++) {
+    if (pthread_create(&threads[i], NULL, portfolioWorker, (void*) &entries[i])) {
+      printf("ERROR: create solver threads failed");
+      exit(EXIT_FAILURE);
+    }
+  }
+  long long solutions = 0;
+  for (int i = 0; i < count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  if (race.winner == SOLVER_NONE) {
+    // only a spent budget keeps every solver from finishing
+    budget->spent = true;
+    long long furthest = -1;
+    for (int i = 0; i < count; i++) {
+      long long reached = mode == SOLVE_ONE ? filledCells(psize, entries[i].grid) : entries[i].solutions;
+      if (reached > furthest) {
+        furthest = reached;
+        race.winner = entries[i].kind;
+      }
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    if (entries[i].kind == race.winner) {
+      solutions = entries[i].solutions;
+      // an unsolved copy is the puzzle as given or the partial grid the
+      // solver's budget left
+      if (mode == SOLVE_ONE) {
+        for (int row = 1; row <= psize; row++) {
+          memcpy(grid[row], entries[i].grid[row], (psize + 1) * sizeof(int));
+        }
+      }
+    }
+    deleteSudokuPuzzle(psize, entries[i].grid);
+  }
+  *winner = race.winner;
+  return solutions;
+}
+
+// solutions after which a solve with these options has its answer
+long long solveLimit(const SolveOptions* options) {
+  if (options->mode == SOLVE_ONE) {
+    return 1;
+  }
+  if (options->mode == SOLVE_UNIQUE) {
+    // a second solution is the least that tells a unique puzzle apart
+    return 2;
+  }
+  return options->limit > 0 ? options->limit : LLONG_MAX;
+}
+
+// runs the chosen solver on grid and returns the number of solutions found
+// SOLVE_ONE stops at the first and writes it into grid, SOLVE_COUNT and
+// SOLVE_UNIQUE only count, without building any solution grid, and
+// SOLVE_ALL writes every solution to out, or only counts them if out is NULL
+// counting and listing stop at the limit of the options, SOLVE_UNIQUE at two
+// a search that spends budget (NULL for none) stops where it is and marks it
+// spent, SOLVE_ONE then leaves the fullest assignment it reached in grid
+// solvedBy is set to the solver that answered, the winner of a portfolio race
+long long solveSudokuPuzzle(const SolveOptions* options, int psize, int** grid, FILE* out,
+                            SearchBudget* budget, SolverKind* solvedBy) {
+  long long limit = solveLimit(options);
+  *solvedBy = options->kind;
+  switch (options->kind) {
+    case SOLVER_BITMASK:
+      return solveBitmask(psize, grid, options->mode, limit, NULL, budget);
+    case SOLVER_DLX:
+      return solveDlx(psize, grid, options->mode, limit, out, NULL, budget);
+    case SOLVER_LOGIC:
+#if defined(__SSE2__)
+      // 9x9 boards fit the register resident solver
+      if (psize == 9 && options->threads <= 1) {
+        return solveSimd9(grid, options->mode, limit, budget);
+      }
+#endif
+      if (options->threads > 1) {
+        return solveLogicParallel(psize, grid, options->threads, budget) ? 1 : 0;
+      }
+      return solveLogic(psize, grid, options->mode, limit, NULL, budget);
+    case SOLVER_SAT:
+      return solveSat(psize, grid, options->mode, limit, NULL, budget);
+    case SOLVER_PORTFOLIO:
+      return solvePortfolio(psize, grid, options->mode, limit, budget, solvedBy);
+    default:
+      return 0;
+  }
+}
+
+// solves an incomplete puzzle that has just been evaluated and adds the
+// solutions and solve time to result, listed solutions go to out
+// the budget of the options starts with the solve
+// with a disk or solution cache a puzzle answered before skips the search,
+// the solution cache also answers puzzles equivalent to one answered before,
+// and a stored solution is mapped onto grid, only listing always searches
+// the disk cache keeps the answers and the verdict for later runs
+void solveEvaluatedPuzzle(const SolveOptions* options, int psize, int** grid, PuzzleResult* result,
+                          FILE* out) {
+  long long start = nowNanos();
+  CanonicalPuzzle given;
+  CanonicalPuzzle canon;
+  bool withSolution = options->mode == SOLVE_ONE;
+  bool listing = options->mode == SOLVE_ALL && out != NULL;
+  bool cached = options->cache != NULL && !listing;
+  unsigned long long lo = 0;
+  unsigned long long hi = 0;
+  bool onDisk = options->diskCache != NULL && !listing && hashPuzzleGrid(psize, grid, &lo, &hi);
+  bool fromDisk = onDisk && lookupDiskSolution(options->diskCache, lo, hi, options, psize, grid, result);
+  if (fromDisk
+      || (cached && lookupCachedSolution(options->cache, psize, grid, withSolution, &given, &canon, result))) {
+    result->outOfBudget = false;
+    result->fixedCells = 0;
+    result->attempted = true;
+    if (onDisk && !fromDisk) {
+      storeDiskResult(options->diskCache, lo, hi, result, options, psize, grid);
+    }
+    result->solveNanos = nowNanos() - start;
+    result->nanos += result->solveNanos;
+    return;
+  }
+  long long searchStart = nowNanos();
+  SearchBudget budget = {options->nodeBudget, 0, false, 0};
+  if (options->timeBudget > 0) {
+    budget.deadline = start + options->timeBudget;
+  }
+  bool budgeted = options->nodeBudget > 0 || options->timeBudget > 0;
+  result->solutions = solveSudokuPuzzle(options, psize, grid, out, budgeted ? &budget : NULL, &result->strategy);
+  result->solved = result->solutions > 0;
+  // an answer reached as the budget ran out still stands
+  result->outOfBudget = budget.spent && result->solutions < solveLimit(options);
+  result->fixedCells = result->outOfBudget && options->mode == SOLVE_ONE ? filledCells(psize, grid) : 0;
+  result->attempted = true;
+  // an answer cut short by the budget would not hold for the next run into it
+  if (cached && !result->outOfBudget) {
+    storeCachedSolution(options->cache, psize, grid, withSolution, &given, &canon, result,
+                        nowNanos() - searchStart);
+  }
+  // a search stopped by the budget leaves only the verdict
+  if (onDisk) {
+    storeDiskResult(options->diskCache, lo, hi, result, options, psize, grid);
+  }
+  result->solveNanos = nowNanos() - start;
+  result->nanos += result->solveNanos;
+}
+
+void addSolveStats(SolveStats* stats, const PuzzleResult* result) {
+  if (result->attempted) {
+    stats->puzzles++;
+    stats->solved += result->solved;
+    stats->unique += result->solutions == 1 && !result->outOfBudget;
+    stats->stopped += result->outOfBudget;
+    stats->nanos += result->solveNanos;
+    if (result->strategy < SOLVER_PORTFOLIO) {
+      stats->wins[result->strategy]++;
+    }
+  }
+}
+
+// reports solver throughput on stderr, apart from the validation output
+void printSolveStats(const SolveStats* stats, const SolveOptions* options) {
+  if (stats->puzzles == 0) {
+    return;
+  }
+  double seconds = stats->nanos / 1e9;
+  double rate = seconds > 0 ? stats->puzzles / seconds : 0;
+  if (options->mode == SOLVE_ONE) {
+    fprintf(stderr, "solve: %lld puzzles, %lld solved in %.3f s, %.0f solves/s\n",
+            stats->puzzles, stats->solved, seconds, rate);
+  }
+  else {
+    fprintf(stderr, "count: %lld puzzles, %lld with solutions, %lld unique in %.3f s, %.0f counts/s\n",
+            stats->puzzles, stats->solved, stats->unique, seconds, rate);
+  }
+  if (options->nodeBudget > 0 || options->timeBudget > 0) {
+    fprintf(stderr, "budget: %lld puzzles stopped before an answer\n", stats->stopped);
+  }
+  if (options->kind == SOLVER_PORTFOLIO) {
+    fprintf(stderr, "portfolio wins:");
+    for (int kind = SOLVER_BITMASK; kind < SOLVER_PORTFOLIO; kind++) {
+      fprintf(stderr, "%s %s %lld", kind == SOLVER_BITMASK ? "" : ",", solverName(kind), stats->wins[kind]);
+    }
+    fprintf(stderr, "\n");
+  }
+}
+
+// where a run writing results in format reports problems, csv and json
+// records on stdout must not get messages mixed in
+FILE* diagnosticOutput(OutputFormat format) {
+  return format == FORMAT_TEXT ? stdout : stderr;
+}
+
+void initResultWriter(ResultWriter* writer, FILE* out, OutputFormat format) {
+  writer->out = out;
+  writer->format = format;
+  writer->solving = false;
+  writer->counting = false;
+  writer->uniqueness = false;
+  writer->racing = false;
+  writer->budgeted = false;
+  writer->len = 0;
+}
+
+// writes out everything buffered so far
+void flushResultWriter(ResultWriter* writer) {
+  fwrite(writer->buf, 1, writer->len, writer->out);
+  fflush(writer->out);
+  writer->len = 0;
+}
+
+// makes sure n more bytes fit in the buffer
+static void reserveResult(ResultWriter* writer, size_t n) {
+  if (writer->len + n > RESULT_BUFFER_SIZE) {
+    fwrite(writer->buf, 1, writer->len, writer->out);
+    writer->len = 0;
+  }
+}
+
+// appends a string known to need no escaping
+static void appendText(ResultWriter* writer, const char* text) {
+  size_t n = strlen(text);
+  reserveResult(writer, n);
+  memcpy(writer->buf + writer->len, text, n);
+  writer->len += n;
+}
+
+// appends a non-negative integer in decimal
+static void appendNumber(ResultWriter* writer, unsigned long long value) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  reserveResult(writer, n);
+  while (n > 0) {
+    writer->buf[writer->len++] = digits[--n];
+  }
+}
+
+// appends a string quoted for the writer's format
+static void appendQuoted(ResultWriter* writer, const char* text) {
+  reserveResult(writer, 1);
+  writer->buf[writer->len++] = '"';
+  for (const char* c = text; *c != '\0'; c++) {
+    reserveResult(writer, 6);
+    if (*c == '"') {
+      writer->buf[writer->len++] = writer->format == FORMAT_CSV ? '"' : '\\';
+      writer->buf[writer->len++] = '"';
+    }
+    else if (writer->format == FORMAT_JSONL && *c == '\\') {
+      writer->buf[writer->len++] = '\\';
+      writer->buf[writer->len++] = '\\';
+    }
+    else if (writer->format == FORMAT_JSONL && (unsigned char) *c < 0x20) {
+      static const char hex[] = "0123456789abcdef";
+      memcpy(writer->buf + writer->len, "\\u00", 4);
+      writer->buf[writer->len + 4] = hex[(unsigned char) *c >> 4];
+      writer->buf[writer->len + 5] = hex[*c & 0xf];
+      writer->len += 6;
+    }
+    else {
+      writer->buf[writer->len++] = *c;
+    }
+  }
+  reserveResult(writer, 1);
+  writer->buf[writer->len++] = '"';
+}
+
+// writes the csv header line, other formats have none
+void writeResultHeader(ResultWriter* writer) {
+  if (writer->format == FORMAT_CSV) {
+    appendText(writer, "id,complete,valid,failing,nanos");
+    appendText(writer, writer->solving ? ",solved" : "");
+    appendText(writer, writer->counting ? ",solutions" : "");
+    appendText(writer, writer->uniqueness ? ",unique" : "");
+    appendText(writer, writer->racing ? ",strategy" : "");
+    appendText(writer, writer->budgeted ? ",stopped,fixed\n" : "\n");
+  }
+}
+
+// sets the optional record fields for the solve options of a run
+void setResultSolving(ResultWriter* writer, const SolveOptions* solve) {
+  writer->solving = solve->kind != SOLVER_NONE;
+  writer->counting = writer->solving && solve->mode != SOLVE_ONE;
+  writer->uniqueness = writer->solving && solve->mode == SOLVE_UNIQUE;
+  writer->racing = solve->kind == SOLVER_PORTFOLIO;
+  writer->budgeted = writer->solving && (solve->nodeBudget > 0 || solve->timeBudget > 0);
+}
+
+// writes one record for a puzzle
+// the id is name when given (a file path), otherwise the puzzle number
+void writeResultRecord(ResultWriter* writer, const char* name, long number, const PuzzleResult* result) {
+  static const char* unitNames[] = {"", "row ", "column ", "box "};
+  bool json = writer->format == FORMAT_JSONL;
+
+  if (writer->format == FORMAT_TEXT) {
+    appendNumber(writer, number);
+    if (!result->loaded) {
+      appendText(writer, ": malformed");
+    }
+    else if (result->complete) {
+      appendText(writer, result->valid ? ": complete true valid true" : ": complete true valid false");
+    }
+    else if (writer->uniqueness && writer->budgeted && result->outOfBudget) {
+      appendText(writer, ": complete false unique unknown");
+    }
+    else if (writer->uniqueness) {
+      appendText(writer, result->solutions == 1 ? ": complete false unique true"
+                                                : ": complete false unique false");
+    }
+    else if (writer->counting) {
+      appendText(writer, ": complete false solutions ");
+      appendNumber(writer, result->solutions);
+    }
+    else if (writer->solving) {
+      appendText(writer, result->solved ? ": complete false solved true" : ": complete false solved false");
+    }
+    else {
+      appendText(writer, ": complete false");
+    }
+    if (writer->racing && result->attempted) {
+      appendText(writer, " by ");
+      appendText(writer, solverName(result->strategy));
+    }
+    if (writer->budgeted && result->outOfBudget) {
+      appendText(writer, " stopped by budget");
+      if (!writer->counting) {
+        appendText(writer, " with ");
+        appendNumber(writer, result->fixedCells);
+        appendText(writer, " cells fixed");
+      }
+    }
+    appendText(writer, "\n");
+    return;
+  }
+
+  appendText(writer, json ? "{\"id\":" : "");
+  if (name != NULL) {
+    appendQuoted(writer, name);
+  }
+  else {
+    appendNumber(writer, number);
+  }
+  if (!result->loaded) {
+    // files that cannot be read and stream records that cannot be parsed
+    const char* error = name != NULL ? "unreadable" : "malformed";
+    appendText(writer, json ? ",\"error\":\"" : ",,,");
+    appendText(writer, error);
+    if (json) {
+      appendText(writer, "\"}\n");
+      return;
+    }
+    // the nanos field stays empty, as do the solver fields
+    appendText(writer, ",");
+    appendText(writer, writer->solving ? "," : "");
+    appendText(writer, writer->counting ? "," : "");
+    appendText(writer, writer->uniqueness ? "," : "");
+    appendText(writer, writer->racing ? "," : "");
+    appendText(writer, writer->budgeted ? ",,\n" : "\n");
+    return;
+  }
+  appendText(writer, json ? ",\"complete\":" : ",");
+  appendText(writer, result->complete ? "true" : "false");
+  appendText(writer, json ? ",\"valid\":" : ",");
+  if (result->complete) {
+    appendText(writer, result->valid ? "true" : "false");
+  }
+  else if (json) {
+    appendText(writer, "null");
+  }
+  appendText(writer, json ? ",\"failing\":" : ",");
+  if (result->failingUnit != UNIT_NONE) {
+    appendText(writer, json ? "\"" : "");
+    appendText(writer, unitNames[result->failingUnit]);
+    appendNumber(writer, result->failingIndex);
+    appendText(writer, json ? "\"" : "");
+  }
+  else if (json) {
+    appendText(writer, "null");
+  }
+  appendText(writer, json ? ",\"nanos\":" : ",");
+  appendNumber(writer, result->nanos);
+  if (writer->solving) {
+    appendText(writer, json ? ",\"solved\":" : ",");
+    appendText(writer, result->solved ? "true" : "false");
+  }
+  if (writer->counting) {
+    // a complete grid is its own only solution when valid and has none otherwise
+    appendText(writer, json ? ",\"solutions\":" : ",");
+    if (result->complete) {
+      appendNumber(writer, result->valid ? 1 : 0);
+    }
+    else if (result->attempted) {
+      appendNumber(writer, result->solutions);
+    }
+    else if (json) {
+      appendText(writer, "null");
+    }
+  }
+  if (writer->uniqueness) {
+    // a search stopped by its budget before a second solution cannot tell
+    appendText(writer, json ? ",\"unique\":" : ",");
+    if (result->complete) {
+      appendText(writer, result->valid ? "true" : "false");
+    }
+    else if (result->attempted && (!writer->budgeted || !result->outOfBudget)) {
+      appendText(writer, result->solutions == 1 ? "true" : "false");
+    }
+    else if (json) {
+      appendText(writer, "null");
+    }
+  }
+  if (writer->racing) {
+    appendText(writer, json ? ",\"strategy\":" : ",");
+    if (result->attempted) {
+      appendText(writer, json ? "\"" : "");
+      appendText(writer, solverName(result->strategy));
+      appendText(writer, json ? "\"" : "");
+    }
+    else if (json) {
+      appendText(writer, "null");
+    }
+  }
+  if (writer->budgeted) {
+    appendText(writer, json ? ",\"stopped\":" : ",");
+    if (result->attempted) {
+      appendText(writer, result->outOfBudget ? "true" : "false");
+    }
+    else if (json) {
+      appendText(writer, "null");
+    }
+    appendText(writer, json ? ",\"fixed\":" : ",");
+    if (result->outOfBudget && !writer->counting) {
+      appendNumber(writer, result->fixedCells);
+    }
+    else if (json) {
+      appendText(writer, "null");
+    }
+  }
+  appendText(writer, json ? "}\n" : "\n");
+}
+
+// validates an already parsed puzzle and records its verdict in result
+// an incomplete puzzle is completed in place when a solver is given
+// for the text format the result is also formatted into a memory buffer
+// a negative sudokuSize means the file could not be read
+// takes ownership of grid
+void validateGrid(const char* path, bool showName, int sudokuSize, int** grid, OutputFormat format,
+                  const SolveOptions* solve, PuzzleResult* result, char** output, size_t* outputSize) {
+  result->solved = false;
+  result->solutions = 0;
+  result->attempted = false;
+  result->solveNanos = 0;
+  result->strategy = SOLVER_NONE;
+  result->outOfBudget = false;
+  result->fixedCells = 0;
+  if (format != FORMAT_TEXT) {
+    result->loaded = false;
+    if (sudokuSize >= 0) {
+      evaluatePuzzle(sudokuSize, grid, result, format);
+      if (!result->complete && solve->kind != SOLVER_NONE) {
+        // listed solutions have no place in a record, only their number
+        solveEvaluatedPuzzle(solve, sudokuSize, grid, result, NULL);
+      }
+      deleteSudokuPuzzle(sudokuSize, grid);
+    }
+    return;
+  }
+  FILE* out = open_memstream(output, outputSize);
+  if (out == NULL) {
+    printf("ERROR: out of memory for result buffer\n");
+    exit(EXIT_FAILURE);
+  }
+  if (showName) {
+    fprintf(out, "%s\n", path);
+  }
+  if (sudokuSize < 0) {
+    fprintf(out, "Could not open file %s\n", path);
+    if (showName) {
+      fprintf(out, "\n");
+    }
+    fclose(out);
+    result->loaded = false;
+    return;
+  }
+  evaluatePuzzle(sudokuSize, grid, result, format);
+  fprintf(out, "Complete puzzle? ");
+  fprintf(out, result->complete ? "true\n" : "false\n");
+  if (result->complete) {
+    fprintf(out, "Valid puzzle? ");
+    fprintf(out, result->valid ? "true\n" : "false\n");
+  }
+  else if (solve->kind != SOLVER_NONE) {
+    // listed solutions go to their own buffer so the count can come first
+    char* listed = NULL;
+    size_t listedSize = 0;
+    FILE* list = solve->mode == SOLVE_ALL ? open_memstream(&listed, &listedSize) : NULL;
+    solveEvaluatedPuzzle(solve, sudokuSize, grid, result, list);
+    if (solve->mode == SOLVE_ONE) {
+      fprintf(out, "Solved puzzle? ");
+      fprintf(out, result->solved ? "true\n" : "false\n");
+    }
+    else if (solve->mode == SOLVE_UNIQUE) {
+      fprintf(out, "Unique puzzle? ");
+      fprintf(out, result->outOfBudget ? "unknown\n" : result->solutions == 1 ? "true\n" : "false\n");
+    }
+    else if (solve->limit > 0 && result->solutions >= solve->limit) {
+      fprintf(out, "Solutions: %lld or more\n", result->solutions);
+    }
+    else {
+      fprintf(out, "Solutions: %lld\n", result->solutions);
+    }
+    if (solve->kind == SOLVER_PORTFOLIO) {
+      fprintf(out, "Answered first by: %s\n", solverName(result->strategy));
+    }
+    if (solve->nodeBudget > 0 || solve->timeBudget > 0) {
+      fprintf(out, "Stopped by budget? ");
+      fprintf(out, result->outOfBudget ? "true\n" : "false\n");
+      if (result->outOfBudget && solve->mode == SOLVE_ONE) {
+        fprintf(out, "Cells fixed: %d of %d\n", result->fixedCells, sudokuSize * sudokuSize);
+      }
+    }
+    if (list != NULL) {
+      // the listed solutions take the place of the grid
+      fclose(list);
+      fwrite(listed, 1, listedSize, out);
+      free(listed);
+      deleteSudokuPuzzle(sudokuSize, grid);
+      fclose(out);
+      return;
+    }
+  }
+  writeSudokuPuzzle(out, sudokuSize, grid);
+  deleteSudokuPuzzle(sudokuSize, grid);
+  fclose(out);
+}
+
+// validates one file and records its verdict, see validateGrid
+void validateFile(const char* path, bool showName, OutputFormat format, const SolveOptions* solve,
+                  PuzzleResult* result, char** output, size_t* outputSize) {
+  int **grid = NULL;
+  int sudokuSize = loadSudokuPuzzle(path, &grid);
+  validateGrid(path, showName, sudokuSize, grid, format, solve, result, output, outputSize);
+}
+
+// sets up an io_uring with room for 'entries' submissions and registers
+// URING_BATCH fixed read buffers with it
+// returns false if io_uring or one of the needed operations is unavailable
+bool uringInit(Uring* ring, unsigned entries) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (ring->fd < 0) {
+    return false;
+  }
+
+  // make sure the kernel knows openat, read fixed and close
+  size_t probeSize = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe* probe = calloc(1, probeSize);
+  bool supported = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0
+                   && probe->last_op >= IORING_OP_CLOSE
+                   && (probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED)
+                   && (probe->ops[IORING_OP_READ_FIXED].flags & IO_URING_OP_SUPPORTED)
+                   && (probe->ops[IORING_OP_CLOSE].flags & IO_URING_OP_SUPPORTED);
+  free(probe);
+  if (!supported) {
+    close(ring->fd);
+    return false;
+  }
+
+  // map the submission ring, completion ring and submission entries
+  ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (ring->cqRingSize > ring->sqRingSize) {
+      ring->sqRingSize = ring->cqRingSize;
+    }
+    ring->cqRingSize = ring->sqRingSize;
+  }
+  ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQ_RING);
+  if (ring->sqRing == MAP_FAILED) {
+    close(ring->fd);
+    return false;
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->cqRing = ring->sqRing;
+  }
+  else {
+    ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cqRing == MAP_FAILED) {
+      munmap(ring->sqRing, ring->sqRingSize);
+      close(ring->fd);
+      return false;
+    }
+  }
+  ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    if (ring->cqRing != ring->sqRing) {
+      munmap(ring->cqRing, ring->cqRingSize);
+    }
+    munmap(ring->sqRing, ring->sqRingSize);
+    close(ring->fd);
+    return false;
+  }
+
+  char* sq = (char*) ring->sqRing;
+  ring->sqHead = (unsigned*) (sq + params.sq_off.head);
+  ring->sqTail = (unsigned*) (sq + params.sq_off.tail);
+  ring->sqMask = (unsigned*) (sq + params.sq_off.ring_mask);
+  ring->sqArray = (unsigned*) (sq + params.sq_off.array);
+  char* cq = (char*) ring->cqRing;
+  ring->cqHead = (unsigned*) (cq + params.cq_off.head);
+  ring->cqTail = (unsigned*) (cq + params.cq_off.tail);
+  ring->cqMask = (unsigned*) (cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+
+  // register the fixed buffer pool so reads skip the per-call page pinning
+  ring->buffers = aligned_alloc(4096, (size_t) URING_BATCH * URING_BUFFER_SIZE);
+  struct iovec iovs[URING_BATCH];
+  for (int i = 0; i < URING_BATCH; i++) {
+    iovs[i].iov_base = ring->buffers + (size_t) i * URING_BUFFER_SIZE;
+    iovs[i].iov_len = URING_BUFFER_SIZE;
+  }
+  if (ring->buffers == NULL
+      || syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, iovs, URING_BATCH) != 0) {
+    free(ring->buffers);
+    munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqRing != ring->sqRing) {
+      munmap(ring->cqRing, ring->cqRingSize);
+    }
+    munmap(ring->sqRing, ring->sqRingSize);
+    close(ring->fd);
+    return false;
+  }
+  return true;
+}
+
+// releases the ring, its mappings and the buffer pool
+void uringFree(Uring* ring) {
+  close(ring->fd);
+  munmap(ring->sqes, ring->sqesSize);
+  if (ring->cqRing != ring->sqRing) {
+    munmap(ring->cqRing, ring->cqRingSize);
+  }
+  munmap(ring->sqRing, ring->sqRingSize);
+  free(ring->buffers);
+}
+
+// returns a cleared submission entry at the tail of the submission ring
+// the caller must make sure no more than the ring size is queued at once
+struct io_uring_sqe* uringGetSqe(Uring* ring) {
+  unsigned tail = *ring->sqTail;
+  unsigned index = tail & *ring->sqMask;
+  struct io_uring_sqe* sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  ring->sqArray[index] = index;
+  __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+  return sqe;
+}
+
+// submits 'count' queued entries, waits for all of them to complete and
+// stores each result in results[user_data]
+void uringSubmitAndWait(Uring* ring, unsigned count, int* results) {
+  unsigned done = 0;
+  while (done < count) {
+    unsigned toSubmit = done == 0 ? count : 0;
+    int ret = syscall(__NR_io_uring_enter, ring->fd, toSubmit, count - done,
+                      IORING_ENTER_GETEVENTS, NULL, 0);
+    if (ret < 0 && errno != EINTR) {
+      printf("ERROR: io_uring_enter failed\n");
+      exit(EXIT_FAILURE);
+    }
+    unsigned head = *ring->cqHead;
+    unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cqMask];
+      results[cqe->user_data] = cqe->res;
+      head++;
+      done++;
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+  }
+}
+
+// hands the parsed files [first, first + count) to the validator workers
+void publishIngested(FilePool* pool, int first, int count) {
+  pthread_mutex_lock(&pool->lock);
+  pool->ingested = first + count;
+  pthread_cond_broadcast(&pool->ingestReady);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+// waits until files up to 'end' fit in the writer's window
+void waitForWindow(FilePool* pool, int end) {
+  pthread_mutex_lock(&pool->lock);
+  while (end > pool->written + pool->window) {
+    pthread_cond_wait(&pool->windowOpen, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+// ingestion thread for the io_uring backend
+// opens, reads and closes URING_BATCH files per round with one io_uring_enter
+// per step, parses them from the fixed buffers and publishes the grids
+void* uringIngest(void* arg) {
+  FilePool* pool = (FilePool*) arg;
+  Uring* ring = pool->ring;
+  int count = pool->paths->count;
+  int batch = URING_BATCH < pool->window ? URING_BATCH : pool->window;
+  int fds[URING_BATCH];
+  int lengths[URING_BATCH];
+  int closed[URING_BATCH];
+
+  for (int first = 0; first < count; first += batch) {
+    int n = count - first < batch ? count - first : batch;
+    waitForWindow(pool, first + n);
+
+    // open every file of the batch
+    for (int i = 0; i < n; i++) {
+      struct io_uring_sqe* sqe = uringGetSqe(ring);
+      sqe->opcode = IORING_OP_OPENAT;
+      sqe->fd = AT_FDCWD;
+      sqe->addr = (unsigned long) pool->paths->items[first + i];
+      sqe->open_flags = O_RDONLY;
+      sqe->user_data = i;
+    }
+    uringSubmitAndWait(ring, n, fds);
+
+    // read each opened file into its fixed buffer
+    unsigned reads = 0;
+    for (int i = 0; i < n; i++) {
+      lengths[i] = -1;
+      if (fds[i] >= 0) {
+        struct io_uring_sqe* sqe = uringGetSqe(ring);
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->fd = fds[i];
+        sqe->addr = (unsigned long) (ring->buffers + (size_t) i * URING_BUFFER_SIZE);
+        sqe->len = URING_BUFFER_SIZE;
+        sqe->off = 0;
+        sqe->buf_index = i;
+        sqe->user_data = i;
+        reads++;
+      }
+    }
+    uringSubmitAndWait(ring, reads, lengths);
+
+    // close them again
+    unsigned closes = 0;
+    for (int i = 0; i < n; i++) {
+      if (fds[i] >= 0) {
+        struct io_uring_sqe* sqe = uringGetSqe(ring);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fds[i];
+        sqe->user_data = i;
+        closes++;
+      }
+    }
+    uringSubmitAndWait(ring, closes, closed);
+
+    // parse, files that filled the whole buffer may be longer and are re-read
+    for (int i = 0; i < n; i++) {
+      int index = first + i;
+      pool->grids[index] = NULL;
+      if (fds[i] < 0 || lengths[i] < 0) {
+        pool->sizes[index] = -1;
+      }
+      else if (lengths[i] == URING_BUFFER_SIZE) {
+        pool->sizes[index] = loadSudokuPuzzle(pool->paths->items[index], &pool->grids[index]);
+      }
+      else {
+        pool->sizes[index] = parseSudokuPuzzle(ring->buffers + (size_t) i * URING_BUFFER_SIZE,
+                                               lengths[i], &pool->grids[index]);
+      }
+    }
+    publishIngested(pool, first, n);
+  }
+  return NULL;
+}
+
+// pool worker, repeatedly claims the next file and validates it
+// workers never run more than 'window' files ahead of the writer so that
+// memory stays bounded no matter how many files are given
+void* poolWorker(void* arg) {
+  FilePool* pool = (FilePool*) arg;
+  bool showName = pool->paths->count > 1;
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->next < pool->paths->count && pool->next >= pool->written + pool->window) {
+      pthread_cond_wait(&pool->windowOpen, &pool->lock);
+    }
+    // with an ingestion thread, wait until the file has been read and parsed
+    while (pool->ingest && pool->next < pool->paths->count && pool->next >= pool->ingested) {
+      pthread_cond_wait(&pool->ingestReady, &pool->lock);
+    }
+    if (pool->next >= pool->paths->count) {
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+    int index = pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+
+    char* output = NULL;
+    size_t outputSize = 0;
+    PuzzleResult result;
+    if (pool->ingest) {
+      validateGrid(pool->paths->items[index], showName, pool->sizes[index],
+                   pool->grids[index], pool->format, pool->solve, &result, &output, &outputSize);
+    }
+    else {
+      validateFile(pool->paths->items[index], showName, pool->format, pool->solve, &result,
+                   &output, &outputSize);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->outputs[index] = output;
+    pool->outputSizes[index] = outputSize;
+    pool->results[index] = result;
+    pool->results[index].done = true;
+    pthread_cond_broadcast(&pool->resultReady);
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+// validates all files on a pool of numThreads workers
+// with useUring, one thread reads and parses the files through io_uring and
+// the workers only validate, if io_uring is unavailable the workers read the
+// files themselves
+// results are written to stdout in input order as soon as they are ready
+// returns the number of files that could not be read
+int validateFiles(PathList* paths, int numThreads, bool useUring, OutputFormat format,
+                  const SolveOptions* solve) {
+  FilePool pool;
+  pool.paths = paths;
+  pool.format = format;
+  pool.solve = solve;
+  pool.results = calloc(paths->count, sizeof(PuzzleResult));
+  pool.outputs = calloc(paths->count, sizeof(char*));
+  pool.outputSizes = calloc(paths->count, sizeof(size_t));
+  pool.next = 0;
+  pool.written = 0;
+  pool.window = numThreads * RESULT_WINDOW_PER_THREAD;
+  pool.ingest = false;
+  pool.grids = NULL;
+  pool.sizes = NULL;
+  pool.ingested = 0;
+  pool.ring = NULL;
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.resultReady, NULL);
+  pthread_cond_init(&pool.windowOpen, NULL);
+  pthread_cond_init(&pool.ingestReady, NULL);
+
+  Uring ring;
+  pthread_t ingestThread;
+  if (useUring && uringInit(&ring, 2 * URING_BATCH)) {
+    pool.ingest = true;
+    pool.grids = calloc(paths->count, sizeof(int**));
+    pool.sizes = calloc(paths->count, sizeof(int));
+    if (pool.grids == NULL || pool.sizes == NULL) {
+      printf("ERROR: out of memory for ingested puzzles\n");
+      exit(EXIT_FAILURE);
+    }
+    pool.ring = &ring;
+    if (pthread_create(&ingestThread, NULL, uringIngest, (void*) &pool)) {
+      printf("ERROR: create ingestion thread failed");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (pool.outputs == NULL || pool.outputSizes == NULL || pool.results == NULL) {
+    printf("ERROR: out of memory for file pool\n");
+    exit(EXIT_FAILURE);
+  }
+
+  pthread_t* workers = malloc(sizeof(pthread_t) * numThreads);
+  if (workers == NULL) {
+    printf("ERROR: out of memory for pool threads\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < numThreads; i++) {
+    if (pthread_create(&workers[i], NULL, poolWorker, (void*) &pool)) {
+      printf("ERROR: create pool threads failed");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // ordered writer, waits for each result in turn
+  ResultWriter* writer = malloc(sizeof(ResultWriter));
+  initResultWriter(writer, stdout, format);
+  setResultSolving(writer, solve);
+  writeResultHeader(writer);
+  int failures = 0;
+  SolveStats stats = {0, 0, 0, 0, 0, {0}};
+  for (int i = 0; i < paths->count; i++) {
+    pthread_mutex_lock(&pool.lock);
+    while (!pool.results[i].done) {
+      pthread_cond_wait(&pool.resultReady, &pool.lock);
+    }
+    char* output = pool.outputs[i];
+    size_t outputSize = pool.outputSizes[i];
+    PuzzleResult result = pool.results[i];
+    pool.outputs[i] = NULL;
+    pool.written = i + 1;
+    pthread_cond_broadcast(&pool.windowOpen);
+    pthread_mutex_unlock(&pool.lock);
+
+    if (!result.loaded) {
+      failures++;
+    }
+    addSolveStats(&stats, &result);
+    if (format == FORMAT_TEXT) {
+      fwrite(output, 1, outputSize, stdout);
+      free(output);
+    }
+    else {
+      writeResultRecord(writer, paths->items[i], i + 1, &result);
+    }
+  }
+  flushResultWriter(writer);
+  free(writer);
+
+  for (int i = 0; i < numThreads; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  if (pool.ingest) {
+    pthread_join(ingestThread, NULL);
+    uringFree(&ring);
+  }
+
+  free(workers);
+  free(pool.results);
+  free(pool.outputs);
+  free(pool.outputSizes);
+  free(pool.grids);
+  free(pool.sizes);
+  pthread_mutex_destroy(&pool.lock);
+  pthread_cond_destroy(&pool.resultReady);
+  pthread_cond_destroy(&pool.windowOpen);
+  pthread_cond_destroy(&pool.ingestReady);
+  printSolveStats(&stats, solve);
+  return failures;
+}
+
+// validates each puzzle of the stream as soon as it has been read
+// and writes one result record per puzzle, incomplete puzzles are
+// completed when a solver is given
+// parsing and validation share this one thread behind the decompression
+// thread: a record parses in about a microsecond, while checkPuzzle starts
+// 3N row, column and box threads for it and takes hundreds, so a separate
+// parser thread would not shorten the run, -b spreads both over threads
+// returns the number of malformed records
+long validateStream(PuzzleStream* stream, OutputFormat format, const SolveOptions* solve) {
+  int cells[MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+  ResultWriter* writer = malloc(sizeof(ResultWriter));
+  initResultWriter(writer, stdout, format);
+  setResultSolving(writer, solve);
+  writeResultHeader(writer);
+  long id = 0;
+  long failures = 0;
+  int psize;
+  SolveStats stats = {0, 0, 0, 0, 0, {0}};
+  stream->flushBeforeRead = writer;
+  while ((psize = nextPuzzle(stream, cells)) != 0) {
+    id++;
+    if (psize == -2) {
+      flushResultWriter(writer);
+      fprintf(stderr, "ERROR: reading input failed\n");
+      failures++;
+      break;
+    }
+    PuzzleResult result;
+    result.loaded = false;
+    result.solved = false;
+    result.solutions = 0;
+    result.attempted = false;
+    result.strategy = SOLVER_NONE;
+    result.outOfBudget = false;
+    if (psize < 0) {
+      failures++;
+    }
+    else {
+      int** grid = gridFromCells(psize, cells);
+      evaluatePuzzle(psize, grid, &result, format);
+      if (!result.complete && writer->solving) {
+        // listed solutions are not kept in stream mode, only counted
+        solveEvaluatedPuzzle(solve, psize, grid, &result, NULL);
+        addSolveStats(&stats, &result);
+      }
+      deleteSudokuPuzzle(psize, grid);
+    }
+    writeResultRecord(writer, NULL, id, &result);
+  }
+  stream->flushBeforeRead = NULL;
+  flushResultWriter(writer);
+  free(writer);
+  printSolveStats(&stats, solve);
+  return failures;
+}
+
+void initByteRing(ByteRing* ring, size_t capacity) {
+  ring->data = malloc(capacity);
+  if (ring->data == NULL) {
+    printf("ERROR: out of memory for ring buffer\n");
+    exit(EXIT_FAILURE);
+  }
+  ring->capacity = capacity;
+  ring->written = 0;
+  ring->read = 0;
+  ring->closed = false;
+  ring->failed = false;
+  pthread_mutex_init(&ring->lock, NULL);
+  pthread_cond_init(&ring->notEmpty, NULL);
+  pthread_cond_init(&ring->notFull, NULL);
+}
+
+void freeByteRing(ByteRing* ring) {
+  free(ring->data);
+  pthread_mutex_destroy(&ring->lock);
+  pthread_cond_destroy(&ring->notEmpty);
+  pthread_cond_destroy(&ring->notFull);
+}
+
+// puzzle stream read function taking bytes out of a ring
+// blocks until bytes are available or the producer closed the ring
+ssize_t readByteRing(void* source, char* dst, size_t len) {
+  ByteRing* ring = (ByteRing*) source;
+  pthread_mutex_lock(&ring->lock);
+  while (ring->written == ring->read && !ring->closed) {
+    pthread_cond_wait(&ring->notEmpty, &ring->lock);
+  }
+  size_t available = ring->written - ring->read;
+  if (available == 0) {
+    pthread_mutex_unlock(&ring->lock);
+    return ring->failed ? -1 : 0;
+  }
+  size_t offset = ring->read % ring->capacity;
+  pthread_mutex_unlock(&ring->lock);
+
+  // only the part up to the end of the storage is copied, the rest comes next call
+  size_t count = available < len ? available : len;
+  if (count > ring->capacity - offset) {
+    count = ring->capacity - offset;
+  }
+  memcpy(dst, ring->data + offset, count);
+
+  pthread_mutex_lock(&ring->lock);
+  ring->read += count;
+  pthread_cond_signal(&ring->notFull);
+  pthread_mutex_unlock(&ring->lock);
+  return count;
+}
+
+// decompression thread, inflates straight into the free part of the ring
+// so that decompression overlaps with parsing and validation
+void* inflateWorker(void* arg) {
+  InflateJob* job = (InflateJob*) arg;
+  ByteRing* ring = job->ring;
+  bool failed = false;
+  for (;;) {
+    pthread_mutex_lock(&ring->lock);
+    while (ring->written - ring->read == ring->capacity) {
+      pthread_cond_wait(&ring->notFull, &ring->lock);
+    }
+    size_t offset = ring->written % ring->capacity;
+    size_t space = ring->capacity - (ring->written - ring->read);
+    pthread_mutex_unlock(&ring->lock);
+
+    // the consumer never touches the free region, so inflate without the lock
+    if (space > ring->capacity - offset) {
+      space = ring->capacity - offset;
+    }
+    if (space > INFLATE_CHUNK_SIZE) {
+      space = INFLATE_CHUNK_SIZE;
+    }
+    int got = gzread(job->input, ring->data + offset, space);
+    if (got <= 0) {
+      failed = got < 0;
+      break;
+    }
+
+    pthread_mutex_lock(&ring->lock);
+    ring->written += got;
+    pthread_cond_signal(&ring->notEmpty);
+    pthread_mutex_unlock(&ring->lock);
+  }
+
+  pthread_mutex_lock(&ring->lock);
+  ring->closed = true;
+  ring->failed = failed;
+  pthread_cond_signal(&ring->notEmpty);
+  pthread_mutex_unlock(&ring->lock);
+  return NULL;
+}
+
+// whether path names a gzip file by its extension
+bool isGzipPath(const char* path) {
+  size_t len = strlen(path);
+  return len > 3 && strcmp(path + len - 3, ".gz") == 0;
+}
+
+// opens path as a puzzle source, - is stdin
+// gzip input (a .gz path, or any path when gzipInput is set) is inflated by
+// a decompression thread into a ring buffer that the stream reads from,
+// so decompression overlaps with parsing and validation
+// returns false if path cannot be opened
+bool openPuzzleSource(PuzzleSource* source, const char* path, bool gzipInput) {
+  bool isStdin = strcmp(path, "-") == 0;
+  source->compressed = gzipInput || isGzipPath(path);
+  source->ownsFd = !isStdin;
+  source->fd = isStdin ? STDIN_FILENO : open(path, O_RDONLY);
+  if (source->fd < 0) {
+    return false;
+  }
+  if (!source->compressed) {
+    initPuzzleStream(&source->stream, readFd, &source->fd);
+    return true;
+  }
+
+  // zlib takes over the descriptor and closes it in gzclose
+  source->gz = gzdopen(isStdin ? dup(source->fd) : source->fd, "rb");
+  source->ownsFd = false;
+  if (source->gz == NULL) {
+    return false;
+  }
+  gzbuffer(source->gz, INFLATE_CHUNK_SIZE);
+  initByteRing(&source->ring, RING_BUFFER_SIZE);
+  source->job.input = source->gz;
+  source->job.ring = &source->ring;
+  if (pthread_create(&source->inflateThread, NULL, inflateWorker, (void*) &source->job)) {
+    printf("ERROR: create decompression thread failed");
+    exit(EXIT_FAILURE);
+  }
+  initPuzzleStream(&source->stream, readByteRing, &source->ring);
+  return true;
+}
+
+// stops the decompression thread if there is one and releases the source
+void closePuzzleSource(PuzzleSource* source) {
+  freePuzzleStream(&source->stream);
+  if (source->compressed) {
+    // drain the ring in case the stream stopped early, so the producer can finish
+    ByteRing* ring = &source->ring;
+    pthread_mutex_lock(&ring->lock);
+    while (!ring->closed) {
+      ring->read = ring->written;
+      pthread_cond_signal(&ring->notFull);
+      pthread_cond_wait(&ring->notEmpty, &ring->lock);
+    }
+    pthread_mutex_unlock(&ring->lock);
+
+    pthread_join(source->inflateThread, NULL);
+    gzclose(source->gz);
+    freeByteRing(ring);
+  }
+  if (source->ownsFd) {
+    close(source->fd);
+  }
+}
+
+// moves a freshly opened source past its first offset bytes, seeking when it
+// can and reading and dropping the bytes otherwise, returns false on a short input
+bool skipPuzzleSource(PuzzleSource* source, long long offset) {
+  PuzzleStream* stream = &source->stream;
+  if (!source->compressed && lseek(source->fd, offset, SEEK_SET) == offset) {
+    stream->position = offset;
+    return true;
+  }
+  while (stream->position < offset) {
+    size_t want = stream->capacity;
+    if ((long long) want > offset - stream->position) {
+      want = offset - stream->position;
+    }
+    ssize_t got = stream->read(stream->source, stream->buf, want);
+    if (got <= 0) {
+      return false;
+    }
+    stream->position += got;
+  }
+  return true;
+}
+
+// serial validation kernel over row-major cells, one pass with a bitmask per unit
+// cells hold 0 for empty, 1..psize, or BATCH_BAD_CELL
+// fills the verdict and the first failing unit like findFailingUnit would
+void checkCellsSerial(int psize, const unsigned char* cells, PuzzleResult* result) {
+  unsigned long long rowSeen[MAX_PUZZLE_SIZE];
+  unsigned long long colSeen[MAX_PUZZLE_SIZE];
+  unsigned long long boxSeen[MAX_PUZZLE_SIZE];
+  // bit u is set when unit u has a repeated or out of range value
+  unsigned long long rowBad = 0;
+  unsigned long long colBad = 0;
+  unsigned long long boxBad = 0;
+  int boxSize = sqrt(psize);
+  bool complete = true;
+
+  memset(rowSeen, 0, psize * sizeof(unsigned long long));
+  memset(colSeen, 0, psize * sizeof(unsigned long long));
+  memset(boxSeen, 0, psize * sizeof(unsigned long long));
+  for (int row = 0; row < psize; row++) {
+    int boxRow = (row / boxSize) * boxSize;
+    for (int col = 0; col < psize; col++) {
+      int value = cells[row * psize + col];
+      int box = boxRow + col / boxSize;
+      if (value == 0) {
+        complete = false;
+        continue;
+      }
+      if (value > psize) {
+        rowBad |= 1ULL << row;
+        colBad |= 1ULL << col;
+        boxBad |= 1ULL << box;
+        continue;
+      }
+      unsigned long long bit = 1ULL << (value - 1);
+      if (rowSeen[row] & bit) {
+        rowBad |= 1ULL << row;
+      }
+      if (colSeen[col] & bit) {
+        colBad |= 1ULL << col;
+      }
+      if (boxSeen[box] & bit) {
+        boxBad |= 1ULL << box;
+      }
+      rowSeen[row] |= bit;
+      colSeen[col] |= bit;
+      boxSeen[box] |= bit;
+    }
+  }
+
+  // with no empty cell and no repeats every unit holds each value exactly once
+  result->loaded = true;
+  result->complete = complete;
+  result->valid = complete && (rowBad | colBad | boxBad) == 0;
+  result->failingUnit = UNIT_NONE;
+  result->failingIndex = 0;
+  if (complete && !result->valid) {
+    if (rowBad != 0) {
+      result->failingUnit = UNIT_ROW;
+      result->failingIndex = __builtin_ctzll(rowBad) + 1;
+    }
+    else if (colBad != 0) {
+      result->failingUnit = UNIT_COLUMN;
+      result->failingIndex = __builtin_ctzll(colBad) + 1;
+    }
+    else {
+      result->failingUnit = UNIT_BOX;
+      result->failingIndex = __builtin_ctzll(boxBad) + 1;
+    }
+  }
+}
+
+// reports solution and result cache use on stderr
+void printCacheStats(ResultCache* cache, DiskCache* diskCache) {
+  if (cache != NULL) {
+    fprintf(stderr, "cache: %ld hits, %ld misses, %ld answers stored, %ld canonical searches\n",
+            cache->hits, cache->misses, cache->entries, cache->canons);
+  }
+  if (diskCache != NULL) {
+    fprintf(stderr, "disk cache: %ld hits, %ld misses, %ld results added, %llu grids in %llu index slots%s\n",
+            diskCache->hits, diskCache->misses, diskCache->stored,
+            diskCache->index->used, diskCache->index->capacity,
+            diskCache->writable ? "" : " (read only)");
+  }
+}
+
+void initPuzzleBatch(PuzzleBatch* batch) {
+  memset(batch, 0, sizeof(*batch));
+}
+
+void freePuzzleBatch(PuzzleBatch* batch) {
+  free(batch->sizes);
+  free(batch->offsets);
+  free(batch->cells);
+  free(batch->results);
+  initPuzzleBatch(batch);
+}
+
+// empties the batch but keeps its storage for the next round
+void clearPuzzleBatch(PuzzleBatch* batch) {
+  batch->count = 0;
+  batch->cellCount = 0;
+}
+
+// appends a puzzle to the batch, psize -1 records a malformed record
+// makes room for at least count puzzles with cellCount cells in total
+void reservePuzzleBatch(PuzzleBatch* batch, int count, size_t cellCount) {
+  if (count > batch->capacity) {
+    while (count > batch->capacity) {
+      batch->capacity = batch->capacity == 0 ? 1024 : batch->capacity * 2;
+    }
+    batch->sizes = realloc(batch->sizes, batch->capacity * sizeof(int));
+    batch->offsets = realloc(batch->offsets, batch->capacity * sizeof(size_t));
+    batch->results = realloc(batch->results, batch->capacity * sizeof(PuzzleResult));
+    if (batch->sizes == NULL || batch->offsets == NULL || batch->results == NULL) {
+      printf("ERROR: out of memory for puzzle batch\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (cellCount > batch->cellCapacity) {
+    while (cellCount > batch->cellCapacity) {
+      batch->cellCapacity = batch->cellCapacity == 0 ? 81 * 1024 : batch->cellCapacity * 2;
+    }
+    batch->cells = realloc(batch->cells, batch->cellCapacity);
+    if (batch->cells == NULL) {
+      printf("ERROR: out of memory for puzzle batch\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+// stores a puzzle in slot index of a reserved batch, its cells from cell offset on
+void putInBatch(PuzzleBatch* batch, int index, size_t offset, int psize, const int* cells) {
+  size_t n = psize > 0 ? (size_t) psize * psize : 0;
+  batch->sizes[index] = psize;
+  batch->offsets[index] = offset;
+  for (size_t i = 0; i < n; i++) {
+    int value = cells[i];
+    batch->cells[offset + i] = value >= 0 && value <= psize ? value : BATCH_BAD_CELL;
+  }
+}
+
+void addToBatch(PuzzleBatch* batch, int psize, const int* cells) {
+  size_t n = psize > 0 ? (size_t) psize * psize : 0;
+  reservePuzzleBatch(batch, batch->count + 1, batch->cellCount + n);
+  putInBatch(batch, batch->count, batch->cellCount, psize, cells);
+  batch->cellCount += n;
+  batch->count++;
+}
+
+// index of the i-th cell of unit u of a 9x9 puzzle, rows then columns then boxes
+static inline int unitCell9(int u, int i) {
+  if (u < 9) {
+    return u * 9 + i;
+  }
+  if (u < 18) {
+    return i * 9 + (u - 9);
+  }
+  int box = u - 18;
+  return ((box / 3) * 3 + i / 3) * 9 + (box % 3) * 3 + i % 3;
+}
+
+// portable tile kernel, tile[cell][lane] holds cell 'cell' of puzzle 'lane'
+// sets bit p of *complete when puzzle p has no empty cell and returns
+// a mask with bit p set when puzzle p is valid
+// a unit is valid when it holds all of 1..9, values 10 and up set no bit
+static unsigned long long checkTileGeneric(const unsigned char (*tile)[TILE_LANES],
+                                           unsigned long long* complete) {
+  unsigned short seen[TILE_LANES];
+  bool ok[TILE_LANES];
+  bool filled[TILE_LANES];
+  for (int p = 0; p < TILE_LANES; p++) {
+    ok[p] = true;
+    filled[p] = true;
+  }
+  for (int c = 0; c < 81; c++) {
+    for (int p = 0; p < TILE_LANES; p++) {
+      filled[p] &= tile[c][p] != 0;
+    }
+  }
+  for (int u = 0; u < 27; u++) {
+    memset(seen, 0, sizeof(seen));
+    for (int i = 0; i < 9; i++) {
+      const unsigned char* cell = tile[unitCell9(u, i)];
+      for (int p = 0; p < TILE_LANES; p++) {
+        seen[p] |= (unsigned short) (((unsigned) (cell[p] <= 9) << cell[p]) >> 1);
+      }
+    }
+    for (int p = 0; p < TILE_LANES; p++) {
+      ok[p] &= seen[p] == 0x1FF;
+    }
+  }
+  unsigned long long valid = 0;
+  *complete = 0;
+  for (int p = 0; p < TILE_LANES; p++) {
+    valid |= (unsigned long long) ok[p] << p;
+    *complete |= (unsigned long long) filled[p] << p;
+  }
+  return valid;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// AVX2 tile kernel, 32 puzzles per register with one byte lane each
+// the value-to-bit lookup is a byte shuffle: digits 1..8 map to a bit of
+// the low mask and digit 9 to the high mask, BATCH_BAD_CELL maps to nothing
+__attribute__((target("avx2")))
+static unsigned long long checkTileAvx2(const unsigned char (*tile)[TILE_LANES],
+                                        unsigned long long* complete) {
+  const __m256i loTable = _mm256_setr_epi8(0, 1, 2, 4, 8, 16, 32, 64, (char) 128, 0, 0, 0, 0, 0, 0, 0,
+                                           0, 1, 2, 4, 8, 16, 32, 64, (char) 128, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i hiTable = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0,
+                                           0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i allBits = _mm256_set1_epi8(-1);
+  const __m256i one = _mm256_set1_epi8(1);
+  unsigned long long valid = 0;
+  *complete = 0;
+  for (int half = 0; half < TILE_LANES; half += 32) {
+    __m256i empty = zero;
+    for (int c = 0; c < 81; c++) {
+      __m256i v = _mm256_loadu_si256((const __m256i*) (tile[c] + half));
+      empty = _mm256_or_si256(empty, _mm256_cmpeq_epi8(v, zero));
+    }
+    __m256i ok = allBits;
+    for (int u = 0; u < 27; u++) {
+      __m256i lo = zero;
+      __m256i hi = zero;
+      for (int i = 0; i < 9; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (tile[unitCell9(u, i)] + half));
+        lo = _mm256_or_si256(lo, _mm256_shuffle_epi8(loTable, v));
+        hi = _mm256_or_si256(hi, _mm256_shuffle_epi8(hiTable, v));
+      }
+      ok = _mm256_and_si256(ok, _mm256_and_si256(_mm256_cmpeq_epi8(lo, allBits),
+                                                 _mm256_cmpeq_epi8(hi, one)));
+    }
+    valid |= (unsigned long long) (unsigned) _mm256_movemask_epi8(ok) << half;
+    *complete |= (unsigned long long) (unsigned) ~_mm256_movemask_epi8(empty) << half;
+  }
+  return valid;
+}
+
+// AVX-512BW tile kernel, all 64 puzzles in one register, same lookup as AVX2
+__attribute__((target("avx512f,avx512bw")))
+static unsigned long long checkTileAvx512(const unsigned char (*tile)[TILE_LANES],
+                                          unsigned long long* complete) {
+  const __m512i loTable = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 2, 4, 8, 16, 32, 64, (char) 128,
+                                                               0, 0, 0, 0, 0, 0, 0));
+  const __m512i hiTable = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 1,
+                                                               0, 0, 0, 0, 0, 0));
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i allBits = _mm512_set1_epi8(-1);
+  const __m512i one = _mm512_set1_epi8(1);
+  __mmask64 empty = 0;
+  for (int c = 0; c < 81; c++) {
+    empty |= _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(tile[c]), zero);
+  }
+  __mmask64 ok = ~(__mmask64) 0;
+  for (int u = 0; u < 27; u++) {
+    __m512i lo = zero;
+    __m512i hi = zero;
+    for (int i = 0; i < 9; i++) {
+      __m512i v = _mm512_loadu_si512(tile[unitCell9(u, i)]);
+      lo = _mm512_or_si512(lo, _mm512_shuffle_epi8(loTable, v));
+      hi = _mm512_or_si512(hi, _mm512_shuffle_epi8(hiTable, v));
+    }
+    ok &= _mm512_cmpeq_epi8_mask(lo, allBits) & _mm512_cmpeq_epi8_mask(hi, one);
+  }
+  *complete = ~empty;
+  return ok;
+}
+#endif
+
+// validates TILE_LANES consecutive 9x9 puzzles of a batch together
+// the puzzles are transposed into structure-of-arrays form so that one
+// vector lane holds one puzzle, complete but invalid puzzles are passed
+// to the serial kernel afterwards to find their failing unit
+// each puzzle is charged an equal share of the time taken
+void validateTile9(PuzzleBatch* batch, int first) {
+  unsigned char tile[81][TILE_LANES] __attribute__((aligned(64)));
+  long long start = nowNanos();
+  for (int p = 0; p < TILE_LANES; p++) {
+    const unsigned char* cells = batch->cells + batch->offsets[first + p];
+    for (int c = 0; c < 81; c++) {
+      tile[c][p] = cells[c];
+    }
+  }
+
+  unsigned long long complete;
+  unsigned long long valid;
+#if defined(__x86_64__) || defined(__i386__)
+  if (__builtin_cpu_supports("avx512bw")) {
+    valid = checkTileAvx512(tile, &complete);
+  }
+  else if (__builtin_cpu_supports("avx2")) {
+    valid = checkTileAvx2(tile, &complete);
+  }
+  else {
+    valid = checkTileGeneric(tile, &complete);
+  }
+#else
+  valid = checkTileGeneric(tile, &complete);
+#endif
+
+  long long share = (nowNanos() - start) / TILE_LANES;
+  for (int p = 0; p < TILE_LANES; p++) {
+    PuzzleResult* result = &batch->results[first + p];
+    if ((complete >> p & 1) && !(valid >> p & 1)) {
+      checkCellsSerial(9, batch->cells + batch->offsets[first + p], result);
+    }
+    else {
+      result->loaded = true;
+      result->complete = complete >> p & 1;
+      result->valid = valid >> p & 1;
+      result->failingUnit = UNIT_NONE;
+      result->failingIndex = 0;
+    }
+    result->nanos = share;
+  }
+}
+
+// whether the TILE_LANES puzzles from first on are all 9x9
+static bool isTile9(const PuzzleBatch* batch, int first) {
+  for (int p = 0; p < TILE_LANES; p++) {
+    if (batch->sizes[first + p] != 9) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void initResultCache(ResultCache* cache) {
+  memset(cache, 0, sizeof(*cache));
+  cache->buckets = calloc(CACHE_BUCKETS, sizeof(CacheEntry*));
+  if (cache->buckets == NULL) {
+    printf("ERROR: out of memory for solution cache\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < CACHE_LOCK_STRIPES; i++) {
+    pthread_mutex_init(&cache->locks[i], NULL);
+  }
+}
+
+void freeResultCache(ResultCache* cache) {
+  for (size_t b = 0; b < CACHE_BUCKETS; b++) {
+    CacheEntry* entry = cache->buckets[b];
+    while (entry != NULL) {
+      CacheEntry* next = entry->next;
+      free(entry);
+      entry = next;
+    }
+  }
+  free(cache->buckets);
+  for (int i = 0; i < CACHE_LOCK_STRIPES; i++) {
+    pthread_mutex_destroy(&cache->locks[i]);
+  }
+}
+
+// 64-bit FNV-1a hash of a byte string
+static unsigned long long hashBytes(const unsigned char* bytes, int len) {
+  unsigned long long hash = 1469598103934665603ULL;
+  for (int i = 0; i < len; i++) {
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+// weight of a cell value in the row of a canonical search, its label when it
+// has one and the next label of its class when it would get one, empty cells
+// weigh most so that rows with more givens come first and pack them to the left
+static inline int canonWeight(const CanonSearch* search, const CanonState* state, int value) {
+  if (value == 0) {
+    return search->psize + 1;
+  }
+  if (state->label[value] != 0) {
+    return state->label[value];
+  }
+  int first = search->classLabel[value];
+  return first + state->taken[first];
+}
+
+// gives a digit seen for the first time the next label of its class
+static inline void canonLabel(const CanonSearch* search, CanonState* state, int value) {
+  if (value != 0 && state->label[value] == 0) {
+    int first = search->classLabel[value];
+    state->label[value] = first + state->taken[first]++;
+  }
+}
+
+// the value of source cell (row, col) as seen through a state's transposition
+static inline int canonCell(const CanonSearch* search, const CanonState* state, int row, int col) {
+  return search->views[state->transpose][row * search->psize + col];
+}
+
+// compares the weight at pos of the row being placed with the smallest row so
+// far, returns true if it is larger and the arrangement is dropped, when it is
+// smaller every arrangement kept so far is dropped instead
+static bool canonLarger(CanonSearch* search, int pos, int weight) {
+  if (weight > search->best[pos]) {
+    return true;
+  }
+  if (weight < search->best[pos]) {
+    search->best[pos] = weight;
+    memset(search->best + pos + 1, 0xFF, search->psize - pos - 1);
+    search->count = 0;
+  }
+  return false;
+}
+
+static void canonPlaceRow(CanonSearch* search, CanonState state, int slot);
+
+// places a group of interchangeable columns of stack slot slot from pos on:
+// those holding a labelled digit in the row by label, then those holding a
+// digit without one by class, in every order within a class since each order
+// labels them differently, while the empty ones stay unplaced at the end of
+// the slot
+static void canonPlaceGroup(CanonSearch* search, const CanonState* state, int slot, int pos,
+                            const unsigned char* group, int size) {
+  int psize = search->psize;
+  unsigned char labelled[CANON_MAX_BOX];
+  unsigned char fresh[CANON_MAX_BOX];
+  int labelledCount = 0;
+  int freshCount = 0;
+  for (int i = 0; i < size; i++) {
+    int value = canonCell(search, state, search->row, group[i]);
+    if (value == 0) {
+      continue;
+    }
+    if (state->label[value] == 0) {
+      fresh[freshCount++] = group[i];
+      continue;
+    }
+    int j = labelledCount++;
+    while (j > 0 && state->label[canonCell(search, state, search->row, labelled[j - 1])] > state->label[value]) {
+      labelled[j] = labelled[j - 1];
+      j--;
+    }
+    labelled[j] = group[i];
+  }
+
+  // the orders of the fresh columns, every permutation of 0..freshCount-1
+  static const unsigned char orders2[] = {0, 1, 1, 0};
+  static const unsigned char orders3[] = {0, 1, 2, 0, 2, 1, 1, 0, 2, 1, 2, 0, 2, 0, 1, 2, 1, 0};
+  static const unsigned char orders4[] = {
+      0, 1, 2, 3, 0, 1, 3, 2, 0, 2, 1, 3, 0, 2, 3, 1, 0, 3, 1, 2, 0, 3, 2, 1,
+      1, 0, 2, 3, 1, 0, 3, 2, 1, 2, 0, 3, 1, 2, 3, 0, 1, 3, 0, 2, 1, 3, 2, 0,
+      2, 0, 1, 3, 2, 0, 3, 1, 2, 1, 0, 3, 2, 1, 3, 0, 2, 3, 0, 1, 2, 3, 1, 0,
+      3, 0, 1, 2, 3, 0, 2, 1, 3, 1, 0, 2, 3, 1, 2, 0, 3, 2, 0, 1, 3, 2, 1, 0};
+  static const unsigned char* orders[] = {orders2, orders2, orders2, orders3, orders4};
+  static const int orderCounts[] = {1, 1, 2, 6, 24};
+  unsigned char freshClass[CANON_MAX_BOX];
+  for (int i = 0; i < freshCount; i++) {
+    freshClass[i] = search->classLabel[canonCell(search, state, search->row, fresh[i])];
+  }
+  for (int o = 0; o < orderCounts[freshCount]; o++) {
+    const unsigned char* order = orders[freshCount] + o * freshCount;
+    // a class with more givens is always placed before one with fewer
+    bool sorted = true;
+    for (int i = 1; i < freshCount && sorted; i++) {
+      sorted = freshClass[order[i - 1]] <= freshClass[order[i]];
+    }
+    if (!sorted) {
+      continue;
+    }
+    CanonState next = *state;
+    int at = pos;
+    bool larger = false;
+    for (int i = 0; i < labelledCount + freshCount && !larger; i++, at++) {
+      int col = i < labelledCount ? labelled[i] : fresh[order[i - labelledCount]];
+      int value = canonCell(search, &next, search->row, col);
+      larger = canonLarger(search, at, canonWeight(search, &next, value));
+      canonLabel(search, &next, value);
+      next.cols[at] = col;
+      next.usedCols |= 1u << col;
+    }
+    if (larger) {
+      return;
+    }
+    next.slotFixed[slot] += labelledCount + freshCount;
+    for (; at < (slot + 1) * search->boxSize; at++) {
+      if (canonLarger(search, at, psize + 1)) {
+        return;
+      }
+    }
+    canonPlaceRow(search, next, slot + 1);
+  }
+}
+
+// places the row search->row under the rows of state from stack slot slot on,
+// keeping every arrangement whose row is no larger than the smallest so far
+// placed columns keep their order, each slot's unplaced columns are sorted by
+// canonPlaceGroup, and unplaced stacks holding a digit in the row are each
+// tried in the next free slot while those empty in it stay unplaced
+static void canonPlaceRow(CanonSearch* search, CanonState state, int slot) {
+  int psize = search->psize;
+  int boxSize = search->boxSize;
+  if (search->overflow) {
+    return;
+  }
+  if (slot == boxSize) {
+    if (search->count == CANON_MAX_STATES) {
+      search->overflow = true;
+      return;
+    }
+    state.rows[search->level] = search->row;
+    state.usedRows |= 1u << search->row;
+    search->states[search->count++] = state;
+    return;
+  }
+  unsigned char group[CANON_MAX_BOX];
+  int size = 0;
+  if (slot < state.freeSlot) {
+    int pos = slot * boxSize;
+    for (int i = 0; i < state.slotFixed[slot]; i++, pos++) {
+      int value = canonCell(search, &state, search->row, state.cols[pos]);
+      if (canonLarger(search, pos, canonWeight(search, &state, value))) {
+        return;
+      }
+      canonLabel(search, &state, value);
+    }
+    int first = state.slotStack[slot] * boxSize;
+    for (int col = first; col < first + boxSize; col++) {
+      if (!(state.usedCols & (1u << col))) {
+        group[size++] = col;
+      }
+    }
+    canonPlaceGroup(search, &state, slot, pos, group, size);
+    return;
+  }
+  bool placed = false;
+  for (int stack = 0; stack < boxSize; stack++) {
+    if (state.usedStacks & (1u << stack)) {
+      continue;
+    }
+    size = 0;
+    bool empty = true;
+    for (int col = stack * boxSize; col < (stack + 1) * boxSize; col++) {
+      group[size++] = col;
+      empty = empty && canonCell(search, &state, search->row, col) == 0;
+    }
+    if (empty) {
+      continue;
+    }
+    CanonState next = state;
+    next.slotStack[slot] = stack;
+    next.slotFixed[slot] = 0;
+    next.freeSlot = slot + 1;
+    next.usedStacks |= 1u << stack;
+    canonPlaceGroup(search, &next, slot, slot * boxSize, group, size);
+    placed = true;
+  }
+  if (!placed) {
+    // the unplaced stacks are all empty in this row
+    for (int pos = slot * boxSize; pos < psize; pos++) {
+      if (canonLarger(search, pos, psize + 1)) {
+        return;
+      }
+    }
+    canonPlaceRow(search, state, boxSize);
+  }
+}
+
+// finds the canonical form of a puzzle: the smallest cell sequence, compared
+// row by row with canonWeight, over transposition, band and stack swaps, row
+// swaps within a band, column swaps within a stack and digit relabelling,
+// which is the smallest over all of them when digits are labelled by class,
+// the number of givens no arrangement changes, and by first appearance
+// within a class
+// rows are placed one at a time, trying every row allowed next for every
+// arrangement tied so far; columns that were empty in every placed row are
+// interchangeable and are only placed once a row tells them apart
+// returns false if more than CANON_MAX_STATES arrangements stay tied
+static bool searchCanonicalForm(int psize, const unsigned char* cells, CanonicalPuzzle* canon) {
+  CanonState levels[2][CANON_MAX_STATES];
+  CanonSearch search;
+  search.psize = psize;
+  search.boxSize = sqrt(psize);
+  search.overflow = false;
+  int boxSize = search.boxSize;
+  for (int row = 0; row < psize; row++) {
+    for (int col = 0; col < psize; col++) {
+      search.views[0][row * psize + col] = cells[row * psize + col];
+      search.views[1][col * psize + row] = cells[row * psize + col];
+    }
+  }
+
+  // rows with more givens are tried first, they tend to give the smaller
+  // row and cut the others short sooner
+  // empty rows of one band, or of two empty bands, lead to the same forms
+  int givens[2][CANON_MAX_SIZE];
+  bool emptyBand[2][CANON_MAX_BOX];
+  for (int transpose = 0; transpose < 2; transpose++) {
+    for (int band = 0; band < boxSize; band++) {
+      emptyBand[transpose][band] = true;
+    }
+    for (int row = 0; row < psize; row++) {
+      givens[transpose][row] = 0;
+      for (int col = 0; col < psize; col++) {
+        givens[transpose][row] += search.views[transpose][row * psize + col] != 0;
+      }
+      emptyBand[transpose][row / boxSize] = emptyBand[transpose][row / boxSize] && givens[transpose][row] == 0;
+    }
+  }
+
+  int occurs[CANON_MAX_SIZE + 1] = {0};
+  for (int i = 0; i < psize * psize; i++) {
+    occurs[cells[i]]++;
+  }
+  for (int digit = 1; digit <= psize; digit++) {
+    search.classLabel[digit] = 1;
+    for (int other = 1; other <= psize; other++) {
+      search.classLabel[digit] += occurs[other] > occurs[digit];
+    }
+  }
+
+  CanonState* current = levels[0];
+  int count = 2;
+  memset(current, 0, 2 * sizeof(CanonState));
+  current[1].transpose = true;
+  unsigned char* key = canon->key + 2;
+  for (int k = 0; k < psize; k++) {
+    search.level = k;
+    search.states = levels[(k + 1) % 2];
+    search.count = 0;
+    memset(search.best, 0xFF, sizeof(search.best));
+    for (int s = 0; s < count; s++) {
+      const CanonState* from = &current[s];
+      // a new band may start with any of its rows, the rest of the band follows
+      int first = 0;
+      int last = psize;
+      if (k % boxSize != 0) {
+        first = from->rows[k - 1] / boxSize * boxSize;
+        last = first + boxSize;
+      }
+      int* rowGivens = givens[from->transpose];
+      unsigned char tries[CANON_MAX_SIZE];
+      int tryCount = 0;
+      for (int row = first; row < last; row++) {
+        if (from->usedRows & (1u << row)) {
+          continue;
+        }
+        int t = tryCount++;
+        while (t > 0 && rowGivens[tries[t - 1]] < rowGivens[row]) {
+          tries[t] = tries[t - 1];
+          t--;
+        }
+        tries[t] = row;
+      }
+      int emptyTried = -1;
+      for (int t = 0; t < tryCount; t++) {
+        int row = tries[t];
+        if (rowGivens[row] == 0) {
+          if (emptyTried >= 0 && (emptyTried / boxSize == row / boxSize
+                                  || (emptyBand[from->transpose][emptyTried / boxSize]
+                                      && emptyBand[from->transpose][row / boxSize]))) {
+            continue;
+          }
+          emptyTried = row;
+        }
+        search.row = row;
+        canonPlaceRow(&search, *from, 0);
+        if (search.overflow) {
+          return false;
+        }
+      }
+    }
+    memcpy(key + k * psize, search.best, psize);
+    current = search.states;
+    count = search.count;
+  }
+
+  // any of the tied arrangements gives the same form, columns and stacks that
+  // stayed empty take the remaining places in order
+  CanonState* found = &current[0];
+  for (int slot = 0; slot < boxSize; slot++) {
+    if (slot >= found->freeSlot) {
+      int stack = 0;
+      while (found->usedStacks & (1u << stack)) {
+        stack++;
+      }
+      found->slotStack[slot] = stack;
+      found->slotFixed[slot] = 0;
+      found->usedStacks |= 1u << stack;
+    }
+    int pos = slot * boxSize + found->slotFixed[slot];
+    for (int col = found->slotStack[slot] * boxSize; col < (found->slotStack[slot] + 1) * boxSize; col++) {
+      if (!(found->usedCols & (1u << col))) {
+        found->cols[pos++] = col;
+      }
+    }
+  }
+  // digits the puzzle does not use take the remaining labels of their class,
+  // any order does
+  for (int digit = 1; digit <= psize; digit++) {
+    canonLabel(&search, found, digit);
+  }
+  canon->transpose = found->transpose;
+  memcpy(canon->rows, found->rows, psize);
+  memcpy(canon->cols, found->cols, psize);
+  memcpy(canon->label, found->label, psize + 1);
+  // empty cells are stored as 0 like everywhere else
+  for (int i = 0; i < psize * psize; i++) {
+    if (key[i] == psize + 1) {
+      key[i] = 0;
+    }
+  }
+  return true;
+}
+
+// fills key with the cells of a puzzle as given and the identity arrangement
+// returns false if a cell holds a value the puzzle size does not allow
+bool keyPuzzleCells(int psize, int** grid, CanonicalPuzzle* key) {
+  if (psize < 1 || psize > MAX_PUZZLE_SIZE) {
+    return false;
+  }
+  for (int row = 0; row < psize; row++) {
+    for (int col = 0; col < psize; col++) {
+      int value = grid[row + 1][col + 1];
+      if (value < 0 || value > psize) {
+        return false;
+      }
+      key->key[2 + row * psize + col] = value;
+    }
+  }
+  key->keyLen = 2 + psize * psize;
+  key->key[0] = CACHE_KEY_CELLS;
+  key->key[1] = psize;
+  key->transpose = false;
+  for (int i = 0; i < psize; i++) {
+    key->rows[i] = i;
+    key->cols[i] = i;
+  }
+  for (int digit = 0; digit <= psize; digit++) {
+    key->label[digit] = digit;
+  }
+  key->hash = hashBytes(key->key, key->keyLen);
+  return true;
+}
+
+// fills canon with the canonical form of the puzzle keyed by given and the
+// arrangement that maps it there, returns false for puzzles larger than
+// CANON_MAX_SIZE and those with too many ties to search
+bool canonicalizePuzzle(int psize, const CanonicalPuzzle* given, CanonicalPuzzle* canon) {
+  if (psize > CANON_MAX_SIZE) {
+    return false;
+  }
+  canon->keyLen = 2 + psize * psize;
+  canon->key[0] = CACHE_KEY_CANONICAL;
+  canon->key[1] = psize;
+  if (!searchCanonicalForm(psize, given->key + 2, canon)) {
+    return false;
+  }
+  canon->hash = hashBytes(canon->key, canon->keyLen);
+  return true;
+}
+
+// the source cell of grid that canonical cell (row, col) comes from
+static inline int* canonSource(const CanonicalPuzzle* canon, int** grid, int row, int col) {
+  int sourceRow = canon->rows[row] + 1;
+  int sourceCol = canon->cols[col] + 1;
+  return canon->transpose ? &grid[sourceCol][sourceRow] : &grid[sourceRow][sourceCol];
+}
+
+// looks up the entry stored under key, on a hit the solution count, whether
+// it solved and the solver go into result and a stored solution is mapped
+// back through key into grid
+static bool findCacheEntry(ResultCache* cache, const CanonicalPuzzle* key, int psize, int** grid,
+                           PuzzleResult* result) {
+  size_t bucket = key->hash & (CACHE_BUCKETS - 1);
+  pthread_mutex_t* lock = &cache->locks[bucket % CACHE_LOCK_STRIPES];
+  bool found = false;
+  pthread_mutex_lock(lock);
+  for (CacheEntry* entry = cache->buckets[bucket]; entry != NULL; entry = entry->next) {
+    if (entry->hash == key->hash && entry->keyLen == key->keyLen
+        && memcmp(entry->key, key->key, key->keyLen) == 0) {
+      result->solutions = entry->solutions;
+      result->solved = entry->solutions > 0;
+      result->strategy = entry->strategy;
+      if (entry->hasSolution) {
+        unsigned char digits[MAX_PUZZLE_SIZE + 1];
+        for (int digit = 1; digit <= psize; digit++) {
+          digits[key->label[digit]] = digit;
+        }
+        const unsigned char* solution = entry->key + entry->keyLen;
+        for (int row = 0; row < psize; row++) {
+          for (int col = 0; col < psize; col++) {
+            *canonSource(key, grid, row, col) = digits[solution[row * psize + col]];
+          }
+        }
+      }
+      found = true;
+      break;
+    }
+  }
+  pthread_mutex_unlock(lock);
+  return found;
+}
+
+// stores the answer in result under key, unless the cache is full or another
+// worker stored it first, a solved grid is kept in the labels of key
+static void insertCacheEntry(ResultCache* cache, const CanonicalPuzzle* key, int psize, int** grid,
+                             const PuzzleResult* result, bool withSolution) {
+  if (__atomic_load_n(&cache->entries, __ATOMIC_RELAXED) >= CACHE_MAX_ENTRIES) {
+    return;
+  }
+  withSolution = withSolution && result->solved;
+  int solutionLen = withSolution ? psize * psize : 0;
+  CacheEntry* created = malloc(sizeof(CacheEntry) + key->keyLen + solutionLen);
+  if (created == NULL) {
+    return;
+  }
+  created->hash = key->hash;
+  created->solutions = result->solutions;
+  created->strategy = result->strategy;
+  created->hasSolution = withSolution;
+  created->keyLen = key->keyLen;
+  memcpy(created->key, key->key, key->keyLen);
+  if (withSolution) {
+    unsigned char* solution = created->key + key->keyLen;
+    for (int row = 0; row < psize; row++) {
+      for (int col = 0; col < psize; col++) {
+        solution[row * psize + col] = key->label[*canonSource(key, grid, row, col)];
+      }
+    }
+  }
+
+  size_t bucket = key->hash & (CACHE_BUCKETS - 1);
+  pthread_mutex_t* lock = &cache->locks[bucket % CACHE_LOCK_STRIPES];
+  pthread_mutex_lock(lock);
+  for (CacheEntry* entry = cache->buckets[bucket]; entry != NULL; entry = entry->next) {
+    if (entry->hash == key->hash && entry->keyLen == key->keyLen
+        && memcmp(entry->key, key->key, key->keyLen) == 0) {
+      pthread_mutex_unlock(lock);
+      free(created);
+      return;
+    }
+  }
+  created->next = cache->buckets[bucket];
+  cache->buckets[bucket] = created;
+  pthread_mutex_unlock(lock);
+  __atomic_add_fetch(&cache->entries, 1, __ATOMIC_RELAXED);
+}
+
+// whether a puzzle missed under its cells should be looked up under its
+// canonical form, true while the hits of past searches saved more search time
+// than all searches took, and for every CANON_PROBE_INTERVAL-th miss besides
+// so a corpus that turns harder switches the search back on
+static bool canonicalSearchPays(ResultCache* cache) {
+  long canons = __atomic_load_n(&cache->canons, __ATOMIC_RELAXED);
+  long solves = __atomic_load_n(&cache->solves, __ATOMIC_RELAXED);
+  if (canons < CANON_WARMUP || solves == 0
+      || __atomic_load_n(&cache->misses, __ATOMIC_RELAXED) % CANON_PROBE_INTERVAL == 0) {
+    return true;
+  }
+  double saved = (double) __atomic_load_n(&cache->canonHits, __ATOMIC_RELAXED)
+                 * __atomic_load_n(&cache->solveNanos, __ATOMIC_RELAXED) / solves;
+  return saved > (double) __atomic_load_n(&cache->canonNanos, __ATOMIC_RELAXED);
+}
+
+// looks up the answer for the puzzle in grid, returns false on a miss
+// the cells as given are tried first, a repeat costs one hash, then the
+// canonical form, which every equivalent puzzle shares, while searching for
+// it pays; a canonical hit is stored under the cells too so the next repeat
+// skips the canonical search
+// on a miss given and canon hold the keys for storeCachedSolution, a key
+// that could not be built has keyLen 0
+bool lookupCachedSolution(ResultCache* cache, int psize, int** grid, bool withSolution,
+                          CanonicalPuzzle* given, CanonicalPuzzle* canon, PuzzleResult* result) {
+  canon->keyLen = 0;
+  if (!keyPuzzleCells(psize, grid, given)) {
+    given->keyLen = 0;
+    return false;
+  }
+  bool found = findCacheEntry(cache, given, psize, grid, result);
+  if (!found && canonicalSearchPays(cache)) {
+    long long start = nowNanos();
+    if (canonicalizePuzzle(psize, given, canon)) {
+      found = findCacheEntry(cache, canon, psize, grid, result);
+      if (found) {
+        insertCacheEntry(cache, given, psize, grid, result, withSolution);
+      }
+    } else {
+      canon->keyLen = 0;
+    }
+    __atomic_add_fetch(&cache->canons, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&cache->canonNanos, nowNanos() - start, __ATOMIC_RELAXED);
+    if (found) {
+      __atomic_add_fetch(&cache->canonHits, 1, __ATOMIC_RELAXED);
+    }
+  }
+  __atomic_add_fetch(found ? &cache->hits : &cache->misses, 1, __ATOMIC_RELAXED);
+  return found;
+}
+
+// stores the answer of a search that took searchNanos under the keys
+// lookupCachedSolution left in given and canon, solved grids only when
+// withSolution is set
+void storeCachedSolution(ResultCache* cache, int psize, int** grid, bool withSolution,
+                         const CanonicalPuzzle* given, const CanonicalPuzzle* canon,
+                         const PuzzleResult* result, long long searchNanos) {
+  __atomic_add_fetch(&cache->solves, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&cache->solveNanos, searchNanos, __ATOMIC_RELAXED);
+  if (given->keyLen > 0) {
+    insertCacheEntry(cache, given, psize, grid, result, withSolution);
+  }
+  if (canon->keyLen > 0) {
+    insertCacheEntry(cache, canon, psize, grid, result, withSolution);
+  }
+}
+
+// 128-bit hash of a puzzle's size and cells, two independent 64-bit lanes
+// mixed eight bytes at a time and finished with the murmur3 finalizer
+void hashGrid128(int psize, const unsigned char* cells, unsigned long long* lo, unsigned long long* hi) {
+  size_t len = (size_t) psize * psize;
+  unsigned long long a = 0x9E3779B97F4A7C15ULL ^ (unsigned long long) psize;
+  unsigned long long b = 0xC2B2AE3D27D4EB4FULL + len;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    unsigned long long word;
+    memcpy(&word, cells + i, 8);
+    a = (a ^ word) * 0xFF51AFD7ED558CCDULL;
+    a ^= a >> 32;
+    b = (b + word) * 0xC4CEB9FE1A85EC53ULL;
+    b ^= b >> 29;
+  }
+  unsigned long long tail = 0;
+  memcpy(&tail, cells + i, len - i);
+  a = (a ^ tail) * 0xFF51AFD7ED558CCDULL;
+  b = (b + tail) * 0xC4CEB9FE1A85EC53ULL;
+  unsigned long long mixed[2] = {a ^ (b >> 31), b ^ (a >> 27)};
+  for (int k = 0; k < 2; k++) {
+    unsigned long long h = mixed[k];
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    mixed[k] = h;
+  }
+  *lo = mixed[0];
+  *hi = mixed[1];
+}
+
+// checksum of a log record and the solution that follows it
+static unsigned long long diskRecordCheck(const DiskRecord* record, const unsigned char* solution) {
+  DiskRecord copy = *record;
+  copy.check = 0;
+  unsigned long long check = hashBytes((const unsigned char*) &copy, sizeof(copy));
+  return check ^ hashBytes(solution, record->solutionLen) * 0x9E3779B97F4A7C15ULL;
+}
+
+// bytes a record with a solution of solutionLen cells takes in the log
+static inline unsigned long long diskRecordLength(unsigned int solutionLen) {
+  return sizeof(DiskRecord) + ((solutionLen + 7) & ~7u);
+}
+
+// reads len bytes of the log at offset, from the mapping when they were
+// written before the cache was opened and from the file otherwise
+static bool readDiskBytes(const DiskCache* cache, unsigned long long offset, void* out, size_t len) {
+  if (offset + len <= cache->logMapSize) {
+    memcpy(out, cache->log + offset, len);
+    return true;
+  }
+  return pread(cache->fd, out, len, offset) == (ssize_t) len;
+}
+
+// reads the record at offset of the log, and its solution when solution is
+// not NULL or the record is verified against its checksum
+// returns false past the end of the log and for a record that does not check out
+static bool readDiskRecord(const DiskCache* cache, unsigned long long offset, DiskRecord* record,
+                           unsigned char* solution, bool verify) {
+  if (!readDiskBytes(cache, offset, record, sizeof(*record))
+      || record->solutionLen > MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE) {
+    return false;
+  }
+  if (solution == NULL && !verify) {
+    return true;
+  }
+  unsigned char cells[MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+  if (solution == NULL) {
+    solution = cells;
+  }
+  if (!readDiskBytes(cache, offset + sizeof(*record), solution, record->solutionLen)) {
+    return false;
+  }
+  return !verify || record->check == diskRecordCheck(record, solution);
+}
+
+// the index slot of a grid hash: the one holding it, or the empty one it would
+// take, the fill limit leaves an empty slot at the end of every probe
+static DiskSlot* probeDiskIndex(DiskSlot* slots, unsigned long long capacity, unsigned long long lo,
+                                unsigned long long hi) {
+  unsigned long long mask = capacity - 1;
+  for (unsigned long long i = lo & mask;; i = (i + 1) & mask) {
+    DiskSlot* slot = &slots[i];
+    if (__atomic_load_n(&slot->offset, __ATOMIC_ACQUIRE) == 0 || (slot->hashLo == lo && slot->hashHi == hi)) {
+      return slot;
+    }
+  }
+}
+
+// points the index at the record at offset for a grid hash, the caller holds
+// the index alone, returns false if the hash is new and the index is full
+static bool indexDiskRecord(DiskCache* cache, unsigned long long lo, unsigned long long hi,
+                            unsigned long long offset) {
+  DiskIndexHeader* index = cache->index;
+  DiskSlot* slot = probeDiskIndex(cache->slots, index->capacity, lo, hi);
+  if (slot->offset == 0) {
+    if ((index->used + 1) * 100 > index->capacity * DISK_CACHE_MAX_LOAD) {
+      return false;
+    }
+    slot->hashLo = lo;
+    slot->hashHi = hi;
+    index->used++;
+  }
+  __atomic_store_n(&slot->offset, offset, __ATOMIC_RELEASE);
+  return true;
+}
+
+// walks the records of the log from offset from up to end in log order, so the
+// newest record of a grid is indexed last, counting them or indexing them
+// returns where the walk stopped: at end, at a torn or unreadable record, or at
+// the first record of a new grid the full index had no room for
+static unsigned long long scanDiskLog(DiskCache* cache, unsigned long long from, unsigned long long end,
+                                      bool index, long* records) {
+  unsigned long long offset = from;
+  DiskRecord record;
+  while (offset + sizeof(record) <= end && readDiskRecord(cache, offset, &record, NULL, true)
+         && offset + diskRecordLength(record.solutionLen) <= end) {
+    if (index && !indexDiskRecord(cache, record.hashLo, record.hashHi, offset)) {
+      break;
+    }
+    if (records != NULL) {
+      (*records)++;
+    }
+    offset += diskRecordLength(record.solutionLen);
+  }
+  return offset;
+}
+
+// maps the index file fd if it was built for the log identified by st, shared
+// for the writer and private to a reader, returns false if it is missing, of
+// another format or describes more of the log than there is
+static bool mapDiskIndex(DiskCache* cache, int fd, const struct stat* logStat) {
+  DiskIndexHeader header;
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+      || memcmp(header.magic, DISK_INDEX_MAGIC, 8) != 0 || header.version != DISK_CACHE_VERSION
+      || header.slotSize != sizeof(DiskSlot) || header.capacity == 0
+      || (header.capacity & (header.capacity - 1)) != 0 || header.logInode != (unsigned long long) logStat->st_ino
+      || header.indexed < sizeof(DiskCacheHeader) || header.indexed > header.logLength
+      || header.logLength > (unsigned long long) logStat->st_size
+      || (off_t) (sizeof(DiskIndexHeader) + header.capacity * sizeof(DiskSlot)) > st.st_size) {
+    return false;
+  }
+  size_t size = sizeof(DiskIndexHeader) + header.capacity * sizeof(DiskSlot);
+  void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, cache->writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  cache->indexMapSize = size;
+  cache->index = (DiskIndexHeader*) map;
+  cache->slots = (DiskSlot*) ((char*) map + sizeof(DiskIndexHeader));
+  return true;
+}
+
+// lays out a new index for the log identified by logStat on fd, or in private
+// memory when fd is -1, with four slots per record, and indexes the log into it
+// returns false if it cannot be mapped
+static bool buildDiskIndex(DiskCache* cache, int fd, const struct stat* logStat) {
+  long records = 0;
+  unsigned long long end = scanDiskLog(cache, sizeof(DiskCacheHeader), logStat->st_size, false, &records);
+  unsigned long long capacity = DISK_INDEX_MIN_SLOTS;
+  while (capacity < 4ULL * records) {
+    capacity <<= 1;
+  }
+  size_t size = sizeof(DiskIndexHeader) + capacity * sizeof(DiskSlot);
+  void* map;
+  if (fd < 0) {
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+  else if (ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0) {
+    return false;
+  }
+  else {
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  cache->indexMapSize = size;
+  cache->index = (DiskIndexHeader*) map;
+  cache->slots = (DiskSlot*) ((char*) map + sizeof(DiskIndexHeader));
+  DiskIndexHeader* index = cache->index;
+  memcpy(index->magic, DISK_INDEX_MAGIC, 8);
+  index->version = DISK_CACHE_VERSION;
+  index->slotSize = sizeof(DiskSlot);
+  index->capacity = capacity;
+  index->logInode = logStat->st_ino;
+  index->indexed = scanDiskLog(cache, sizeof(DiskCacheHeader), end, true, NULL);
+  index->logLength = end;
+  return true;
+}
+
+// opens the index of the log at path for the writer: maps the index file and
+// indexes the records appended after it was last written, or rebuilds it next
+// to the old one and renames it over it when it is missing, stale or past
+// DISK_INDEX_GROW_LOAD, then cuts a torn last record off the log
+static bool openDiskIndexWriter(DiskCache* cache, const char* path, struct stat* logStat) {
+  char indexPath[PATH_MAX];
+  char buildPath[PATH_MAX];
+  snprintf(indexPath, sizeof(indexPath), "%s.index", path);
+  snprintf(buildPath, sizeof(buildPath), "%s.index.new", path);
+  int fd = open(indexPath, O_RDWR);
+  bool mapped = mapDiskIndex(cache, fd, logStat);
+  if (fd >= 0) {
+    close(fd);
+  }
+  if (mapped) {
+    DiskIndexHeader* index = cache->index;
+    index->indexed = scanDiskLog(cache, index->indexed, logStat->st_size, true, NULL);
+    if (index->full || index->used * 100 >= index->capacity * DISK_INDEX_GROW_LOAD) {
+      munmap(cache->index, cache->indexMapSize);
+      mapped = false;
+    }
+  }
+  if (!mapped) {
+    fd = open(buildPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      return false;
+    }
+    mapped = buildDiskIndex(cache, fd, logStat);
+    close(fd);
+    if (!mapped || rename(buildPath, indexPath) != 0) {
+      if (mapped) {
+        munmap(cache->index, cache->indexMapSize);
+      }
+      unlink(buildPath);
+      return false;
+    }
+  }
+  DiskIndexHeader* index = cache->index;
+  if (index->indexed < (unsigned long long) logStat->st_size) {
+    // the last writer stopped in the middle of a record, the log ends before it
+    munmap((void*) cache->log, cache->logMapSize);
+    cache->log = NULL;
+    cache->logMapSize = 0;
+    if (ftruncate(cache->fd, index->indexed) != 0) {
+      munmap(cache->index, cache->indexMapSize);
+      return false;
+    }
+    logStat->st_size = index->indexed;
+    void* map = mmap(NULL, index->indexed, PROT_READ, MAP_SHARED, cache->fd, 0);
+    if (map != MAP_FAILED) {
+      cache->log = map;
+      cache->logMapSize = index->indexed;
+    }
+  }
+  index->logLength = index->indexed;
+  index->full = 0;
+  return true;
+}
+
+// opens the index of the log at path for a reader, privately: the index file
+// with the records appended since it was written added, or one built from the
+// log when the file is missing or stale
+static bool openDiskIndexReader(DiskCache* cache, const char* path, const struct stat* logStat) {
+  char indexPath[PATH_MAX];
+  snprintf(indexPath, sizeof(indexPath), "%s.index", path);
+  int fd = open(indexPath, O_RDONLY);
+  bool mapped = mapDiskIndex(cache, fd, logStat);
+  if (fd >= 0) {
+    close(fd);
+  }
+  if (mapped) {
+    DiskIndexHeader* index = cache->index;
+    index->indexed = scanDiskLog(cache, index->indexed, logStat->st_size, true, NULL);
+    return true;
+  }
+  return buildDiskIndex(cache, -1, logStat);
+}
+
+// maps the result cache log at path and its index, creating them if they do
+// not exist; the first process to take the file lock may append results,
+// later ones only read, and wait for a log that its writer has only created
+// returns false if the files cannot be used
+bool openDiskCache(DiskCache* cache, const char* path) {
+  memset(cache, 0, sizeof(*cache));
+  cache->fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (cache->fd < 0) {
+    cache->fd = open(path, O_RDONLY);
+    if (cache->fd < 0) {
+      return false;
+    }
+  }
+  cache->writable = flock(cache->fd, LOCK_EX | LOCK_NB) == 0;
+
+  struct stat st;
+  if (fstat(cache->fd, &st) != 0) {
+    close(cache->fd);
+    return false;
+  }
+  if (cache->writable && st.st_size < (off_t) sizeof(DiskCacheHeader)) {
+    // a new log, or one whose writer stopped before its header was written
+    DiskCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DISK_CACHE_MAGIC, 8);
+    header.version = DISK_CACHE_VERSION;
+    header.recordSize = sizeof(DiskRecord);
+    if (ftruncate(cache->fd, 0) != 0 || pwrite(cache->fd, &header, sizeof(header), 0) != sizeof(header)) {
+      close(cache->fd);
+      return false;
+    }
+  }
+
+  DiskCacheHeader header;
+  bool ready = false;
+  for (int attempt = 0; attempt < DISK_CACHE_OPEN_RETRIES && !ready; attempt++) {
+    if (attempt > 0) {
+      struct timespec pause = {0, DISK_CACHE_RETRY_MS * 1000000L};
+      nanosleep(&pause, NULL);
+    }
+    ready = fstat(cache->fd, &st) == 0 && st.st_size >= (off_t) sizeof(header)
+            && pread(cache->fd, &header, sizeof(header), 0) == sizeof(header);
+  }
+  if (!ready || memcmp(header.magic, DISK_CACHE_MAGIC, 8) != 0 || header.version != DISK_CACHE_VERSION
+      || header.recordSize != sizeof(DiskRecord)) {
+    close(cache->fd);
+    return false;
+  }
+
+  // map the log as it is now, the pages come in from the page cache as records are read
+  void* log = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, cache->fd, 0);
+  if (log == MAP_FAILED) {
+    close(cache->fd);
+    return false;
+  }
+  cache->log = log;
+  cache->logMapSize = st.st_size;
+  if (!(cache->writable ? openDiskIndexWriter(cache, path, &st) : openDiskIndexReader(cache, path, &st))) {
+    if (cache->log != NULL) {
+      munmap((void*) cache->log, cache->logMapSize);
+    }
+    close(cache->fd);
+    return false;
+  }
+  cache->writeLock = mmap(NULL, sizeof(pthread_mutex_t), PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (cache->writeLock == MAP_FAILED) {
+    closeDiskCache(cache);
+    return false;
+  }
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutex_init(cache->writeLock, &attr);
+  pthread_mutexattr_destroy(&attr);
+  return true;
+}
+
+void closeDiskCache(DiskCache* cache) {
+  if (cache->log != NULL) {
+    munmap((void*) cache->log, cache->logMapSize);
+  }
+  munmap(cache->index, cache->indexMapSize);
+  close(cache->fd);
+  if (cache->writeLock != NULL && cache->writeLock != MAP_FAILED) {
+    pthread_mutex_destroy(cache->writeLock);
+    munmap(cache->writeLock, sizeof(pthread_mutex_t));
+  }
+}
+
+// reads the newest record for a grid hash, and its solution when solution is
+// not NULL, returns false if the log has none
+static bool findDiskRecord(DiskCache* cache, unsigned long long lo, unsigned long long hi,
+                           DiskRecord* record, unsigned char* solution) {
+  DiskSlot* slot = probeDiskIndex(cache->slots, cache->index->capacity, lo, hi);
+  unsigned long long offset = __atomic_load_n(&slot->offset, __ATOMIC_ACQUIRE);
+  return offset != 0 && readDiskRecord(cache, offset, record, solution, false)
+         && record->hashLo == lo && record->hashHi == hi;
+}
+
+// 128-bit hash of the puzzle in grid, the same as that of its cells in a batch
+// returns false if a cell holds a value the puzzle size does not allow
+bool hashPuzzleGrid(int psize, int** grid, unsigned long long* lo, unsigned long long* hi) {
+  unsigned char cells[MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+  if (psize < 1 || psize > MAX_PUZZLE_SIZE) {
+    return false;
+  }
+  for (int row = 0; row < psize; row++) {
+    for (int col = 0; col < psize; col++) {
+      int value = grid[row + 1][col + 1];
+      if (value < 0 || value > psize) {
+        return false;
+      }
+      cells[row * psize + col] = value;
+    }
+  }
+  hashGrid128(psize, cells, lo, hi);
+  return true;
+}
+
+// looks up the verdict stored for a grid hash, returns false on a miss
+bool lookupDiskVerdict(DiskCache* cache, unsigned long long lo, unsigned long long hi,
+                       PuzzleResult* result) {
+  DiskRecord record;
+  if (!findDiskRecord(cache, lo, hi, &record, NULL)) {
+    __atomic_add_fetch(&cache->misses, 1, __ATOMIC_RELAXED);
+    return false;
+  }
+  result->loaded = true;
+  result->complete = (record.state & DISK_RECORD_COMPLETE) != 0;
+  result->valid = (record.state & DISK_RECORD_VALID) != 0;
+  result->failingUnit = record.failing >> 16;
+  result->failingIndex = record.failing & 0xFFFF;
+  __atomic_add_fetch(&cache->hits, 1, __ATOMIC_RELAXED);
+  return true;
+}
+
+// answers the search of the options for a grid hash from its record, when the
+// record holds enough: a solution, or an exact count of none, to find one, and
+// an exact count or a lower bound reaching the limit to count; a stored
+// solution is written into grid, returns false on a miss
+bool lookupDiskSolution(DiskCache* cache, unsigned long long lo, unsigned long long hi,
+                        const SolveOptions* options, int psize, int** grid, PuzzleResult* result) {
+  DiskRecord record;
+  unsigned char solution[MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+  bool found = findDiskRecord(cache, lo, hi, &record, solution) && (record.state & DISK_RECORD_COUNTED);
+  bool exact = (record.state & DISK_RECORD_EXACT) != 0;
+  long long limit = solveLimit(options);
+  if (found && options->mode == SOLVE_ONE) {
+    if (record.solutionLen == (unsigned int) (psize * psize)) {
+      for (int c = 0; c < psize * psize; c++) {
+        grid[c / psize + 1][c % psize + 1] = solution[c];
+      }
+      result->solutions = 1;
+    }
+    else if (exact && record.solutions == 0) {
+      result->solutions = 0;
+    }
+    else {
+      found = false;
+    }
+  }
+  else if (found && (exact || record.solutions >= limit)) {
+    result->solutions = record.solutions < limit ? record.solutions : limit;
+  }
+  else {
+    found = false;
+  }
+  if (!found) {
+    __atomic_add_fetch(&cache->misses, 1, __ATOMIC_RELAXED);
+    return false;
+  }
+  result->solved = result->solutions > 0;
+  result->strategy = record.strategy;
+  __atomic_add_fetch(&cache->hits, 1, __ATOMIC_RELAXED);
+  return true;
+}
+
+// appends the verdict in result for a grid hash and, when solve is not NULL
+// and its search ran to the end, the search outcome, merged with the record
+// the log held for the grid: an exact count wins over a lower bound and a
+// bigger bound over a smaller one, a stored solution is kept
+// nothing is appended if this process is not the writer or the log knew as much
+void storeDiskResult(DiskCache* cache, unsigned long long lo, unsigned long long hi,
+                     const PuzzleResult* result, const SolveOptions* solve, int psize, int** grid) {
+  if (!cache->writable) {
+    return;
+  }
+  unsigned char buffer[sizeof(DiskRecord) + MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE + 8];
+  DiskRecord* record = (DiskRecord*) buffer;
+  unsigned char* solution = buffer + sizeof(DiskRecord);
+  pthread_mutex_lock(cache->writeLock);
+  DiskRecord old;
+  bool found = findDiskRecord(cache, lo, hi, &old, solution);
+  if (found) {
+    *record = old;
+  }
+  else {
+    memset(record, 0, sizeof(*record));
+    record->hashLo = lo;
+    record->hashHi = hi;
+  }
+  record->state &= DISK_RECORD_COUNTED | DISK_RECORD_EXACT;
+  record->state |= result->complete ? DISK_RECORD_COMPLETE : 0;
+  record->state |= result->valid ? DISK_RECORD_VALID : 0;
+  record->failing = (unsigned int) result->failingUnit << 16 | result->failingIndex;
+  if (solve != NULL && result->attempted && !result->outOfBudget) {
+    // finding one solution only tells there are none apart from a lower bound
+    bool exact = solve->mode == SOLVE_ONE ? result->solutions == 0 : result->solutions < solveLimit(solve);
+    bool known = (record->state & DISK_RECORD_COUNTED) != 0;
+    if (!known || (!(record->state & DISK_RECORD_EXACT) && (exact || result->solutions > record->solutions))) {
+      record->state |= DISK_RECORD_COUNTED | (exact ? DISK_RECORD_EXACT : 0);
+      record->solutions = result->solutions;
+      record->strategy = result->strategy;
+    }
+    if (solve->mode == SOLVE_ONE && result->solved && record->solutionLen == 0) {
+      for (int c = 0; c < psize * psize; c++) {
+        solution[c] = grid[c / psize + 1][c % psize + 1];
+      }
+      record->solutionLen = psize * psize;
+    }
+  }
+  record->check = 0;
+  old.check = 0;
+  if (!found || memcmp(record, &old, sizeof(old)) != 0) {
+    memset(solution + record->solutionLen, 0, diskRecordLength(record->solutionLen) - sizeof(DiskRecord)
+                                              - record->solutionLen);
+    record->check = diskRecordCheck(record, solution);
+    DiskIndexHeader* index = cache->index;
+    unsigned long long offset = index->logLength;
+    size_t len = diskRecordLength(record->solutionLen);
+    if (pwrite(cache->fd, buffer, len, offset) == (ssize_t) len) {
+      index->logLength = offset + len;
+      if (indexDiskRecord(cache, lo, hi, offset)) {
+        if (index->indexed == offset) {
+          index->indexed = offset + len;
+        }
+      }
+      else if (!index->full) {
+        index->full = 1;
+        fprintf(stderr, "disk cache: the index is full, results added from now on are indexed "
+                        "when the cache is next opened\n");
+      }
+      cache->stored++;
+    }
+  }
+  pthread_mutex_unlock(cache->writeLock);
+}
+
+// validates puzzle i of the batch through the persistent cache, a miss goes
+// through the serial kernel; the verdict of an incomplete puzzle of a solving
+// run is stored with its search outcome instead
+void validateThroughDisk(PuzzleBatch* batch, int i) {
+  int psize = batch->sizes[i];
+  const unsigned char* cells = batch->cells + batch->offsets[i];
+  PuzzleResult* result = &batch->results[i];
+  unsigned long long lo;
+  unsigned long long hi;
+  hashGrid128(psize, cells, &lo, &hi);
+  if (lookupDiskVerdict(batch->diskCache, lo, hi, result)) {
+    return;
+  }
+  checkCellsSerial(psize, cells, result);
+  if (batch->solve == NULL || result->complete) {
+    storeDiskResult(batch->diskCache, lo, hi, result, NULL, psize, NULL);
+  }
+}
+
+// completes puzzle i of the batch if it was read and found incomplete, with
+// the solve options of the batch, listed solutions are only counted
+static void solveBatchPuzzle(PuzzleBatch* batch, int i) {
+  PuzzleResult* result = &batch->results[i];
+  result->solved = false;
+  result->solutions = 0;
+  result->attempted = false;
+  result->solveNanos = 0;
+  result->strategy = SOLVER_NONE;
+  result->outOfBudget = false;
+  result->fixedCells = 0;
+  int psize = batch->sizes[i];
+  if (psize <= 0 || !result->loaded || result->complete) {
+    return;
+  }
+  int cells[MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+  const unsigned char* bytes = batch->cells + batch->offsets[i];
+  for (int c = 0; c < psize * psize; c++) {
+    cells[c] = bytes[c];
+  }
+  int** grid = gridFromCells(psize, cells);
+  solveEvaluatedPuzzle(batch->solve, psize, grid, result, NULL);
+  deleteSudokuPuzzle(psize, grid);
+}
+
+// validates the puzzles [first, last) of a batch, runs of 9x9 puzzles go
+// through the tile kernel and everything else through the serial kernel
+// with a persistent cache every puzzle is looked up by its grid hash first
+// incomplete puzzles are then completed if the batch has solve options
+void validateBatchRange(PuzzleBatch* batch, int first, int last) {
+  for (int i = first; i < last; i++) {
+    if (batch->diskCache != NULL && batch->sizes[i] > 0) {
+      long long start = nowNanos();
+      validateThroughDisk(batch, i);
+      batch->results[i].nanos = nowNanos() - start;
+      continue;
+    }
+    if (i + TILE_LANES <= last && isTile9(batch, i)) {
+      validateTile9(batch, i);
+      i += TILE_LANES - 1;
+      continue;
+    }
+    PuzzleResult* result = &batch->results[i];
+    if (batch->sizes[i] < 0) {
+      result->loaded = false;
+      continue;
+    }
+    long long start = nowNanos();
+    checkCellsSerial(batch->sizes[i], batch->cells + batch->offsets[i], result);
+    result->nanos = nowNanos() - start;
+  }
+  if (batch->solve != NULL) {
+    for (int i = first; i < last; i++) {
+      solveBatchPuzzle(batch, i);
+    }
+  }
+}
+
+// batch worker, claims BATCH_GRAIN puzzles at a time until none are left
+void* batchWorker(void* arg) {
+  BatchJob* job = (BatchJob*) arg;
+  int count = job->batch->count;
+  int first;
+  while ((first = __atomic_fetch_add(&job->next, BATCH_GRAIN, __ATOMIC_RELAXED)) < count) {
+    int last = first + BATCH_GRAIN < count ? first + BATCH_GRAIN : count;
+    validateBatchRange(job->batch, first, last);
+  }
+  return NULL;
+}
+
+// validates every puzzle of the batch, whole puzzles are spread over
+// numThreads workers that each run the tile or serial kernel
+void validateBatch(PuzzleBatch* batch, int numThreads) {
+  BatchJob job = {batch, 0};
+  int needed = (batch->count + BATCH_GRAIN - 1) / BATCH_GRAIN;
+  if (numThreads > needed) {
+    numThreads = needed;
+  }
+  if (numThreads <= 1) {
+    validateBatchRange(batch, 0, batch->count);
+    return;
+  }
+  pthread_t* workers = malloc(sizeof(pthread_t) * numThreads);
+  if (workers == NULL) {
+    printf("ERROR: out of memory for batch threads\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < numThreads; i++) {
+    if (pthread_create(&workers[i], NULL, batchWorker, (void*) &job)) {
+      printf("ERROR: create batch threads failed");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (int i = 0; i < numThreads; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  free(workers);
+}
+
+// maps path for parallel parsing, returns false for inputs that have to be
+// streamed: stdin, compressed and empty files
+bool mapCorpus(MappedCorpus* corpus, const char* path, bool gzipInput) {
+  if (gzipInput || strcmp(path, "-") == 0 || isGzipPath(path)) {
+    return false;
+  }
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  void* text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (text == MAP_FAILED) {
+    return false;
+  }
+  madvise(text, st.st_size, MADV_SEQUENTIAL);
+  corpus->text = text;
+  corpus->size = st.st_size;
+  corpus->offset = 0;
+  return true;
+}
+
+void unmapCorpus(MappedCorpus* corpus) {
+  munmap((void*) corpus->text, corpus->size);
+}
+
+// parses the records of one range, counting them or storing them
+void* parseRangeWorker(void* arg) {
+  ParseRange* range = (ParseRange*) arg;
+  int cells[MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+  size_t pos = range->from;
+  int index = range->first;
+  size_t cell = range->firstCell;
+  for (;;) {
+    size_t used;
+    int psize = scanPuzzleRecord(range->text + pos, range->to - pos, true, &used, cells);
+    pos += used;
+    if (psize == 0) {
+      break;
+    }
+    if (range->store) {
+      putInBatch(range->batch, index++, cell, psize, cells);
+      cell += psize > 0 ? (size_t) psize * psize : 0;
+      continue;
+    }
+    range->count++;
+    if (psize > 0) {
+      range->cellCount += (size_t) psize * psize;
+    }
+    else {
+      range->malformed++;
+    }
+  }
+  return NULL;
+}
+
+// runs fn over every range, one thread each
+static void runParseRanges(ParseRange* ranges, int count, void* (*fn)(void*)) {
+  pthread_t* threads = malloc(sizeof(pthread_t) * count);
+  if (threads == NULL) {
+    printf("ERROR: out of memory for parser threads\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int t = 0; t < count; t++) {
+    if (pthread_create(&threads[t], NULL, fn, (void*) &ranges[t])) {
+      printf("ERROR: create parser threads failed");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (int t = 0; t < count; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  free(threads);
+}
+
+// cuts the next window of a mapped corpus into numThreads byte ranges that
+// start at record boundaries, *to is set to the end of the window
+static ParseRange* splitCorpusWindow(MappedCorpus* corpus, PuzzleBatch* batch, int numThreads, size_t* to) {
+  bool found;
+  size_t from = corpus->offset;
+  size_t limit = corpus->size - from > PARSE_WINDOW_BYTES ? from + PARSE_WINDOW_BYTES : corpus->size;
+  *to = findRecordStart(corpus->text, corpus->size, limit, true, &found);
+  ParseRange* ranges = calloc(numThreads, sizeof(ParseRange));
+  if (ranges == NULL) {
+    printf("ERROR: out of memory for parser ranges\n");
+    exit(EXIT_FAILURE);
+  }
+  size_t step = (*to - from) / numThreads;
+  for (int t = 0; t < numThreads; t++) {
+    ranges[t].text = corpus->text;
+    ranges[t].size = corpus->size;
+    ranges[t].batch = batch;
+    ranges[t].from = t == 0 ? from : ranges[t - 1].to;
+    size_t end = t == numThreads - 1 ? *to : findRecordStart(corpus->text, corpus->size, from + step * (t + 1), true, &found);
+    ranges[t].to = end > ranges[t].from ? (end < *to ? end : *to) : ranges[t].from;
+  }
+  return ranges;
+}
+
+// parses the next window of a mapped corpus into batch on numThreads threads
+// the window is cut into byte ranges at record boundaries, a first pass counts
+// the records of each range, the prefix sums of the counts place every range
+// in the batch, and a second pass parses each range straight into its slots
+// returns false once the corpus is used up
+bool parseCorpusWindow(MappedCorpus* corpus, PuzzleBatch* batch, int numThreads, long* malformed) {
+  size_t to;
+  ParseRange* ranges = splitCorpusWindow(corpus, batch, numThreads, &to);
+  runParseRanges(ranges, numThreads, parseRangeWorker);
+
+  int count = 0;
+  size_t cellCount = 0;
+  for (int t = 0; t < numThreads; t++) {
+    ranges[t].first = count;
+    ranges[t].firstCell = cellCount;
+    ranges[t].store = true;
+    count += ranges[t].count;
+    cellCount += ranges[t].cellCount;
+    *malformed += ranges[t].malformed;
+  }
+  reservePuzzleBatch(batch, count, cellCount);
+  runParseRanges(ranges, numThreads, parseRangeWorker);
+  batch->count = count;
+  batch->cellCount = cellCount;
+  free(ranges);
+  corpus->offset = to;
+  return to < corpus->size;
+}
+
+// length of an 81 character puzzle line
+#define LINE9_LENGTH 81
+
+// verdict of a complete 9x9 puzzle from the units that hold all of 1..9,
+// bit u of rowOk, colOk and boxOk stands for unit u
+static void lineVerdict(unsigned rowOk, unsigned colOk, unsigned boxOk, bool complete,
+                        PuzzleResult* result) {
+  result->loaded = true;
+  result->complete = complete;
+  result->valid = complete && (rowOk & colOk & boxOk) == 0x1FF;
+  result->failingUnit = UNIT_NONE;
+  result->failingIndex = 0;
+  if (complete && !result->valid) {
+    if (rowOk != 0x1FF) {
+      result->failingUnit = UNIT_ROW;
+      result->failingIndex = __builtin_ctz(~rowOk) + 1;
+    }
+    else if (colOk != 0x1FF) {
+      result->failingUnit = UNIT_COLUMN;
+      result->failingIndex = __builtin_ctz(~colOk) + 1;
+    }
+    else {
+      result->failingUnit = UNIT_BOX;
+      result->failingIndex = __builtin_ctz(~boxOk) + 1;
+    }
+  }
+}
+
+// portable line kernel, validates a puzzle straight from its 81 characters
+// returns false if a character is not a digit or '.', leaving result alone
+static bool checkLine9Generic(const char* line, PuzzleResult* result) {
+  unsigned short rows[9] = {0};
+  unsigned short cols[9] = {0};
+  unsigned short boxes[9] = {0};
+  bool complete = true;
+  for (int c = 0; c < LINE9_LENGTH; c++) {
+    unsigned value = (unsigned char) line[c] - '0';
+    if (value > 9 && line[c] != '.') {
+      return false;
+    }
+    if (value == 0 || value > 9) {
+      complete = false;
+      continue;
+    }
+    unsigned short bit = 1 << (value - 1);
+    rows[c / 9] |= bit;
+    cols[c % 9] |= bit;
+    boxes[(c / 27) * 3 + (c % 9) / 3] |= bit;
+  }
+  unsigned rowOk = 0;
+  unsigned colOk = 0;
+  unsigned boxOk = 0;
+  for (int u = 0; u < 9; u++) {
+    rowOk |= (unsigned) (rows[u] == 0x1FF) << u;
+    colOk |= (unsigned) (cols[u] == 0x1FF) << u;
+    boxOk |= (unsigned) (boxes[u] == 0x1FF) << u;
+  }
+  lineVerdict(rowOk, colOk, boxOk, complete, result);
+  return true;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// SSSE3 line kernel, one row of the puzzle per register, read straight from
+// the text with '0' subtracted in the register, reads 7 bytes past the line
+// the digit-to-bit lookup is the one of the tile kernels, a byte shuffle into
+// a low mask for 1..8 and a high mask for 9, ORs of neighbouring lanes give
+// the box triplets in lanes 0, 3 and 6 and the whole row in lane 0
+__attribute__((target("ssse3")))
+static bool checkLine9Ssse3(const char* line, PuzzleResult* result) {
+  const __m128i loTable = _mm_setr_epi8(0, 1, 2, 4, 8, 16, 32, 64, (char) 128, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i hiTable = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0);
+  const __m128i zeroChar = _mm_set1_epi8('0');
+  const __m128i dot = _mm_set1_epi8('.');
+  const __m128i nine = _mm_set1_epi8(9);
+  const __m128i ten = _mm_set1_epi8(10);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i allBits = _mm_set1_epi8(-1);
+  const __m128i one = _mm_set1_epi8(1);
+  __m128i colLo = zero;
+  __m128i colHi = zero;
+  __m128i boxLo = zero;
+  __m128i boxHi = zero;
+  __m128i empty = zero;
+  __m128i bad = zero;
+  unsigned rowOk = 0;
+  unsigned boxOk = 0;
+  for (int r = 0; r < 9; r++) {
+    __m128i text = _mm_loadu_si128((const __m128i*) (line + r * 9));
+    __m128i digit = _mm_sub_epi8(text, zeroChar);
+    bad = _mm_or_si128(bad, _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(digit, nine), digit),
+                                                          _mm_cmpeq_epi8(text, dot)), allBits));
+    // '.' and anything else outside 0..9 index an empty table entry
+    __m128i v = _mm_min_epu8(digit, ten);
+    __m128i lo = _mm_shuffle_epi8(loTable, v);
+    __m128i hi = _mm_shuffle_epi8(hiTable, v);
+    empty = _mm_or_si128(empty, _mm_cmpeq_epi8(_mm_or_si128(lo, hi), zero));
+    colLo = _mm_or_si128(colLo, lo);
+    colHi = _mm_or_si128(colHi, hi);
+    __m128i tripleLo = _mm_or_si128(lo, _mm_or_si128(_mm_srli_si128(lo, 1), _mm_srli_si128(lo, 2)));
+    __m128i tripleHi = _mm_or_si128(hi, _mm_or_si128(_mm_srli_si128(hi, 1), _mm_srli_si128(hi, 2)));
+    __m128i rowLo = _mm_or_si128(tripleLo, _mm_or_si128(_mm_srli_si128(tripleLo, 3), _mm_srli_si128(tripleLo, 6)));
+    __m128i rowHi = _mm_or_si128(tripleHi, _mm_or_si128(_mm_srli_si128(tripleHi, 3), _mm_srli_si128(tripleHi, 6)));
+    unsigned full = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(rowLo, allBits), _mm_cmpeq_epi8(rowHi, one)));
+    rowOk |= (full & 1) << r;
+    boxLo = _mm_or_si128(boxLo, tripleLo);
+    boxHi = _mm_or_si128(boxHi, tripleHi);
+    if (r % 3 == 2) {
+      full = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(boxLo, allBits), _mm_cmpeq_epi8(boxHi, one)));
+      boxOk |= ((full & 1) | (full >> 2 & 2) | (full >> 4 & 4)) << (r - 2);
+      boxLo = zero;
+      boxHi = zero;
+    }
+  }
+  if (_mm_movemask_epi8(bad) & 0x1FF) {
+    return false;
+  }
+  unsigned colOk = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(colLo, allBits),
+                                                   _mm_cmpeq_epi8(colHi, one))) & 0x1FF;
+  lineVerdict(rowOk, colOk, boxOk, (_mm_movemask_epi8(empty) & 0x1FF) == 0, result);
+  return true;
+}
+#endif
+
+// whether the record at pos is an 81 character line, which always makes
+// exactly one record: a puzzle, or a malformed line
+static inline bool isLine9At(const char* text, size_t pos, size_t to) {
+  return pos + LINE9_LENGTH <= to && !isBlank(text[pos + LINE9_LENGTH - 1])
+         && (pos + LINE9_LENGTH == to || text[pos + LINE9_LENGTH] == '\n')
+         && memchr(text + pos, '\n', LINE9_LENGTH) == NULL;
+}
+
+// validates the records of one range without building any puzzle
+// the first pass only counts records, 81 character lines by their length,
+// the second checks those lines straight from the mapped text and parses
+// anything else for the serial kernel, leaving verdicts from the given slot on
+void* validateRangeWorker(void* arg) {
+  ParseRange* range = (ParseRange*) arg;
+  int cells[MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+  unsigned char bytes[MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+#if defined(__x86_64__) || defined(__i386__)
+  bool ssse3 = __builtin_cpu_supports("ssse3");
+#endif
+  const char* text = range->text;
+  PuzzleResult* results = range->batch->results;
+  long long start = nowNanos();
+  int index = range->first;
+  size_t pos = range->from;
+  while (pos < range->to) {
+    if (isBlank(text[pos])) {
+      pos++;
+      continue;
+    }
+    if (isLine9At(text, pos, range->to)) {
+      if (!range->store) {
+        range->count++;
+        pos += LINE9_LENGTH;
+        continue;
+      }
+      bool checked;
+#if defined(__x86_64__) || defined(__i386__)
+      if (ssse3 && pos + 8 * 9 + 16 <= range->size) {
+        checked = checkLine9Ssse3(text + pos, &results[index]);
+      }
+      else {
+        checked = checkLine9Generic(text + pos, &results[index]);
+      }
+#else
+      checked = checkLine9Generic(text + pos, &results[index]);
+#endif
+      if (checked) {
+        index++;
+        pos += LINE9_LENGTH;
+        continue;
+      }
+    }
+    size_t used;
+    int psize = scanPuzzleRecord(text + pos, range->to - pos, true, &used, cells);
+    pos += used;
+    if (psize == 0) {
+      break;
+    }
+    if (!range->store) {
+      range->count++;
+      continue;
+    }
+    if (psize < 0) {
+      range->malformed++;
+      results[index++].loaded = false;
+      continue;
+    }
+    for (int i = 0; i < psize * psize; i++) {
+      bytes[i] = cells[i] >= 0 && cells[i] <= psize ? cells[i] : BATCH_BAD_CELL;
+    }
+    checkCellsSerial(psize, bytes, &results[index++]);
+  }
+  if (range->store && range->count > 0) {
+    long long share = (nowNanos() - start) / range->count;
+    for (int i = range->first; i < index; i++) {
+      results[i].nanos = share;
+    }
+  }
+  return NULL;
+}
+
+// validates the next window of a mapped corpus on numThreads threads without
+// parsing it into the batch, only the verdicts land in it, in corpus order
+// returns false once the corpus is used up
+bool validateCorpusWindow(MappedCorpus* corpus, PuzzleBatch* batch, int numThreads, long* malformed) {
+  size_t to;
+  ParseRange* ranges = splitCorpusWindow(corpus, batch, numThreads, &to);
+  runParseRanges(ranges, numThreads, validateRangeWorker);
+  int count = 0;
+  for (int t = 0; t < numThreads; t++) {
+    ranges[t].first = count;
+    ranges[t].store = true;
+    count += ranges[t].count;
+  }
+  reservePuzzleBatch(batch, count, 0);
+  runParseRanges(ranges, numThreads, validateRangeWorker);
+  for (int t = 0; t < numThreads; t++) {
+    *malformed += ranges[t].malformed;
+  }
+  batch->count = count;
+  free(ranges);
+  corpus->offset = to;
+  return to < corpus->size;
+}
+
+// hash of the input paths of a run, so a checkpoint is only resumed by the same run
+unsigned long long hashPathList(PathList* paths) {
+  unsigned long long hash = 0xCBF29CE484222325ULL;
+  for (int p = 0; p < paths->count; p++) {
+    for (const char* c = paths->items[p]; ; c++) {
+      hash = (hash ^ (unsigned char) *c) * 0x100000001B3ULL;
+      if (*c == '\0') {
+        break;
+      }
+    }
+  }
+  return hash;
+}
+
+// reads the checkpoint at path, returns false if there is none or it is damaged
+bool loadCheckpoint(const char* path, Checkpoint* checkpoint) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  bool ok = fread(checkpoint, sizeof(*checkpoint), 1, file) == 1
+            && memcmp(checkpoint->magic, CHECKPOINT_MAGIC, 8) == 0
+            && checkpoint->version == CHECKPOINT_VERSION;
+  fclose(file);
+  return ok;
+}
+
+// replaces the checkpoint at path, through a temporary file renamed over it
+// so a run stopped at any moment leaves either the old or the new checkpoint
+bool saveCheckpoint(const char* path, Checkpoint* checkpoint) {
+  char temp[PATH_MAX];
+  if (snprintf(temp, sizeof(temp), "%s.tmp", path) >= (int) sizeof(temp)) {
+    return false;
+  }
+  memcpy(checkpoint->magic, CHECKPOINT_MAGIC, 8);
+  checkpoint->version = CHECKPOINT_VERSION;
+  int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = write(fd, checkpoint, sizeof(*checkpoint)) == sizeof(*checkpoint) && fsync(fd) == 0;
+  close(fd);
+  return ok && rename(temp, path) == 0;
+}
+
+// batch mode, every path is a corpus of puzzles in either format
+// puzzles are read BATCH_CHUNK_PUZZLES at a time, validated across numThreads
+// workers and written in input order, then throughput is reported on stderr
+// plain files are mapped and parsed PARSE_WINDOW_BYTES at a time on numThreads threads,
+// without a result cache or a solver they are validated straight from the mapped text
+// incomplete puzzles are completed by the workers when a solver is given
+// with a checkpoint path, progress is saved every CHECKPOINT_INTERVAL_NANOS and
+// a run finding a checkpoint from the same inputs continues where it stopped
+// returns the number of malformed records, or -1 if an input cannot be opened
+long validateCorpora(PathList* paths, int numThreads, bool gzipInput, DiskCache* diskCache,
+                     const char* checkpointPath, OutputFormat format, const SolveOptions* solve) {
+  int cells[MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+  ResultWriter* writer = malloc(sizeof(ResultWriter));
+  initResultWriter(writer, stdout, format);
+  setResultSolving(writer, solve);
+  PuzzleBatch batch;
+  initPuzzleBatch(&batch);
+  batch.solve = writer->solving ? solve : NULL;
+  batch.diskCache = diskCache;
+  long id = 0;
+  long failures = 0;
+  long long validateNanos = 0;
+  SolveStats stats = {0, 0, 0, 0, 0, {0}};
+  long long start = nowNanos();
+  long long lastCheckpoint = start;
+  int firstPath = 0;
+  long long firstOffset = 0;
+
+  Checkpoint checkpoint;
+  if (checkpointPath != NULL && loadCheckpoint(checkpointPath, &checkpoint)) {
+    if (checkpoint.format != (int) format || checkpoint.pathsHash != hashPathList(paths)
+        || checkpoint.solver != (int) solve->kind || checkpoint.solveMode != (int) solve->mode
+        || checkpoint.solveLimit != solve->limit || checkpoint.nodeBudget != solve->nodeBudget
+        || checkpoint.timeBudget != solve->timeBudget) {
+      fprintf(diagnosticOutput(format), "Checkpoint %s belongs to a different run\n", checkpointPath);
+      free(writer);
+      freePuzzleBatch(&batch);
+      return -1;
+    }
+    // drop output written after the checkpoint, it is produced again
+    struct stat st;
+    if (checkpoint.outputOffset >= 0 && fstat(fileno(stdout), &st) == 0 && S_ISREG(st.st_mode)) {
+      if (st.st_size < checkpoint.outputOffset) {
+        fprintf(diagnosticOutput(format), "Output is shorter than checkpoint %s records, append to it with >>\n",
+                checkpointPath);
+        free(writer);
+        freePuzzleBatch(&batch);
+        return -1;
+      }
+      if (ftruncate(fileno(stdout), checkpoint.outputOffset) == 0) {
+        fseeko(stdout, checkpoint.outputOffset, SEEK_SET);
+      }
+    }
+    firstPath = checkpoint.pathIndex;
+    firstOffset = checkpoint.inputOffset;
+    id = checkpoint.written;
+    failures = checkpoint.failures;
+    validateNanos = checkpoint.validateNanos;
+    stats = checkpoint.solveStats;
+    fprintf(stderr, "batch: resuming after %ld puzzles\n", id);
+  }
+  else {
+    writeResultHeader(writer);
+    if (checkpointPath != NULL) {
+      // a run stopped before its first interval resumes after the header
+      // instead of writing it again
+      flushResultWriter(writer);
+      memset(&checkpoint, 0, sizeof(checkpoint));
+      checkpoint.format = format;
+      checkpoint.pathsHash = hashPathList(paths);
+      checkpoint.solver = solve->kind;
+      checkpoint.solveMode = solve->mode;
+      checkpoint.solveLimit = solve->limit;
+      checkpoint.nodeBudget = solve->nodeBudget;
+      checkpoint.timeBudget = solve->timeBudget;
+      checkpoint.outputOffset = ftello(stdout);
+      if (!saveCheckpoint(checkpointPath, &checkpoint)) {
+        fprintf(stderr, "batch: could not write checkpoint %s\n", checkpointPath);
+      }
+    }
+  }
+
+  for (int p = firstPath; p < paths->count && failures >= 0; p++) {
+    PuzzleSource source;
+    MappedCorpus corpus;
+    bool zeroCopy = diskCache == NULL && batch.solve == NULL;
+    bool mapped = (numThreads > 1 || zeroCopy) && mapCorpus(&corpus, paths->items[p], gzipInput);
+    if (!mapped && (!openPuzzleSource(&source, paths->items[p], gzipInput)
+        || (p == firstPath && firstOffset > 0 && !skipPuzzleSource(&source, firstOffset)))) {
+      flushResultWriter(writer);
+      fprintf(diagnosticOutput(format), "Could not open file %s\n", paths->items[p]);
+      failures = -1;
+      break;
+    }
+    if (mapped && p == firstPath) {
+      corpus.offset = (size_t) firstOffset < corpus.size ? (size_t) firstOffset : corpus.size;
+    }
+    bool more = true;
+    while (more) {
+      clearPuzzleBatch(&batch);
+      long long validateStart = nowNanos();
+      if (mapped && zeroCopy) {
+        more = validateCorpusWindow(&corpus, &batch, numThreads, &failures);
+      }
+      else if (mapped) {
+        more = parseCorpusWindow(&corpus, &batch, numThreads, &failures);
+      }
+      while (!mapped && batch.count < BATCH_CHUNK_PUZZLES) {
+        int psize = nextPuzzle(&source.stream, cells);
+        if (psize == 0 || psize == -2) {
+          if (psize == -2) {
+            flushResultWriter(writer);
+            fprintf(stderr, "ERROR: reading %s failed\n", paths->items[p]);
+            failures++;
+          }
+          more = false;
+          break;
+        }
+        if (psize < 0) {
+          failures++;
+        }
+        addToBatch(&batch, psize, cells);
+      }
+
+      if (!mapped || !zeroCopy) {
+        validateStart = nowNanos();
+        validateBatch(&batch, numThreads);
+      }
+      validateNanos += nowNanos() - validateStart;
+
+      for (int i = 0; i < batch.count; i++) {
+        writeResultRecord(writer, NULL, ++id, &batch.results[i]);
+        if (writer->solving) {
+          addSolveStats(&stats, &batch.results[i]);
+        }
+      }
+
+      if (checkpointPath != NULL && nowNanos() - lastCheckpoint >= CHECKPOINT_INTERVAL_NANOS) {
+        flushResultWriter(writer);
+        checkpoint.format = format;
+        checkpoint.pathsHash = hashPathList(paths);
+        checkpoint.pathIndex = p;
+        checkpoint.inputOffset = mapped ? (long long) corpus.offset : source.stream.position;
+        checkpoint.written = id;
+        checkpoint.failures = failures;
+        checkpoint.validateNanos = validateNanos;
+        checkpoint.solveStats = stats;
+        checkpoint.outputOffset = ftello(stdout);
+        if (!saveCheckpoint(checkpointPath, &checkpoint)) {
+          fprintf(stderr, "batch: could not write checkpoint %s\n", checkpointPath);
+        }
+        lastCheckpoint = nowNanos();
+      }
+    }
+    if (mapped) {
+      unmapCorpus(&corpus);
+    }
+    else {
+      closePuzzleSource(&source);
+    }
+  }
+  flushResultWriter(writer);
+  free(writer);
+  freePuzzleBatch(&batch);
+  // a finished run has nothing to resume
+  if (checkpointPath != NULL && failures >= 0) {
+    unlink(checkpointPath);
+  }
+
+  double seconds = (nowNanos() - start) / 1e9;
+  double validateSeconds = validateNanos / 1e9;
+  fprintf(stderr, "batch: %ld puzzles in %.3f s, %.0f puzzles/s overall, %.0f puzzles/s validating\n",
+          id, seconds, seconds > 0 ? id / seconds : 0.0,
+          validateSeconds > 0 ? id / validateSeconds : 0.0);
+  printCacheStats(solve->cache, diskCache);
+  printSolveStats(&stats, solve);
+  return failures;
+}
+
+// sets up a queue holding up to capacity items, capacity must be a power of two
+void initBlockQueue(BlockQueue* queue, size_t capacity) {
+  memset(queue, 0, sizeof(*queue));
+  queue->sequences = malloc(capacity * sizeof(size_t));
+  queue->items = malloc(capacity * sizeof(void*));
+  if (queue->sequences == NULL || queue->items == NULL) {
+    printf("ERROR: out of memory for pipeline queue\n");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < capacity; i++) {
+    queue->sequences[i] = i;
+  }
+  queue->mask = capacity - 1;
+}
+
+void freeBlockQueue(BlockQueue* queue) {
+  free(queue->sequences);
+  free(queue->items);
+}
+
+// adds item to the queue, returns false if the queue is full
+bool tryPushQueue(BlockQueue* queue, void* item) {
+  size_t pos = __atomic_load_n(&queue->enqueuePos, __ATOMIC_RELAXED);
+  for (;;) {
+    size_t seq = __atomic_load_n(&queue->sequences[pos & queue->mask], __ATOMIC_ACQUIRE);
+    long diff = (long) seq - (long) pos;
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&queue->enqueuePos, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    }
+    else if (diff < 0) {
+      return false;
+    }
+    else {
+      pos = __atomic_load_n(&queue->enqueuePos, __ATOMIC_RELAXED);
+    }
+  }
+  queue->items[pos & queue->mask] = item;
+  __atomic_store_n(&queue->sequences[pos & queue->mask], pos + 1, __ATOMIC_RELEASE);
+
+  // record the depth for tuning, a slightly stale dequeue position is fine here
+  size_t depth = pos + 1 - __atomic_load_n(&queue->dequeuePos, __ATOMIC_RELAXED);
+  size_t high = __atomic_load_n(&queue->highWater, __ATOMIC_RELAXED);
+  while (depth > high && !__atomic_compare_exchange_n(&queue->highWater, &high, depth, true,
+                                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+  return true;
+}
+
+// takes the oldest item from the queue, returns NULL if the queue is empty
+void* tryPopQueue(BlockQueue* queue) {
+  size_t pos = __atomic_load_n(&queue->dequeuePos, __ATOMIC_RELAXED);
+  for (;;) {
+    size_t seq = __atomic_load_n(&queue->sequences[pos & queue->mask], __ATOMIC_ACQUIRE);
+    long diff = (long) seq - (long) (pos + 1);
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&queue->dequeuePos, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    }
+    else if (diff < 0) {
+      return NULL;
+    }
+    else {
+      pos = __atomic_load_n(&queue->dequeuePos, __ATOMIC_RELAXED);
+    }
+  }
+  void* item = queue->items[pos & queue->mask];
+  __atomic_store_n(&queue->sequences[pos & queue->mask], pos + queue->mask + 1, __ATOMIC_RELEASE);
+  return item;
+}
+
+// waits a little longer each time a stage finds nothing to do
+void pipelineBackoff(int* idle) {
+  if (*idle < 16) {
+    sched_yield();
+  }
+  else {
+    struct timespec pause = {0, 50000};
+    nanosleep(&pause, NULL);
+  }
+  (*idle)++;
+}
+
+// adds item to the queue, waiting while it is full
+void pushQueue(BlockQueue* queue, void* item) {
+  int idle = 0;
+  while (!tryPushQueue(queue, item)) {
+    pipelineBackoff(&idle);
+  }
+}
+
+// takes the next item from the queue, waiting while it is empty
+// returns NULL once the queue is empty and *producersDone is set
+void* popQueue(BlockQueue* queue, bool* producersDone) {
+  int idle = 0;
+  for (;;) {
+    void* item = tryPopQueue(queue);
+    if (item != NULL) {
+      return item;
+    }
+    // producers push before they finish, so one more look after seeing
+    // the done flag cannot miss an item
+    if (__atomic_load_n(producersDone, __ATOMIC_ACQUIRE)) {
+      return tryPopQueue(queue);
+    }
+    pipelineBackoff(&idle);
+  }
+}
+
+// finds the first record that starts at or after pos in buf[0..len)
+// records start on a line holding a single token: a size header or a line
+// format puzzle, rows of the matrix format hold several numbers
+// a line running into the end of the buffer only counts when eof is set
+// returns the offset of the record, or len with *found false if there is none
+size_t findRecordStart(const char* buf, size_t len, size_t pos, bool eof, bool* found) {
+  *found = false;
+  if (pos > 0 && pos < len && buf[pos - 1] != '\n') {
+    while (pos < len && buf[pos] != '\n') {
+      pos++;
+    }
+    pos++;
+  }
+  while (pos < len) {
+    size_t lineEnd = pos;
+    while (lineEnd < len && buf[lineEnd] != '\n') {
+      lineEnd++;
+    }
+    if (lineEnd == len && !eof) {
+      return len;
+    }
+    int tokens = 0;
+    for (size_t i = pos; i < lineEnd; i++) {
+      if (!isBlank(buf[i]) && (i == pos || isBlank(buf[i - 1]))) {
+        tokens++;
+      }
+    }
+    if (tokens == 1) {
+      *found = true;
+      return pos;
+    }
+    pos = lineEnd + 1;
+  }
+  if (eof) {
+    *found = true;
+  }
+  return len;
+}
+
+// opens the pipeline's next input, returns false when there are no more
+// called with readLock held
+bool openNextPipelineInput(Pipeline* pipe) {
+  while (pipe->fileIndex < pipe->paths->count) {
+    const char* path = pipe->paths->items[pipe->fileIndex];
+    struct stat st;
+    int fd = -1;
+    if (strcmp(path, "-") != 0 && !pipe->gzipInput && !isGzipPath(path)) {
+      fd = open(path, O_RDONLY);
+    }
+    if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+      pipe->seekable = true;
+      pipe->fd = fd;
+      pipe->fds[pipe->fileIndex] = fd;
+      pipe->fileSize = st.st_size;
+      pipe->fileOffset = 0;
+      pipe->sourceOpen = true;
+      return true;
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+    if (openPuzzleSource(&pipe->source, path, pipe->gzipInput)) {
+      pipe->seekable = false;
+      pipe->carryLen = 0;
+      pipe->sourceOpen = true;
+      return true;
+    }
+    fprintf(stderr, "Could not open file %s\n", path);
+    __atomic_add_fetch(&pipe->failures, 1, __ATOMIC_RELAXED);
+    pipe->fileIndex++;
+  }
+  return false;
+}
+
+// moves on from the current input once it has been read completely
+// called with readLock held
+void finishPipelineInput(Pipeline* pipe) {
+  if (!pipe->seekable) {
+    closePuzzleSource(&pipe->source);
+  }
+  pipe->sourceOpen = false;
+  pipe->fileIndex++;
+}
+
+// waits until block seq fits within depth blocks of the writer,
+// which bounds the memory held by the pipeline
+void waitForPipelineCredit(Pipeline* pipe, long seq) {
+  int idle = 0;
+  while (seq >= __atomic_load_n(&pipe->written, __ATOMIC_ACQUIRE) + (long) pipe->depth) {
+    pipelineBackoff(&idle);
+  }
+}
+
+// reads the records starting in [from, to) of a regular file into block
+// the owned range is widened at both ends to whole records
+void readPipelineRange(int fd, off_t size, off_t from, off_t to, PipelineBlock* block) {
+  // start one byte early so a record start at 'from' can be told from the middle of a line
+  off_t base = from > 0 ? from - 1 : 0;
+  size_t capacity = (to - base) + PIPELINE_READ_AHEAD;
+  size_t len = 0;
+  char* text = malloc(capacity);
+  if (text == NULL) {
+    printf("ERROR: out of memory for pipeline block\n");
+    exit(EXIT_FAILURE);
+  }
+  bool found;
+  size_t end;
+  for (;;) {
+    while (len < capacity && base + (off_t) len < size) {
+      ssize_t got = pread(fd, text + len, capacity - len, base + len);
+      if (got <= 0) {
+        if (got < 0 && errno == EINTR) {
+          continue;
+        }
+        size = base + len;
+        break;
+      }
+      len += got;
+    }
+    bool eof = base + (off_t) len >= size;
+    end = findRecordStart(text, len, to - base, eof, &found);
+    if (found || eof) {
+      break;
+    }
+    capacity += PIPELINE_READ_AHEAD;
+    text = realloc(text, capacity);
+    if (text == NULL) {
+      printf("ERROR: out of memory for pipeline block\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  // the first record is the first one starting in the range
+  size_t start = from == 0 ? 0 : findRecordStart(text, len, from - base, true, &found);
+  block->text = text;
+  block->start = start < end ? start : end;
+  block->end = end;
+}
+
+// reads the next part of a sequential input into block, cut after the last
+// whole record, the rest is carried over to the next block
+// called with readLock held, returns true when the input is exhausted
+bool readPipelineStream(Pipeline* pipe, PipelineBlock* block) {
+  size_t capacity = pipe->carryLen + PIPELINE_BLOCK_SIZE;
+  char* text = malloc(capacity);
+  if (text == NULL) {
+    printf("ERROR: out of memory for pipeline block\n");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(text, pipe->carry, pipe->carryLen);
+  size_t len = pipe->carryLen;
+  PuzzleStream* stream = &pipe->source.stream;
+  bool eof = false;
+  size_t cut = 0;
+  for (;;) {
+    while (len < capacity) {
+      ssize_t got = stream->read(stream->source, text + len, capacity - len);
+      if (got <= 0) {
+        if (got < 0) {
+          fprintf(stderr, "ERROR: reading %s failed\n", pipe->paths->items[pipe->fileIndex]);
+          __atomic_add_fetch(&pipe->failures, 1, __ATOMIC_RELAXED);
+        }
+        eof = true;
+        break;
+      }
+      len += got;
+    }
+    if (eof) {
+      cut = len;
+      break;
+    }
+    // cut at the start of the last record, it may continue in the next read
+    size_t pos = 0;
+    size_t last = 0;
+    bool found;
+    while ((pos = findRecordStart(text, len, pos, false, &found)) < len && found) {
+      last = pos;
+      pos++;
+    }
+    if (last > 0) {
+      cut = last;
+      break;
+    }
+    capacity += PIPELINE_BLOCK_SIZE;
+    text = realloc(text, capacity);
+    if (text == NULL) {
+      printf("ERROR: out of memory for pipeline block\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  pipe->carryLen = len - cut;
+  pipe->carry = realloc(pipe->carry, pipe->carryLen + 1);
+  if (pipe->carry == NULL) {
+    printf("ERROR: out of memory for pipeline block\n");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(pipe->carry, text + cut, pipe->carryLen);
+  block->text = text;
+  block->start = 0;
+  block->end = cut;
+  return eof;
+}
+
+// reader stage, claims the next block of the inputs in order and reads it
+void* pipelineReader(void* arg) {
+  Pipeline* pipe = (Pipeline*) arg;
+  for (;;) {
+    pthread_mutex_lock(&pipe->readLock);
+    if (!pipe->sourceOpen && !openNextPipelineInput(pipe)) {
+      pthread_mutex_unlock(&pipe->readLock);
+      break;
+    }
+    PipelineBlock* block = calloc(1, sizeof(PipelineBlock));
+    block->seq = pipe->nextSeq++;
+    waitForPipelineCredit(pipe, block->seq);
+    if (pipe->seekable) {
+      // claim a byte range, the read itself happens outside the lock
+      int fd = pipe->fd;
+      off_t size = pipe->fileSize;
+      off_t from = pipe->fileOffset;
+      off_t to = from + PIPELINE_BLOCK_SIZE < size ? from + PIPELINE_BLOCK_SIZE : size;
+      pipe->fileOffset = to;
+      if (to >= size) {
+        finishPipelineInput(pipe);
+      }
+      pthread_mutex_unlock(&pipe->readLock);
+      readPipelineRange(fd, size, from, to, block);
+    }
+    else {
+      if (readPipelineStream(pipe, block)) {
+        finishPipelineInput(pipe);
+      }
+      pthread_mutex_unlock(&pipe->readLock);
+    }
+    pushQueue(&pipe->parseQueue, block);
+  }
+  if (__atomic_sub_fetch(&pipe->activeReaders, 1, __ATOMIC_ACQ_REL) == 0) {
+    __atomic_store_n(&pipe->readersDone, true, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+// parser stage, turns the text of a block into a batch of puzzles
+void* pipelineParser(void* arg) {
+  Pipeline* pipe = (Pipeline*) arg;
+  int cells[MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+  PipelineBlock* block;
+  while ((block = popQueue(&pipe->parseQueue, &pipe->readersDone)) != NULL) {
+    initPuzzleBatch(&block->batch);
+    block->batch.solve = pipe->solve;
+    block->batch.diskCache = pipe->diskCache;
+    size_t pos = block->start;
+    for (;;) {
+      size_t used;
+      int psize = scanPuzzleRecord(block->text + pos, block->end - pos, true, &used, cells);
+      pos += used;
+      if (psize == 0) {
+        break;
+      }
+      addToBatch(&block->batch, psize, cells);
+    }
+    free(block->text);
+    block->text = NULL;
+    pushQueue(&pipe->validateQueue, block);
+  }
+  if (__atomic_sub_fetch(&pipe->activeParsers, 1, __ATOMIC_ACQ_REL) == 0) {
+    __atomic_store_n(&pipe->parsersDone, true, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+// validator stage, runs the serial kernel over every puzzle of a block and
+// completes the incomplete ones when the run solves
+void* pipelineValidator(void* arg) {
+  Pipeline* pipe = (Pipeline*) arg;
+  PipelineBlock* block;
+  while ((block = popQueue(&pipe->validateQueue, &pipe->parsersDone)) != NULL) {
+    validateBatchRange(&block->batch, 0, block->batch.count);
+    pushQueue(&pipe->writeQueue, block);
+  }
+  if (__atomic_sub_fetch(&pipe->activeValidators, 1, __ATOMIC_ACQ_REL) == 0) {
+    __atomic_store_n(&pipe->validatorsDone, true, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+// starts count threads running fn on the pipeline
+pthread_t* startPipelineStage(Pipeline* pipe, int count, void* (*fn)(void*)) {
+  pthread_t* threads = malloc(sizeof(pthread_t) * count);
+  if (threads == NULL) {
+    printf("ERROR: out of memory for pipeline threads\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < count; i++) {
+    if (pthread_create(&threads[i], NULL, fn, (void*) pipe)) {
+      printf("ERROR: create pipeline threads failed");
+      exit(EXIT_FAILURE);
+    }
+  }
+  return threads;
+}
+
+void joinPipelineStage(pthread_t* threads, int count) {
+  for (int i = 0; i < count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
+
+// batch mode as a staged pipeline: readers cut the corpora into record-aligned
+// blocks, parsers turn blocks into puzzles, validators check them and this
+// thread writes the results in input order, reordering blocks as needed
+// stages are connected by lock-free queues of the given depth
+// returns the number of malformed records and unreadable inputs
+long runPipeline(PathList* paths, bool gzipInput, int readers, int parsers, int validators,
+                 int depth, DiskCache* diskCache, OutputFormat format,
+                 const SolveOptions* solve) {
+  Pipeline pipe;
+  memset(&pipe, 0, sizeof(pipe));
+  pipe.paths = paths;
+  pipe.diskCache = diskCache;
+  pipe.gzipInput = gzipInput;
+  pipe.readers = readers;
+  pipe.parsers = parsers;
+  pipe.validators = validators;
+  pipe.depth = 1;
+  while ((int) pipe.depth < depth) {
+    pipe.depth *= 2;
+  }
+  initBlockQueue(&pipe.parseQueue, pipe.depth);
+  initBlockQueue(&pipe.validateQueue, pipe.depth);
+  initBlockQueue(&pipe.writeQueue, pipe.depth);
+  pthread_mutex_init(&pipe.readLock, NULL);
+  pipe.fds = malloc(paths->count * sizeof(int));
+  for (int i = 0; i < paths->count; i++) {
+    pipe.fds[i] = -1;
+  }
+  pipe.activeReaders = readers;
+  pipe.activeParsers = parsers;
+  pipe.activeValidators = validators;
+
+  ResultWriter* writer = malloc(sizeof(ResultWriter));
+  initResultWriter(writer, stdout, format);
+  setResultSolving(writer, solve);
+  writeResultHeader(writer);
+  pipe.solve = writer->solving ? solve : NULL;
+  SolveStats stats = {0, 0, 0, 0, 0, {0}};
+  long long start = nowNanos();
+
+  pthread_t* readerThreads = startPipelineStage(&pipe, readers, pipelineReader);
+  pthread_t* parserThreads = startPipelineStage(&pipe, parsers, pipelineParser);
+  pthread_t* validatorThreads = startPipelineStage(&pipe, validators, pipelineValidator);
+
+  // ordered writer, blocks arrive in any order and wait in pending
+  PipelineBlock** pending = calloc(pipe.depth, sizeof(PipelineBlock*));
+  long id = 0;
+  long malformed = 0;
+  PipelineBlock* block;
+  while ((block = popQueue(&pipe.writeQueue, &pipe.validatorsDone)) != NULL) {
+    pending[block->seq % pipe.depth] = block;
+    long next = pipe.written;
+    while ((block = pending[next % pipe.depth]) != NULL && block->seq == next) {
+      pending[next % pipe.depth] = NULL;
+      for (int i = 0; i < block->batch.count; i++) {
+        if (!block->batch.results[i].loaded) {
+          malformed++;
+        }
+        writeResultRecord(writer, NULL, ++id, &block->batch.results[i]);
+        if (writer->solving) {
+          addSolveStats(&stats, &block->batch.results[i]);
+        }
+      }
+      freePuzzleBatch(&block->batch);
+      free(block);
+      next++;
+      __atomic_store_n(&pipe.written, next, __ATOMIC_RELEASE);
+    }
+  }
+  flushResultWriter(writer);
+  free(writer);
+
+  joinPipelineStage(readerThreads, readers);
+  joinPipelineStage(parserThreads, parsers);
+  joinPipelineStage(validatorThreads, validators);
+
+  double seconds = (nowNanos() - start) / 1e9;
+  fprintf(stderr, "pipeline: %ld puzzles in %.3f s, %.0f puzzles/s\n",
+          id, seconds, seconds > 0 ? id / seconds : 0.0);
+  fprintf(stderr, "pipeline: %d readers, %d parsers, %d validators, queue depth %zu\n",
+          readers, parsers, validators, pipe.depth);
+  fprintf(stderr, "pipeline: peak queue use parse %zu, validate %zu, write %zu\n",
+          pipe.parseQueue.highWater, pipe.validateQueue.highWater, pipe.writeQueue.highWater);
+  printCacheStats(solve->cache, diskCache);
+  printSolveStats(&stats, solve);
+
+  for (int i = 0; i < paths->count; i++) {
+    if (pipe.fds[i] >= 0) {
+      close(pipe.fds[i]);
+    }
+  }
+  free(pipe.fds);
+  free(pipe.carry);
+  free(pending);
+  freeBlockQueue(&pipe.parseQueue);
+  freeBlockQueue(&pipe.validateQueue);
+  freeBlockQueue(&pipe.writeQueue);
+  pthread_mutex_destroy(&pipe.readLock);
+  return malformed + pipe.failures;
+}
+
+// body of shard worker k, validates the records of text[from, to), completing
+// incomplete ones when solve is not NULL, and puts their verdicts in results,
+// which has room for every record the range can hold
+void runShard(int k, const char* text, size_t from, size_t to, int numThreads, bool pin,
+              DiskCache* diskCache, const SolveOptions* solve,
+              PuzzleResult* results, ShardStats* stats) {
+  if (pin) {
+    int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c = 0; c < numThreads; c++) {
+      CPU_SET((k * numThreads + c) % cpus, &set);
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+  }
+  int cells[MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+  PuzzleBatch batch;
+  initPuzzleBatch(&batch);
+  batch.solve = solve;
+  batch.diskCache = diskCache;
+  size_t pos = from;
+  bool more = true;
+  while (more) {
+    clearPuzzleBatch(&batch);
+    while (batch.count < BATCH_CHUNK_PUZZLES) {
+      size_t used;
+      int psize = scanPuzzleRecord(text + pos, to - pos, true, &used, cells);
+      pos += used;
+      if (psize == 0) {
+        more = false;
+        break;
+      }
+      if (psize < 0) {
+        stats->malformed++;
+      }
+      addToBatch(&batch, psize, cells);
+    }
+    long long start = nowNanos();
+    validateBatch(&batch, numThreads);
+    stats->validateNanos += nowNanos() - start;
+    memcpy(results + stats->count, batch.results, batch.count * sizeof(PuzzleResult));
+    stats->count += batch.count;
+  }
+  freePuzzleBatch(&batch);
+  if (solve != NULL && solve->cache != NULL) {
+    stats->cacheHits = solve->cache->hits;
+    stats->cacheMisses = solve->cache->misses;
+  }
+  if (diskCache != NULL) {
+    stats->diskHits = diskCache->hits;
+    stats->diskMisses = diskCache->misses;
+    stats->diskStored = diskCache->stored;
+  }
+  __atomic_store_n(&stats->done, true, __ATOMIC_RELEASE);
+}
+
+// sharded batch mode, every path must be a regular corpus file, plain or gzip
+// each file is mapped, or inflated when compressed, and cut at record
+// boundaries into one shard per worker process, the workers put their
+// verdicts in a shared anonymous mapping and the coordinator writes them in
+// input order and merges the statistics
+// returns the number of malformed records, or -1 if an input or worker fails
+long validateSharded(PathList* paths, int numProcs, int numThreads, bool pin, DiskCache* diskCache,
+                     OutputFormat format, const SolveOptions* solve) {
+  ResultWriter* writer = malloc(sizeof(ResultWriter));
+  initResultWriter(writer, stdout, format);
+  setResultSolving(writer, solve);
+  writeResultHeader(writer);
+  SolveStats solveStats = {0, 0, 0, 0, 0, {0}};
+  int threadsPerProc = numThreads / numProcs > 0 ? numThreads / numProcs : 1;
+  ShardStats* stats = mmap(NULL, numProcs * sizeof(ShardStats), PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  size_t* bounds = malloc((numProcs + 1) * sizeof(size_t));
+  pid_t* pids = malloc(numProcs * sizeof(pid_t));
+  if (stats == MAP_FAILED || bounds == NULL || pids == NULL) {
+    printf("ERROR: out of memory for shard workers\n");
+    exit(EXIT_FAILURE);
+  }
+  ShardStats total;
+  memset(&total, 0, sizeof(total));
+  long id = 0;
+  long failures = 0;
+  long long start = nowNanos();
+
+  for (int p = 0; p < paths->count && failures >= 0; p++) {
+    const char* path = paths->items[p];
+    int fd = strcmp(path, "-") == 0 ? -1 : open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+      flushResultWriter(writer);
+      fprintf(diagnosticOutput(format), "Could not open file %s as a plain corpus\n", path);
+      if (fd >= 0) {
+        close(fd);
+      }
+      failures = -1;
+      break;
+    }
+    size_t size = st.st_size;
+    if (size == 0) {
+      close(fd);
+      continue;
+    }
+    const char* text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) {
+      flushResultWriter(writer);
+      fprintf(diagnosticOutput(format), "Could not map file %s\n", path);
+      failures = -1;
+      break;
+    }
+    // a compressed corpus is inflated up front, the workers share its pages after fork
+    char* inflated = NULL;
+    if (isGzipData(text, size)) {
+      size_t inflatedSize;
+      inflated = inflateBuffer(text, size, &inflatedSize);
+      munmap((void*) text, size);
+      if (inflated == NULL) {
+        flushResultWriter(writer);
+        fprintf(diagnosticOutput(format), "Could not inflate file %s\n", path);
+        failures = -1;
+        break;
+      }
+      if (inflatedSize == 0) {
+        free(inflated);
+        continue;
+      }
+      text = inflated;
+      size = inflatedSize;
+    }
+
+    // shard k owns the records starting in [bounds[k], bounds[k + 1])
+    bounds[0] = 0;
+    bounds[numProcs] = size;
+    for (int k = 1; k < numProcs; k++) {
+      bool found;
+      size_t at = findRecordStart(text, size, size / numProcs * k, true, &found);
+      bounds[k] = at > bounds[k - 1] ? at : bounds[k - 1];
+    }
+    // every record takes at least two bytes, so this bounds the records of a
+    // shard, pages of the mapping are only backed once a worker writes them
+    size_t slots = 0;
+    for (int k = 0; k < numProcs; k++) {
+      slots += (bounds[k + 1] - bounds[k]) / 2 + 1;
+    }
+    PuzzleResult* results = mmap(NULL, slots * sizeof(PuzzleResult), PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (results == MAP_FAILED) {
+      printf("ERROR: out of memory for shard results\n");
+      exit(EXIT_FAILURE);
+    }
+    memset(stats, 0, numProcs * sizeof(ShardStats));
+
+    flushResultWriter(writer);
+    fflush(stdout);
+    size_t slot = 0;
+    for (int k = 0; k < numProcs; k++) {
+      pids[k] = fork();
+      if (pids[k] < 0) {
+        printf("ERROR: fork of shard worker failed\n");
+        exit(EXIT_FAILURE);
+      }
+      if (pids[k] == 0) {
+        runShard(k, text, bounds[k], bounds[k + 1], threadsPerProc, pin, diskCache,
+                 writer->solving ? solve : NULL, results + slot, &stats[k]);
+        _exit(EXIT_SUCCESS);
+      }
+      slot += (bounds[k + 1] - bounds[k]) / 2 + 1;
+    }
+    bool lost = false;
+    for (int k = 0; k < numProcs; k++) {
+      int status;
+      while (waitpid(pids[k], &status, 0) < 0 && errno == EINTR) {
+      }
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0
+          || !__atomic_load_n(&stats[k].done, __ATOMIC_ACQUIRE)) {
+        lost = true;
+      }
+    }
+    if (lost) {
+      fprintf(diagnosticOutput(format), "ERROR: a shard worker for %s failed\n", path);
+      failures = -1;
+    }
+    else {
+      slot = 0;
+      for (int k = 0; k < numProcs; k++) {
+        for (long i = 0; i < stats[k].count; i++) {
+          writeResultRecord(writer, NULL, ++id, &results[slot + i]);
+          if (writer->solving) {
+            addSolveStats(&solveStats, &results[slot + i]);
+          }
+        }
+        slot += (bounds[k + 1] - bounds[k]) / 2 + 1;
+        failures += stats[k].malformed;
+        total.count += stats[k].count;
+        total.cacheHits += stats[k].cacheHits;
+        total.cacheMisses += stats[k].cacheMisses;
+        total.diskHits += stats[k].diskHits;
+        total.diskMisses += stats[k].diskMisses;
+        total.diskStored += stats[k].diskStored;
+        // the shards run side by side, so the slowest one is the validation time
+        if (stats[k].validateNanos > total.validateNanos) {
+          total.validateNanos = stats[k].validateNanos;
+        }
+      }
+    }
+    munmap(results, slots * sizeof(PuzzleResult));
+    if (inflated != NULL) {
+      free(inflated);
+    }
+    else {
+      munmap((void*) text, size);
+    }
+  }
+  flushResultWriter(writer);
+  free(writer);
+  free(bounds);
+  free(pids);
+  munmap(stats, numProcs * sizeof(ShardStats));
+
+  double seconds = (nowNanos() - start) / 1e9;
+  double validateSeconds = total.validateNanos / 1e9;
+  fprintf(stderr, "sharded: %ld puzzles over %d processes in %.3f s, %.0f puzzles/s overall, %.0f puzzles/s validating\n",
+          id, numProcs, seconds, seconds > 0 ? id / seconds : 0.0,
+          validateSeconds > 0 ? id / validateSeconds : 0.0);
+  if (solve->cache != NULL) {
+    fprintf(stderr, "cache: %ld hits, %ld misses\n", total.cacheHits, total.cacheMisses);
+  }
+  if (diskCache != NULL) {
+    fprintf(stderr, "disk cache: %ld hits, %ld misses, %ld results added, %llu grids in %llu index slots\n",
+            total.diskHits, total.diskMisses, total.diskStored,
+            diskCache->index->used, diskCache->index->capacity);
+  }
+  printSolveStats(&solveStats, solve);
+  return failures;
+}
+
+// big-endian encoding of protocol fields
+static void putU16(unsigned char* p, unsigned int v) {
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+static void putU32(unsigned char* p, unsigned int v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static void putU64(unsigned char* p, unsigned long long v) {
+  putU32(p, v >> 32);
+  putU32(p + 4, (unsigned int) v);
+}
+
+static unsigned int getU16(const unsigned char* p) {
+  return (unsigned int) p[0] << 8 | p[1];
+}
+
+static unsigned int getU32(const unsigned char* p) {
+  return (unsigned int) p[0] << 24 | (unsigned int) p[1] << 16 | (unsigned int) p[2] << 8 | p[3];
+}
+
+static unsigned long long getU64(const unsigned char* p) {
+  return (unsigned long long) getU32(p) << 32 | getU32(p + 4);
+}
+
+// writes all len bytes to a socket, returns false if the peer is gone
+bool sendAll(int fd, const void* buf, size_t len) {
+  const char* p = buf;
+  while (len > 0) {
+    ssize_t sent = send(fd, p, len, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    p += sent;
+    len -= sent;
+  }
+  return true;
+}
+
+// reads exactly len bytes from a socket, returns false if the peer is gone
+bool recvAll(int fd, void* buf, size_t len) {
+  char* p = buf;
+  while (len > 0) {
+    ssize_t got = recv(fd, p, len, 0);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return false;
+    }
+    p += got;
+    len -= got;
+  }
+  return true;
+}
+
+// reads one frame, growing *payload as needed
+// returns false if the peer is gone or sent a frame that is too large
+bool readFrame(int fd, unsigned int* type, unsigned long long* seq, unsigned char** payload,
+               size_t* capacity, size_t* len) {
+  unsigned char header[FRAME_HEADER_SIZE];
+  if (!recvAll(fd, header, FRAME_HEADER_SIZE)) {
+    return false;
+  }
+  *type = getU32(header);
+  *len = getU32(header + 4);
+  *seq = getU64(header + 8);
+  if (*len > NET_MAX_FRAME) {
+    return false;
+  }
+  if (*len > *capacity) {
+    *payload = realloc(*payload, *len);
+    if (*payload == NULL) {
+      printf("ERROR: out of memory for network frame\n");
+      exit(EXIT_FAILURE);
+    }
+    *capacity = *len;
+  }
+  return recvAll(fd, *payload, *len);
+}
+
+// fills the header at the start of frame
+static void putFrameHeader(unsigned char* frame, unsigned int type, size_t len, unsigned long long seq) {
+  putU32(frame, type);
+  putU32(frame + 4, len);
+  putU64(frame + 8, seq);
+}
+
+// resolves "host:port" or "port" into an IPv4 address, an empty or missing
+// host means the loopback address
+bool parseHostPort(const char* text, struct sockaddr_in* addr) {
+  char host[256] = "127.0.0.1";
+  const char* port = text;
+  const char* colon = strrchr(text, ':');
+  if (colon != NULL) {
+    size_t n = colon - text;
+    if (n >= sizeof(host)) {
+      return false;
+    }
+    if (n > 0) {
+      memcpy(host, text, n);
+      host[n] = '\0';
+    }
+    port = colon + 1;
+  }
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* found;
+  if (getaddrinfo(host, port, &hints, &found) != 0) {
+    return false;
+  }
+  memcpy(addr, found->ai_addr, sizeof(*addr));
+  freeaddrinfo(found);
+  return true;
+}
+
+// encodes the puzzles of a batch as a FRAME_BATCH frame
+unsigned char* encodeBatchFrame(PuzzleBatch* batch, long seq, size_t* frameLen) {
+  size_t len = 4 + batch->count + batch->cellCount;
+  unsigned char* frame = malloc(FRAME_HEADER_SIZE + len);
+  if (frame == NULL) {
+    printf("ERROR: out of memory for network frame\n");
+    exit(EXIT_FAILURE);
+  }
+  putFrameHeader(frame, FRAME_BATCH, len, seq);
+  unsigned char* p = frame + FRAME_HEADER_SIZE;
+  putU32(p, batch->count);
+  p += 4;
+  for (int i = 0; i < batch->count; i++) {
+    int psize = batch->sizes[i];
+    *p++ = psize > 0 ? psize : 0;
+    if (psize > 0) {
+      memcpy(p, batch->cells + batch->offsets[i], (size_t) psize * psize);
+      p += (size_t) psize * psize;
+    }
+  }
+  *frameLen = FRAME_HEADER_SIZE + len;
+  return frame;
+}
+
+// decodes a FRAME_BATCH payload into batch, returns false if it is truncated
+bool decodeBatchFrame(const unsigned char* payload, size_t len, PuzzleBatch* batch) {
+  int cells[MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+  if (len < 4) {
+    return false;
+  }
+  unsigned int count = getU32(payload);
+  size_t pos = 4;
+  clearPuzzleBatch(batch);
+  for (unsigned int i = 0; i < count; i++) {
+    if (pos >= len) {
+      return false;
+    }
+    int psize = payload[pos++];
+    size_t n = (size_t) psize * psize;
+    if (psize > MAX_PUZZLE_SIZE || pos + n > len) {
+      return false;
+    }
+    for (size_t c = 0; c < n; c++) {
+      cells[c] = payload[pos + c] == BATCH_BAD_CELL ? -1 : payload[pos + c];
+    }
+    pos += n;
+    addToBatch(batch, psize > 0 ? psize : -1, cells);
+  }
+  return true;
+}
+
+// encodes solve options as a FRAME_OPTIONS frame into frame
+void encodeOptionsFrame(const SolveOptions* solve, unsigned char* frame) {
+  putFrameHeader(frame, FRAME_OPTIONS, FRAME_OPTIONS_SIZE, 0);
+  unsigned char* p = frame + FRAME_HEADER_SIZE;
+  p[0] = solve->kind;
+  p[1] = solve->mode;
+  putU16(p + 2, solve->threads);
+  putU64(p + 4, solve->limit);
+  putU64(p + 12, solve->nodeBudget);
+  putU64(p + 20, solve->timeBudget);
+}
+
+// decodes a FRAME_OPTIONS payload, returns false if it is not valid
+bool decodeOptionsFrame(const unsigned char* payload, size_t len, SolveOptions* solve) {
+  if (len != FRAME_OPTIONS_SIZE || payload[0] > SOLVER_PORTFOLIO || payload[1] > SOLVE_ALL) {
+    return false;
+  }
+  solve->kind = payload[0];
+  solve->mode = payload[1];
+  solve->threads = getU16(payload + 2) > 0 ? getU16(payload + 2) : 1;
+  solve->limit = getU64(payload + 4);
+  solve->nodeBudget = getU64(payload + 12);
+  solve->timeBudget = getU64(payload + 20);
+  return true;
+}
+
+// packs the verdict of one puzzle for a FRAME_VERDICTS payload, with its
+// solve outcome when solving, returns the bytes written
+size_t encodeVerdict(const PuzzleResult* result, bool solving, unsigned char* p) {
+  p[0] = (result->loaded ? 1 : 0) | (result->complete ? 2 : 0) | (result->valid ? 4 : 0);
+  p[1] = result->failingUnit;
+  putU16(p + 2, result->failingIndex);
+  putU32(p + 4, result->nanos < 0xFFFFFFFFLL ? result->nanos : 0xFFFFFFFFLL);
+  if (!solving) {
+    return VERDICT_SIZE;
+  }
+  p[8] = (result->attempted ? 1 : 0) | (result->solved ? 2 : 0) | (result->outOfBudget ? 4 : 0);
+  p[9] = result->strategy;
+  putU16(p + 10, result->fixedCells);
+  putU64(p + 12, result->solutions);
+  putU32(p + 20, result->solveNanos < 0xFFFFFFFFLL ? result->solveNanos : 0xFFFFFFFFLL);
+  return SOLVED_VERDICT_SIZE;
+}
+
+// unpacks one verdict written by encodeVerdict, returns the bytes read
+size_t decodeVerdict(const unsigned char* v, bool solving, PuzzleResult* result) {
+  result->loaded = (v[0] & 1) != 0;
+  result->complete = (v[0] & 2) != 0;
+  result->valid = (v[0] & 4) != 0;
+  result->failingUnit = v[1];
+  result->failingIndex = getU16(v + 2);
+  result->nanos = getU32(v + 4);
+  if (!solving) {
+    return VERDICT_SIZE;
+  }
+  result->attempted = (v[8] & 1) != 0;
+  result->solved = (v[8] & 2) != 0;
+  result->outOfBudget = (v[8] & 4) != 0;
+  result->strategy = v[9] <= SOLVER_PORTFOLIO ? v[9] : SOLVER_NONE;
+  result->fixedCells = getU16(v + 10);
+  result->solutions = getU64(v + 12);
+  result->solveNanos = getU32(v + 20);
+  return SOLVED_VERDICT_SIZE;
+}
+
+// worker mode, connects to the coordinator at address and validates the
+// batches it sends until it says it is done, completing incomplete puzzles
+// when the options the coordinator sent first name a solver
+// returns false if the coordinator cannot be reached or the connection breaks
+bool runNetWorker(const char* address, int numThreads, ResultCache* cache, DiskCache* diskCache) {
+  struct sockaddr_in addr;
+  if (!parseHostPort(address, &addr)) {
+    printf("Could not resolve %s\n", address);
+    return false;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+    printf("Could not connect to %s\n", address);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  // the solve options arrive from the coordinator, the cache is this worker's
+  SolveOptions solve = {SOLVER_NONE, SOLVE_ONE, 1, 0, 0, 0, cache, diskCache};
+  PuzzleBatch batch;
+  initPuzzleBatch(&batch);
+  batch.diskCache = diskCache;
+  unsigned char* payload = NULL;
+  size_t capacity = 0;
+  unsigned char* reply = NULL;
+  size_t replyCapacity = 0;
+  long batches = 0;
+  bool ok = false;
+  for (;;) {
+    unsigned int type;
+    unsigned long long seq;
+    size_t len;
+    if (!readFrame(fd, &type, &seq, &payload, &capacity, &len)) {
+      break;
+    }
+    if (type == FRAME_DONE) {
+      ok = true;
+      break;
+    }
+    if (type == FRAME_OPTIONS) {
+      if (!decodeOptionsFrame(payload, len, &solve)) {
+        break;
+      }
+      batch.solve = solve.kind != SOLVER_NONE ? &solve : NULL;
+      continue;
+    }
+    if (type != FRAME_BATCH || !decodeBatchFrame(payload, len, &batch)) {
+      break;
+    }
+    validateBatch(&batch, numThreads);
+
+    bool solving = batch.solve != NULL;
+    size_t entrySize = solving ? SOLVED_VERDICT_SIZE : VERDICT_SIZE;
+    size_t replyLen = FRAME_HEADER_SIZE + 4 + (size_t) batch.count * entrySize;
+    if (replyLen > replyCapacity) {
+      reply = realloc(reply, replyLen);
+      if (reply == NULL) {
+        printf("ERROR: out of memory for network frame\n");
+        exit(EXIT_FAILURE);
+      }
+      replyCapacity = replyLen;
+    }
+    putFrameHeader(reply, FRAME_VERDICTS, replyLen - FRAME_HEADER_SIZE, seq);
+    putU32(reply + FRAME_HEADER_SIZE, batch.count);
+    unsigned char* p = reply + FRAME_HEADER_SIZE + 4;
+    for (int i = 0; i < batch.count; i++) {
+      p += encodeVerdict(&batch.results[i], solving, p);
+    }
+    if (!sendAll(fd, reply, replyLen)) {
+      break;
+    }
+    batches++;
+  }
+  close(fd);
+  free(payload);
+  free(reply);
+  freePuzzleBatch(&batch);
+  fprintf(stderr, "worker: %ld batches validated\n", batches);
+  return ok;
+}
+
+// reads up to NET_BATCH_PUZZLES puzzles from the inputs into batch
+// *p is the input being read and *open whether source holds it
+// returns false when every input is exhausted or one cannot be opened
+bool readNetBatch(PathList* paths, bool gzipInput, int* p, bool* open, PuzzleSource* source,
+                  PuzzleBatch* batch, long* failures) {
+  int cells[MAX_PUZZLE_SIZE * MAX_PUZZLE_SIZE];
+  clearPuzzleBatch(batch);
+  while (batch->count < NET_BATCH_PUZZLES && *p < paths->count) {
+    if (!*open) {
+      if (!openPuzzleSource(source, paths->items[*p], gzipInput)) {
+        // the coordinator's records may be on stdout, as in the pipeline
+        fprintf(stderr, "Could not open file %s\n", paths->items[*p]);
+        *failures = -1;
+        *p = paths->count;
+        return false;
+      }
+      *open = true;
+    }
+    int psize = nextPuzzle(&source->stream, cells);
+    if (psize == 0 || psize == -2) {
+      if (psize == -2) {
+        fprintf(stderr, "ERROR: reading %s failed\n", paths->items[*p]);
+        (*failures)++;
+      }
+      closePuzzleSource(source);
+      *open = false;
+      (*p)++;
+      continue;
+    }
+    if (psize < 0) {
+      (*failures)++;
+    }
+    addToBatch(batch, psize, cells);
+  }
+  return batch->count > 0;
+}
+
+// stops using a worker, its unanswered batches go back to the pending ones
+void dropNetWorker(NetWorker* workers, int w, NetBatch* window, long firstSeq, long nextSeq,
+                   long* redispatched) {
+  close(workers[w].fd);
+  workers[w].fd = -1;
+  workers[w].inFlight = 0;
+  for (long seq = firstSeq; seq < nextSeq; seq++) {
+    NetBatch* held = &window[seq % NET_MAX_OUTSTANDING];
+    if (held->state == NET_SENT && held->worker == w) {
+      held->state = NET_PENDING;
+      (*redispatched)++;
+    }
+  }
+}
+
+// coordinator mode, listens on address and hands batches of the corpora to
+// the workers that connect, writing their verdicts in input order
+// each worker gets the solve options first and completes incomplete puzzles
+// a worker that disconnects has its unanswered batches sent to another one
+// returns the number of malformed records, or -1 if an input or the socket fails
+long runNetCoordinator(PathList* paths, const char* address, bool gzipInput, OutputFormat format,
+                       const SolveOptions* solve) {
+  struct sockaddr_in addr;
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  if (listener >= 0) {
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  }
+  if (listener < 0 || !parseHostPort(address, &addr)
+      || bind(listener, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(listener, 64) != 0) {
+    fprintf(diagnosticOutput(format), "Could not listen on %s\n", address);
+    if (listener >= 0) {
+      close(listener);
+    }
+    return -1;
+  }
+
+  ResultWriter* writer = malloc(sizeof(ResultWriter));
+  initResultWriter(writer, stdout, format);
+  setResultSolving(writer, solve);
+  writeResultHeader(writer);
+  size_t entrySize = writer->solving ? SOLVED_VERDICT_SIZE : VERDICT_SIZE;
+  unsigned char options[FRAME_HEADER_SIZE + FRAME_OPTIONS_SIZE];
+  encodeOptionsFrame(solve, options);
+  SolveStats stats = {0, 0, 0, 0, 0, {0}};
+  NetBatch* window = calloc(NET_MAX_OUTSTANDING, sizeof(NetBatch));
+  NetWorker* workers = NULL;
+  int workerCount = 0;
+  struct pollfd* fds = NULL;
+  unsigned char* payload = NULL;
+  size_t capacity = 0;
+  long firstSeq = 0;
+  long nextSeq = 0;
+  long id = 0;
+  long failures = 0;
+  long redispatched = 0;
+  int connected = 0;
+  int p = 0;
+  bool open = false;
+  bool inputDone = false;
+  PuzzleSource source;
+  long long start = nowNanos();
+
+  while (!inputDone || firstSeq < nextSeq) {
+    // read ahead while there is room in the window
+    while (!inputDone && nextSeq - firstSeq < NET_MAX_OUTSTANDING) {
+      NetBatch* held = &window[nextSeq % NET_MAX_OUTSTANDING];
+      if (!readNetBatch(paths, gzipInput, &p, &open, &source, &held->batch, &failures)) {
+        inputDone = true;
+        break;
+      }
+      held->seq = nextSeq++;
+      held->state = NET_PENDING;
+      held->frame = encodeBatchFrame(&held->batch, held->seq, &held->frameLen);
+    }
+    if (failures < 0) {
+      break;
+    }
+
+    // hand pending batches, oldest first, to workers with room
+    for (long seq = firstSeq; seq < nextSeq; seq++) {
+      NetBatch* held = &window[seq % NET_MAX_OUTSTANDING];
+      int w = 0;
+      while (held->state == NET_PENDING && w < workerCount) {
+        if (workers[w].fd >= 0 && workers[w].inFlight < NET_WORKER_WINDOW) {
+          if (sendAll(workers[w].fd, held->frame, held->frameLen)) {
+            held->state = NET_SENT;
+            held->worker = w;
+            workers[w].inFlight++;
+          }
+          else {
+            dropNetWorker(workers, w, window, firstSeq, nextSeq, &redispatched);
+          }
+        }
+        w++;
+      }
+    }
+
+    // wait for a new worker or a verdict
+    if (firstSeq == nextSeq) {
+      continue;
+    }
+    fds = realloc(fds, (workerCount + 1) * sizeof(struct pollfd));
+    fds[0].fd = listener;
+    fds[0].events = POLLIN;
+    for (int w = 0; w < workerCount; w++) {
+      fds[w + 1].fd = workers[w].fd;
+      fds[w + 1].events = POLLIN;
+    }
+    if (poll(fds, workerCount + 1, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(diagnosticOutput(format), "ERROR: poll on workers failed\n");
+      failures = -1;
+      break;
+    }
+    for (int w = 0; w < workerCount; w++) {
+      if (workers[w].fd < 0 || fds[w + 1].revents == 0) {
+        continue;
+      }
+      unsigned int type;
+      unsigned long long seq;
+      size_t len;
+      bool ok = readFrame(workers[w].fd, &type, &seq, &payload, &capacity, &len)
+                && type == FRAME_VERDICTS && (long) seq >= firstSeq && (long) seq < nextSeq;
+      NetBatch* held = ok ? &window[seq % NET_MAX_OUTSTANDING] : NULL;
+      ok = ok && held->state == NET_SENT && held->worker == w && len >= 4
+           && getU32(payload) == (unsigned int) held->batch.count
+           && len == 4 + (size_t) held->batch.count * entrySize;
+      if (!ok) {
+        dropNetWorker(workers, w, window, firstSeq, nextSeq, &redispatched);
+        continue;
+      }
+      const unsigned char* v = payload + 4;
+      for (int i = 0; i < held->batch.count; i++) {
+        v += decodeVerdict(v, writer->solving, &held->batch.results[i]);
+      }
+      held->state = NET_DONE;
+      workers[w].inFlight--;
+    }
+    if (fds[0].revents != 0) {
+      int fd = accept(listener, NULL, NULL);
+      if (fd >= 0 && !sendAll(fd, options, sizeof(options))) {
+        close(fd);
+      }
+      else if (fd >= 0) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        workers = realloc(workers, (workerCount + 1) * sizeof(NetWorker));
+        workers[workerCount].fd = fd;
+        workers[workerCount].inFlight = 0;
+        workerCount++;
+        connected++;
+      }
+    }
+
+    // write finished batches in input order
+    while (firstSeq < nextSeq && window[firstSeq % NET_MAX_OUTSTANDING].state == NET_DONE) {
+      NetBatch* held = &window[firstSeq % NET_MAX_OUTSTANDING];
+      for (int i = 0; i < held->batch.count; i++) {
+        writeResultRecord(writer, NULL, ++id, &held->batch.results[i]);
+        if (writer->solving) {
+          addSolveStats(&stats, &held->batch.results[i]);
+        }
+      }
+      free(held->frame);
+      held->frame = NULL;
+      firstSeq++;
+    }
+  }
+
+  // let the workers go
+  unsigned char done[FRAME_HEADER_SIZE];
+  putFrameHeader(done, FRAME_DONE, 0, nextSeq);
+  for (int w = 0; w < workerCount; w++) {
+    if (workers[w].fd >= 0) {
+      sendAll(workers[w].fd, done, sizeof(done));
+      close(workers[w].fd);
+    }
+  }
+  close(listener);
+  if (open) {
+    closePuzzleSource(&source);
+  }
+  flushResultWriter(writer);
+  free(writer);
+  for (int i = 0; i < NET_MAX_OUTSTANDING; i++) {
+    free(window[i].frame);
+    freePuzzleBatch(&window[i].batch);
+  }
+  free(window);
+  free(workers);
+  free(fds);
+  free(payload);
+
+  double seconds = (nowNanos() - start) / 1e9;
+  fprintf(stderr, "coordinator: %ld puzzles in %.3f s, %.0f puzzles/s, %d workers, %ld batches sent again\n",
+          id, seconds, seconds > 0 ? id / seconds : 0.0, connected, redispatched);
+  printSolveStats(&stats, solve);
+  return failures;
+}
+
+void printUsage(void) {
+  printf("usage: ./sudoku [-s] [-e logic|bitmask|dlx|sat|portfolio] [-m one|count|unique|all] [-n limit] [-N nodes] [-T milliseconds] [-t threads] [-c] [-f text|csv|jsonl] [-j threads] [-u] [-l list.txt] puzzle.txt|directory ...\n");
+  printf("       ./sudoku [-f text|csv|jsonl] [-z] - < puzzles.txt\n");
+  printf("       ./sudoku -d puzzle.cnf puzzle.txt\n");
+  printf("       ./sudoku [-f text|csv|jsonl] corpus.txt.gz\n");
+  printf("       ./sudoku -b [solve options] [-C cache.file] [-k checkpoint.file] [-f text|csv|jsonl] [-j threads] [-z] corpus.txt|- ...\n");
+  printf("       ./sudoku -b -p readers,parsers,validators [-q depth] [solve options] [-C cache.file] [-f text|csv|jsonl] [-z] corpus.txt|- ...\n");
+  printf("       ./sudoku -b -S [host:]port [solve options] [-f text|csv|jsonl] [-z] corpus.txt|- ...\n");
+  printf("       ./sudoku -W host:port [-c] [-C cache.file] [-j threads]\n");
+  printf("       ./sudoku -b -P processes [-a] [solve options] [-C cache.file] [-f text|csv|jsonl] [-j threads] corpus.txt ...\n");
+  printf("solve options: [-s] [-e solver] [-m mode] [-n limit] [-N nodes] [-T milliseconds] [-t threads] [-c]\n");
+}
+
+// expects file names or directories of puzzles as arguments in command line
+// -j sets the number of files validated at the same time
+// -l names a file holding one puzzle path per line
+// -u reads the files through io_uring, falling back to the worker threads
+// -s completes puzzles that have empty cells and prints the completed grid
+// -e picks the solver (logic by default) and implies -s, -m count counts the solutions of each
+// puzzle, -m unique stops at the second one and -m all lists every solution (dlx only)
+// -n stops counting at that many solutions
+// -N and -T give the search of each puzzle a budget of nodes and milliseconds,
+// a puzzle that runs out of it is left with the most cells the search fixed
+// and reported as stopped (count and unique answers are then incomplete)
+// -e sat solves the sat encoding of the puzzle by clause learning, -d writes
+// that encoding to a DIMACS file instead of validating the puzzle
+// -e portfolio races the bitmask, dlx, logic and sat solvers on each puzzle
+// and reports which one answered first
+// -t searches each puzzle on several threads (logic engine)
+// a single - reads a stream of puzzles from stdin and prints one line per puzzle
+// -z decompresses that stream with gzip, a single .gz file is streamed the same way
+// -f csv or -f jsonl writes one compact record per puzzle instead of the text output
+// -b treats every argument as a corpus of many puzzles and validates them in batches
+// -p runs batch mode as a read/parse/validate/write pipeline with that many threads
+// per stage, -q sets the depth of the queues between the stages
+// -c answers a puzzle repeated, or equivalent under the sudoku symmetries, to
+// one solved before in the run from the solution cache instead of searching
+// -C keeps batch mode verdicts and search outcomes in an append-only log shared
+// between runs, read through a memory-mapped index kept next to it in file.index
+// -P splits every corpus over that many worker processes sharing the -j threads,
+// -a pins each worker process to its own cores
+// -k saves the progress of batch mode to a checkpoint file and resumes from it
+// -S makes batch mode a coordinator handing out batches to -W workers over tcp
+int main(int argc, char **argv) {
+  PathList paths = {NULL, 0, 0};
+  int numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+  bool useUring = false;
+  bool gzipInput = false;
+  bool batchMode = false;
+  bool useCache = false;
+  const char* diskCachePath = NULL;
+  const char* checkpointPath = NULL;
+  const char* serveAddress = NULL;
+  const char* workerAddress = NULL;
+  const char* dimacsPath = NULL;
+  int numProcs = 0;
+  bool pin = false;
+  int stages[3] = {0, 0, 0};
+  int queueDepth = PIPELINE_QUEUE_DEPTH;
+  OutputFormat format = FORMAT_TEXT;
+  SolveOptions solve = {SOLVER_NONE, SOLVE_ONE, 1, 0, 0, 0, NULL, NULL};
+  bool solverChosen = false;
+  int opt;
+  // the leading '-' hands back positional paths in place so that they keep
+  // their order relative to -l list files
+  while ((opt = getopt(argc, argv, "-abcC:d:e:f:j:k:l:m:n:N:p:P:q:sS:t:T:uW:z")) != -1) {
+    switch (opt) {
+      case 1:
+        if (!addInput(&paths, optarg)) {
+          printf("Could not open directory %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 's':
+        if (solve.kind == SOLVER_NONE) {
+          solve.kind = SOLVER_LOGIC;
+        }
+        break;
+      case 'e':
+        if (strcmp(optarg, "logic") == 0) {
+          solve.kind = SOLVER_LOGIC;
+        }
+        else if (strcmp(optarg, "bitmask") == 0) {
+          solve.kind = SOLVER_BITMASK;
+        }
+        else if (strcmp(optarg, "dlx") == 0) {
+          solve.kind = SOLVER_DLX;
+        }
+        else if (strcmp(optarg, "sat") == 0) {
+          solve.kind = SOLVER_SAT;
+        }
+        else if (strcmp(optarg, "portfolio") == 0) {
+          solve.kind = SOLVER_PORTFOLIO;
+        }
+        else {
+          printUsage();
+          return EXIT_FAILURE;
+        }
+        solverChosen = true;
+        break;
+      case 't':
+        solve.threads = atoi(optarg);
+        if (solve.threads < 1) {
+          printUsage();
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'm':
+        if (strcmp(optarg, "one") == 0) {
+          solve.mode = SOLVE_ONE;
+        }
+        else if (strcmp(optarg, "count") == 0) {
+          solve.mode = SOLVE_COUNT;
+        }
+        else if (strcmp(optarg, "unique") == 0) {
+          solve.mode = SOLVE_UNIQUE;
+        }
+        else if (strcmp(optarg, "all") == 0) {
+          solve.mode = SOLVE_ALL;
+        }
+        else {
+          printUsage();
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'n':
+        solve.limit = atoll(optarg);
+        if (solve.limit < 1) {
+          printUsage();
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'N':
+        solve.nodeBudget = atoll(optarg);
+        if (solve.nodeBudget < 1) {
+          printUsage();
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'T':
+        solve.timeBudget = atoll(optarg) * 1000000LL;
+        if (solve.timeBudget < 1) {
+          printUsage();
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'd':
+        dimacsPath = optarg;
+        break;
+      case 'S':
+        serveAddress = optarg;
+        break;
+      case 'W':
+        workerAddress = optarg;
+        break;
+      case 'k':
+        checkpointPath = optarg;
+        break;
+      case 'a':
+        pin = true;
+        break;
+      case 'P':
+        numProcs = atoi(optarg);
+        if (numProcs < 1) {
+          printUsage();
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'C':
+        diskCachePath = optarg;
+        break;
+      case 'c':
+        useCache = true;
+        break;
+      case 'p':
+        if (sscanf(optarg, "%d,%d,%d", &stages[0], &stages[1], &stages[2]) != 3
+            || stages[0] < 1 || stages[1] < 1 || stages[2] < 1) {
+          printUsage();
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'q':
+        queueDepth = atoi(optarg);
+        if (queueDepth < 1) {
+          printUsage();
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'b':
+        batchMode = true;
+        break;
+      case 'f':
+        if (strcmp(optarg, "text") == 0) {
+          format = FORMAT_TEXT;
+        }
+        else if (strcmp(optarg, "csv") == 0) {
+          format = FORMAT_CSV;
+        }
+        else if (strcmp(optarg, "jsonl") == 0) {
+          format = FORMAT_JSONL;
+        }
+        else {
+          printUsage();
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'z':
+        gzipInput = true;
+        break;
+      case 'u':
+        useUring = true;
+        break;
+      case 'j':
+        numThreads = atoi(optarg);
+        if (numThreads < 1) {
+          printUsage();
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'l':
+        if (!addListFile(&paths, optarg)) {
+          printf("Could not open file %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      default:
+        printUsage();
+        return EXIT_FAILURE;
+    }
+  }
+  for (int i = optind; i < argc; i++) {
+    if (!addInput(&paths, argv[i])) {
+      printf("Could not open directory %s\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  if ((solve.threads > 1 || solve.nodeBudget > 0 || solve.timeBudget > 0) && solve.kind == SOLVER_NONE) {
+    solve.kind = SOLVER_LOGIC;
+  }
+  if (solve.threads > 1 && (solve.kind != SOLVER_LOGIC || solve.mode != SOLVE_ONE)) {
+    // only the logic engine splits its search over threads
+    printUsage();
+    return EXIT_FAILURE;
+  }
+  if (solve.mode == SOLVE_ALL) {
+    // only the exact cover search writes out every solution it reaches
+    if (solverChosen && solve.kind != SOLVER_DLX) {
+      printUsage();
+      return EXIT_FAILURE;
+    }
+    solve.kind = SOLVER_DLX;
+  }
+  else if (solve.mode != SOLVE_ONE && solve.kind == SOLVER_NONE) {
+    solve.kind = SOLVER_LOGIC;
+  }
+  if (workerAddress != NULL && solve.kind != SOLVER_NONE) {
+    // a tcp worker solves with the options its coordinator sends
+    printUsage();
+    return EXIT_FAILURE;
+  }
+  if ((paths.count == 0) == (workerAddress == NULL)) {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+  if (dimacsPath != NULL) {
+    // the encoding of one puzzle, for an outside sat solver
+    if (paths.count != 1 || batchMode || strcmp(paths.items[0], "-") == 0) {
+      printUsage();
+      return EXIT_FAILURE;
+    }
+    int** grid;
+    int psize = readSudokuPuzzle(paths.items[0], &grid);
+    FILE* out = fopen(dimacsPath, "w");
+    if (out == NULL) {
+      printf("Could not open file %s\n", dimacsPath);
+      return EXIT_FAILURE;
+    }
+    writeSatDimacs(out, psize, grid);
+    fclose(out);
+    deleteSudokuPuzzle(psize, grid);
+    freePathList(&paths);
+    return EXIT_SUCCESS;
+  }
+  if (numThreads < 1) {
+    numThreads = 1;
+  }
+  if (checkpointPath != NULL && (!batchMode || numProcs > 0 || stages[0] > 0 || serveAddress != NULL)) {
+    // only the plain batch runner writes its output in checkpointed rounds
+    printUsage();
+    return EXIT_FAILURE;
+  }
+  // every mode that solves looks its puzzles up in the solution cache first
+  ResultCache cache;
+  if (useCache) {
+    initResultCache(&cache);
+    solve.cache = &cache;
+  }
+  if (batchMode || workerAddress != NULL) {
+    DiskCache diskCache;
+    if (diskCachePath != NULL && !openDiskCache(&diskCache, diskCachePath)) {
+      fprintf(diagnosticOutput(format), "Could not open cache file %s\n", diskCachePath);
+      freePathList(&paths);
+      return EXIT_FAILURE;
+    }
+    // batches look verdicts up in it and their solves look answers up in it
+    solve.diskCache = diskCachePath != NULL ? &diskCache : NULL;
+    long failures;
+    if (workerAddress != NULL) {
+      failures = runNetWorker(workerAddress, numThreads, useCache ? &cache : NULL,
+                              diskCachePath ? &diskCache : NULL) ? 0 : -1;
+    }
+    else if (serveAddress != NULL) {
+      failures = runNetCoordinator(&paths, serveAddress, gzipInput, format, &solve);
+    }
+    else if (numProcs > 0) {
+      failures = validateSharded(&paths, numProcs, numThreads, pin, diskCachePath ? &diskCache : NULL,
+                                 format, &solve);
+    }
+    else if (stages[0] > 0) {
+      failures = runPipeline(&paths, gzipInput, stages[0], stages[1], stages[2], queueDepth,
+                             diskCachePath ? &diskCache : NULL, format, &solve);
+    }
+    else {
+      failures = validateCorpora(&paths, numThreads, gzipInput, diskCachePath ? &diskCache : NULL,
+                                 checkpointPath, format, &solve);
+    }
+    if (useCache) {
+      freeResultCache(&cache);
+    }
+    if (diskCachePath != NULL) {
+      closeDiskCache(&diskCache);
+    }
+    freePathList(&paths);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if (paths.count == 1 && (isGzipPath(paths.items[0]) || strcmp(paths.items[0], "-") == 0)) {
+    PuzzleSource source;
+    if (!openPuzzleSource(&source, paths.items[0], gzipInput)) {
+      fprintf(diagnosticOutput(format), "Could not open file %s\n", paths.items[0]);
+      freePathList(&paths);
+      return EXIT_FAILURE;
+    }
+    long failures = validateStream(&source.stream, format, &solve);
+    closePuzzleSource(&source);
+    printCacheStats(solve.cache, NULL);
+    if (useCache) {
+      freeResultCache(&cache);
+    }
+    freePathList(&paths);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if (numThreads > paths.count) {
+    numThreads = paths.count;
+  }
+
+  int failures = validateFiles(&paths, numThreads, useUring, format, &solve);
+  printCacheStats(solve.cache, NULL);
+  if (useCache) {
+    freeResultCache(&cache);
+  }
+  freePathList(&paths);
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}